@@ -0,0 +1,171 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KORE_ADDRESSINDEX_H
+#define KORE_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+//! Address types stored in the address indexes
+enum AddressIndexType {
+    ADDRESS_TYPE_NONE = 0,
+    ADDRESS_TYPE_PUBKEYHASH = 1, //! Pay-to-pubkey-hash and pay-to-pubkey outputs, keyed by the key hash
+    ADDRESS_TYPE_SCRIPTHASH = 2,
+};
+
+/** Heights and transaction positions are stored big-endian so that keys of one address sort by height */
+template <typename Stream>
+inline void SerializeBE32(Stream& s, uint32_t n)
+{
+    unsigned char buf[4];
+    WriteBE32(buf, n);
+    s.write((char*)buf, 4);
+}
+
+template <typename Stream>
+inline uint32_t UnserializeBE32(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, 4);
+    return ReadBE32(buf);
+}
+
+/** Key of one output of an address that is still unspent */
+struct CAddressUnspentKey {
+    unsigned int type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey() : type(ADDRESS_TYPE_NONE), index(0) {}
+    CAddressUnspentKey(unsigned int typeIn, const uint160& hashBytesIn, const uint256& txhashIn, unsigned int indexIn) : type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), index(indexIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + 32 + 4;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char chType;
+        ::Unserialize(s, chType, nType, nVersion);
+        type = chType;
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+    }
+};
+
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+
+    CAddressUnspentValue() { SetNull(); }
+    CAddressUnspentValue(CAmount satoshisIn, const CScript& scriptIn, int blockHeightIn) : satoshis(satoshisIn), script(scriptIn), blockHeight(blockHeightIn) {}
+
+    //! A null value in an update erases the entry
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const { return satoshis == -1; }
+};
+
+/** Key of one credit (output) or debit (spending input) of an address */
+struct CAddressIndexKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey() : type(ADDRESS_TYPE_NONE), blockHeight(0), txindex(0), index(0), spending(false) {}
+    CAddressIndexKey(unsigned int typeIn, const uint160& hashBytesIn, int blockHeightIn, unsigned int txindexIn, const uint256& txhashIn, unsigned int indexIn, bool spendingIn) : type(typeIn), hashBytes(hashBytesIn), blockHeight(blockHeightIn), txindex(txindexIn), txhash(txhashIn), index(indexIn), spending(spendingIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + 4 + 4 + 32 + 4 + 1;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        SerializeBE32(s, blockHeight);
+        SerializeBE32(s, txindex);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+        ::Serialize(s, spending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char chType;
+        ::Unserialize(s, chType, nType, nVersion);
+        type = chType;
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = UnserializeBE32(s);
+        txindex = UnserializeBE32(s);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+        ::Unserialize(s, spending, nType, nVersion);
+    }
+};
+
+/** Prefix of all CAddressIndexKey (or CAddressUnspentKey) entries of one address, from an optional height on */
+struct CAddressIndexIteratorKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight; //! -1 to leave the height out of the prefix
+
+    CAddressIndexIteratorKey(unsigned int typeIn, const uint160& hashBytesIn, int blockHeightIn = -1) : type(typeIn), hashBytes(hashBytesIn), blockHeight(blockHeightIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + (blockHeight >= 0 ? 4 : 0);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, (unsigned char)type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        if (blockHeight >= 0)
+            SerializeBE32(s, blockHeight);
+    }
+};
+
+#endif // KORE_ADDRESSINDEX_H
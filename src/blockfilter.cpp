@@ -0,0 +1,371 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "main.h"
+#include "util.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+CBlockFilterDB* pblockfilterdb = NULL;
+
+namespace
+{
+//! Last block of the active chain with a filter (protected by cs_main)
+const CBlockIndex* pindexFilterBest = NULL;
+//! Set once the builder thread has caught up; from then on ConnectTip keeps the index current (protected by cs_main)
+bool fFilterIndexSynced = false;
+
+/** Writes bits most significant first */
+class CBitWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+    unsigned char nBuffer;
+    int nOffset;
+
+public:
+    CBitWriter(std::vector<unsigned char>& vchIn) : vch(vchIn), nBuffer(0), nOffset(0) {}
+
+    void Write(uint64_t nData, int nBits)
+    {
+        while (nBits > 0) {
+            int nNow = std::min(8 - nOffset, nBits);
+            nBuffer |= ((nData >> (nBits - nNow)) & ((1U << nNow) - 1)) << (8 - nOffset - nNow);
+            nOffset += nNow;
+            nBits -= nNow;
+            if (nOffset == 8)
+                Flush();
+        }
+    }
+
+    void Flush()
+    {
+        if (nOffset == 0)
+            return;
+        vch.push_back(nBuffer);
+        nBuffer = 0;
+        nOffset = 0;
+    }
+};
+
+class CBitReader
+{
+private:
+    const std::vector<unsigned char>& vch;
+    size_t nPos;
+    int nOffset;
+
+public:
+    CBitReader(const std::vector<unsigned char>& vchIn) : vch(vchIn), nPos(0), nOffset(0) {}
+
+    uint64_t Read(int nBits)
+    {
+        uint64_t nData = 0;
+        while (nBits > 0) {
+            if (nPos >= vch.size())
+                throw std::runtime_error("CBitReader::Read : end of data");
+            int nNow = std::min(8 - nOffset, nBits);
+            nData = (nData << nNow) | ((vch[nPos] >> (8 - nOffset - nNow)) & ((1U << nNow) - 1));
+            nOffset += nNow;
+            nBits -= nNow;
+            if (nOffset == 8) {
+                nPos++;
+                nOffset = 0;
+            }
+        }
+        return nData;
+    }
+};
+
+void GolombRiceEncode(CBitWriter& writer, int nP, uint64_t nValue)
+{
+    // Quotient in unary, remainder in nP bits
+    uint64_t nQuotient = nValue >> nP;
+    while (nQuotient > 0) {
+        int nBits = (int)std::min(nQuotient, (uint64_t)64);
+        writer.Write(~0ULL, nBits);
+        nQuotient -= nBits;
+    }
+    writer.Write(0, 1);
+    writer.Write(nValue, nP);
+}
+
+uint64_t GolombRiceDecode(CBitReader& reader, int nP)
+{
+    uint64_t nQuotient = 0;
+    while (reader.Read(1) == 1)
+        nQuotient++;
+    return (nQuotient << nP) + reader.Read(nP);
+}
+
+//! (x * n) >> 64, mapping a uniform 64-bit hash onto [0, n)
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * n) >> 64);
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t ac = x_hi * n_hi, ad = x_hi * n_lo, bc = x_lo * n_hi, bd = x_lo * n_lo;
+    uint64_t mid = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid >> 32);
+#endif
+}
+
+bool IsFilterElement(const CScript& script)
+{
+    return !script.empty() && script[0] != OP_RETURN;
+}
+}
+
+bool IsExactMatchScript(const CScript& script)
+{
+    if (script.empty() || script.IsUnspendable() || script.IsNormalPaymentScript() || script.IsPayToScriptHash())
+        return true;
+    return ((script.size() == 35 && script[0] == 33) || (script.size() == 67 && script[0] == 65)) && script.back() == OP_CHECKSIG;
+}
+
+CBlockFilter::CBlockFilter(const CBlock& block, const CBlockUndo& blockundo) : hashBlock(block.GetHash()), nElements(0), fOnlyExactScripts(true)
+{
+    std::set<CScript> setElements;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        BOOST_FOREACH (const CTxOut& txout, tx.vout) {
+            if (IsFilterElement(txout.scriptPubKey))
+                setElements.insert(txout.scriptPubKey);
+            fOnlyExactScripts = fOnlyExactScripts && IsExactMatchScript(txout.scriptPubKey);
+        }
+    }
+    BOOST_FOREACH (const CTxUndo& txundo, blockundo.vtxundo) {
+        BOOST_FOREACH (const CTxInUndo& txinundo, txundo.vprevout) {
+            if (IsFilterElement(txinundo.txout.scriptPubKey))
+                setElements.insert(txinundo.txout.scriptPubKey);
+            fOnlyExactScripts = fOnlyExactScripts && IsExactMatchScript(txinundo.txout.scriptPubKey);
+        }
+    }
+
+    nElements = setElements.size();
+    std::vector<uint64_t> vValues;
+    vValues.reserve(nElements);
+    BOOST_FOREACH (const CScript& script, setElements)
+        vValues.push_back(HashToRange(script));
+    std::sort(vValues.begin(), vValues.end());
+
+    CBitWriter writer(vchFilter);
+    uint64_t nLast = 0;
+    BOOST_FOREACH (uint64_t nValue, vValues) {
+        GolombRiceEncode(writer, P, nValue - nLast);
+        nLast = nValue;
+    }
+    writer.Flush();
+}
+
+uint64_t CBlockFilter::HashToRange(const CScript& script) const
+{
+    // The SipHash key is the first 16 bytes of the block hash, as in BIP158
+    const unsigned char* pkey = hashBlock.begin();
+    uint64_t nHash = CSipHasher(ReadLE64(pkey), ReadLE64(pkey + 8)).Write(script.data(), script.size()).Finalize();
+    return MapIntoRange(nHash, (uint64_t)nElements * M);
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    return Hash(vchFilter.begin(), vchFilter.end());
+}
+
+bool CBlockFilter::Match(const CScript& script) const
+{
+    std::set<CScript> setScripts;
+    setScripts.insert(script);
+    return MatchAny(setScripts);
+}
+
+bool CBlockFilter::MatchAny(const std::set<CScript>& setScripts) const
+{
+    if (nElements == 0 || setScripts.empty())
+        return false;
+
+    std::vector<uint64_t> vQuery;
+    vQuery.reserve(setScripts.size());
+    BOOST_FOREACH (const CScript& script, setScripts)
+        vQuery.push_back(HashToRange(script));
+    std::sort(vQuery.begin(), vQuery.end());
+
+    // Walk the filter and the sorted queries in step
+    CBitReader reader(vchFilter);
+    std::vector<uint64_t>::const_iterator it = vQuery.begin();
+    uint64_t nValue = 0;
+    try {
+        for (uint32_t i = 0; i < nElements; i++) {
+            nValue += GolombRiceDecode(reader, P);
+            while (it != vQuery.end() && *it < nValue)
+                ++it;
+            if (it == vQuery.end())
+                return false;
+            if (*it == nValue)
+                return true;
+        }
+    } catch (const std::exception& e) {
+        // A damaged filter can't rule anything out
+        LogPrintf("%s : %s in filter of block %s\n", __func__, e.what(), hashBlock.ToString());
+        return true;
+    }
+    return false;
+}
+
+CBlockFilterDB::CBlockFilterDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "filter", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256& hashBlock, CBlockFilter& filter)
+{
+    if (!Read(make_pair('f', hashBlock), filter))
+        return false;
+    // Filters written before the marker existed read as inconclusive
+    filter.fOnlyExactScripts = Exists(make_pair('e', hashBlock));
+    return true;
+}
+
+bool CBlockFilterDB::WriteFilter(const CBlockFilter& filter, const uint256& hashBest)
+{
+    CLevelDBBatch batch;
+    batch.Write(make_pair('f', filter.GetBlockHash()), filter);
+    if (filter.HasOnlyExactScripts())
+        batch.Write(make_pair('e', filter.GetBlockHash()), '1');
+    else
+        batch.Erase(make_pair('e', filter.GetBlockHash()));
+    batch.Write('B', hashBest);
+    return WriteBatch(batch);
+}
+
+bool CBlockFilterDB::ReadBestBlock(uint256& hashBest)
+{
+    return Read('B', hashBest);
+}
+
+bool CBlockFilterDB::WriteBestBlock(const uint256& hashBest)
+{
+    return Write('B', hashBest);
+}
+
+bool BuildBlockFilter(const CBlock& block, const CBlockIndex* pindex, CBlockFilter& filter)
+{
+    CBlockUndo blockundo;
+    // Only the coinbase has no undo data
+    if (block.vtx.size() > 1) {
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull() || !blockundo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()))
+            return error("%s : no undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    filter = CBlockFilter(block, blockundo);
+    return true;
+}
+
+bool GetBlockFilter(const CBlockIndex* pindex, CBlockFilter& filter)
+{
+    return pblockfilterdb && pblockfilterdb->ReadFilter(pindex->GetBlockHash(), filter);
+}
+
+bool IsBlockFilterIndexSynced()
+{
+    AssertLockHeld(cs_main);
+    return pblockfilterdb && fFilterIndexSynced;
+}
+
+void BlockFilterIndexConnectTip(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!pblockfilterdb || !fFilterIndexSynced)
+        return;
+    if (pindex->pprev != pindexFilterBest) {
+        // Only happens after an earlier write failed; the index resumes from there on the next start
+        LogPrintf("%s : index is behind at block %s, not updating\n", __func__, pindexFilterBest ? pindexFilterBest->GetBlockHash().ToString() : "none");
+        fFilterIndexSynced = false;
+        return;
+    }
+    CBlockFilter filter;
+    if (!BuildBlockFilter(block, pindex, filter) || !pblockfilterdb->WriteFilter(filter, pindex->GetBlockHash())) {
+        LogPrintf("%s : failed to index block %s\n", __func__, pindex->GetBlockHash().ToString());
+        return;
+    }
+    pindexFilterBest = pindex;
+}
+
+void BlockFilterIndexDisconnectTip(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!pblockfilterdb || pindex != pindexFilterBest)
+        return;
+    // The filter itself stays, it is keyed by block hash and still valid should the block come back
+    pindexFilterBest = pindex->pprev;
+    pblockfilterdb->WriteBestBlock(pindexFilterBest->GetBlockHash());
+}
+
+void ThreadBlockFilterIndex()
+{
+    RenameThread("kore-filterindex");
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (pblockfilterdb && pblockfilterdb->ReadBestBlock(hashBest)) {
+            BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+            if (mi != mapBlockIndex.end())
+                pindexFilterBest = chainActive.FindFork(mi->second);
+        }
+        LogPrintf("Block filter index: building from height %d\n", pindexFilterBest ? pindexFilterBest->nHeight + 1 : 0);
+    }
+
+    int64_t nLastLog = GetTime();
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            if (!pblockfilterdb)
+                return;
+            if (pindexFilterBest && !chainActive.Contains(pindexFilterBest))
+                pindexFilterBest = chainActive.FindFork(pindexFilterBest);
+            pindex = pindexFilterBest ? chainActive.Next(pindexFilterBest) : chainActive.Genesis();
+            if (!pindex) {
+                fFilterIndexSynced = true;
+                LogPrintf("Block filter index: synced at height %d\n", chainActive.Height());
+                return;
+            }
+        }
+
+        // Read and build without cs_main, only the index update needs it
+        CBlock block;
+        CBlockFilter filter;
+        if (!ReadBlockFromDisk(block, pindex) || !BuildBlockFilter(block, pindex, filter)) {
+            LogPrintf("Block filter index: failed to build filter of block %s, stopping\n", pindex->GetBlockHash().ToString());
+            return;
+        }
+
+        LOCK(cs_main);
+        if (!pblockfilterdb)
+            return;
+        // Filters of blocks that were disconnected meanwhile are still stored, but the index doesn't advance
+        bool fActive = chainActive.Contains(pindex);
+        const CBlockIndex* pindexBest = fActive ? pindex : pindexFilterBest;
+        if (!pblockfilterdb->WriteFilter(filter, pindexBest ? pindexBest->GetBlockHash() : uint256(0))) {
+            LogPrintf("Block filter index: failed to write filter of block %s, stopping\n", pindex->GetBlockHash().ToString());
+            return;
+        }
+        pindexFilterBest = pindexBest;
+        if (GetTime() >= nLastLog + 60) {
+            nLastLog = GetTime();
+            LogPrintf("Block filter index: at height %d of %d\n", pindex->nHeight, chainActive.Height());
+        }
+    }
+}
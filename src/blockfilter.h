@@ -0,0 +1,121 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KORE_BLOCKFILTER_H
+#define KORE_BLOCKFILTER_H
+
+#include "leveldbwrapper.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+//! -blockfilterindex default
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+
+/**
+ * Whether a wallet decides if it owns an output with this script by looking
+ * the script up among its own (CWallet::GetScriptPubKeys): pay-to-pubkey-hash,
+ * pay-to-script-hash, pay-to-pubkey and scripts nobody can spend. Bare multisig
+ * and other templates are owned through their keys, a filter can't rule them out.
+ */
+bool IsExactMatchScript(const CScript& script);
+
+/**
+ * Golomb-coded set of the scriptPubKeys a block creates and spends, using
+ * the parameters of the BIP158 basic filter. A negative match is certain,
+ * a positive one is a false positive with probability 1/M per queried
+ * script.
+ */
+class CBlockFilter
+{
+public:
+    static const int P = 19;
+    static const uint64_t M = 784931;
+
+private:
+    uint256 hashBlock;
+    uint32_t nElements;
+    std::vector<unsigned char> vchFilter;
+    //! Not part of the BIP158 filter, CBlockFilterDB stores it alongside
+    bool fOnlyExactScripts;
+
+    uint64_t HashToRange(const CScript& script) const;
+
+    friend class CBlockFilterDB;
+
+public:
+    CBlockFilter() : nElements(0), fOnlyExactScripts(false) {}
+    CBlockFilter(const CBlock& block, const CBlockUndo& blockundo);
+
+    const uint256& GetBlockHash() const { return hashBlock; }
+    uint32_t GetElementCount() const { return nElements; }
+    const std::vector<unsigned char>& GetEncoded() const { return vchFilter; }
+    //! Double-SHA256 of the encoded filter
+    uint256 GetHash() const;
+
+    bool Match(const CScript& script) const;
+    //! Whether any of the scripts may be in the block; cheaper than calling Match for each
+    bool MatchAny(const std::set<CScript>& setScripts) const;
+    //! Whether every script the block creates or spends is an exact match script, so a miss
+    //! of all of a wallet's scripts means the block doesn't involve the wallet
+    bool HasOnlyExactScripts() const { return fOnlyExactScripts; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nElements);
+        READWRITE(vchFilter);
+    }
+};
+
+/** Access to the block filter index (in blocks/filter) */
+class CBlockFilterDB : public CLevelDBWrapper
+{
+public:
+    CBlockFilterDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CBlockFilterDB(const CBlockFilterDB&);
+    void operator=(const CBlockFilterDB&);
+
+public:
+    bool ReadFilter(const uint256& hashBlock, CBlockFilter& filter);
+    //! Store a filter, and record its block as the last one indexed on the active chain
+    bool WriteFilter(const CBlockFilter& filter, const uint256& hashBest);
+    bool ReadBestBlock(uint256& hashBest);
+    bool WriteBestBlock(const uint256& hashBest);
+};
+
+/**
+ * Global variable that points to the block filter index, NULL unless -blockfilterindex is set.
+ * Only assigned while AppInit2 loads the block index and deleted by PrepareShutdown after
+ * the RPC server has stopped, with cs_main held; in between it doesn't change and, LevelDB
+ * reads being thread safe, filters can be looked up without cs_main.
+ */
+extern CBlockFilterDB* pblockfilterdb;
+
+/** Build the filter of a connected block, reading its undo data from disk */
+bool BuildBlockFilter(const CBlock& block, const CBlockIndex* pindex, CBlockFilter& filter);
+/** Look up the filter of a block. Safe to call without cs_main, see pblockfilterdb. */
+bool GetBlockFilter(const CBlockIndex* pindex, CBlockFilter& filter);
+/** Whether the index has caught up with the active chain */
+bool IsBlockFilterIndexSynced();
+/** Keep the index in step with the active chain; called by ConnectTip and DisconnectTip with cs_main held */
+void BlockFilterIndexConnectTip(const CBlock& block, const CBlockIndex* pindex);
+void BlockFilterIndexDisconnectTip(const CBlockIndex* pindex);
+/** Build the filters of the blocks connected before the index was enabled */
+void ThreadBlockFilterIndex();
+
+#endif // KORE_BLOCKFILTER_H
@@ -0,0 +1,150 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cachefile.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+
+namespace
+{
+//! Leads every record file; the whole-file caches started with the length of their magic message instead
+const unsigned char pchCacheFileTag[4] = {'K', 'C', 'R', 'F'};
+
+//! Covers the type too, a record must not load into another map with an intact payload
+uint32_t RecordChecksum(unsigned char nType, const std::vector<unsigned char>& vchRecord)
+{
+    uint256 hash = Hash(&nType, &nType + 1, vchRecord.begin(), vchRecord.end());
+    uint32_t nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    return nChecksum;
+}
+}
+
+CCacheFileWriter::CCacheFileWriter(const boost::filesystem::path& pathIn, const std::string& strMagicMessage)
+    : pathDB(pathIn), pathTmp(pathIn.string() + ".new"), fileout(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION), nRecords(0), fError(false)
+{
+    if (fileout.IsNull()) {
+        error("%s : Failed to open file %s", __func__, pathTmp.string());
+        return;
+    }
+
+    try {
+        fileout << FLATDATA(pchCacheFileTag);
+        fileout << CACHEFILE_VERSION;
+        fileout << strMagicMessage;                   // cache file specific magic message
+        fileout << FLATDATA(Params().MessageStart()); // network specific magic number
+    } catch (std::exception& e) {
+        fError = true;
+        error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
+}
+
+void CCacheFileWriter::WriteRecord(unsigned char nType, const CDataStream& ssRecord)
+{
+    if (IsNull())
+        return;
+
+    std::vector<unsigned char> vchRecord(ssRecord.begin(), ssRecord.end());
+    try {
+        fileout << nType;
+        fileout << vchRecord;
+        fileout << RecordChecksum(nType, vchRecord);
+        nRecords++;
+    } catch (std::exception& e) {
+        fError = true;
+        error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
+}
+
+bool CCacheFileWriter::Commit()
+{
+    if (IsNull()) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp);
+        return false;
+    }
+
+    FileCommit(fileout.Get());
+    fileout.fclose();
+    if (!RenameOver(pathTmp, pathDB))
+        return error("%s : Rename-into-place failed for %s", __func__, pathDB.string());
+    return true;
+}
+
+CCacheFileReader::CCacheFileReader(const boost::filesystem::path& pathIn)
+    : pathDB(pathIn), filein(fopen(pathIn.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION), nRecords(0), nCorrupt(0)
+{
+}
+
+CacheFileStatus CCacheFileReader::ReadHeader(const std::string& strMagicMessage)
+{
+    if (filein.IsNull())
+        return CACHEFILE_IO_ERROR;
+
+    unsigned char pchTagTmp[4];
+    unsigned char pchMsgTmp[4];
+    int nVersionTmp = 0;
+    std::string strMagicMessageTmp;
+    try {
+        filein >> FLATDATA(pchTagTmp);
+        if (memcmp(pchTagTmp, pchCacheFileTag, sizeof(pchTagTmp)))
+            return CACHEFILE_OUTDATED;
+
+        filein >> nVersionTmp;
+        if (nVersionTmp != CACHEFILE_VERSION)
+            return CACHEFILE_OUTDATED;
+
+        filein >> strMagicMessageTmp;
+        if (strMagicMessage != strMagicMessageTmp)
+            return CACHEFILE_BAD_MAGIC;
+
+        filein >> FLATDATA(pchMsgTmp);
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return CACHEFILE_BAD_NETWORK;
+    } catch (std::exception& e) {
+        error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        return CACHEFILE_IO_ERROR;
+    }
+
+    return CACHEFILE_OK;
+}
+
+bool CCacheFileReader::Next(unsigned char& nType, CDataStream& ssRecord)
+{
+    std::vector<unsigned char> vchRecord;
+    uint32_t nChecksum;
+    while (!filein.IsNull()) {
+        int c = fgetc(filein.Get());
+        if (c == EOF)
+            return false;
+        ungetc(c, filein.Get());
+
+        try {
+            filein >> nType;
+            filein >> vchRecord;
+            filein >> nChecksum;
+        } catch (std::exception& e) {
+            LogPrint("masternode", "%s : Truncated record in %s, stopping - %s\n", __func__, pathDB.filename().string(), e.what());
+            return false;
+        }
+
+        if (nChecksum != RecordChecksum(nType, vchRecord)) {
+            nCorrupt++;
+            continue;
+        }
+
+        nRecords++;
+        ssRecord.clear();
+        ssRecord.write((const char*)vchRecord.data(), vchRecord.size());
+        return true;
+    }
+    return false;
+}
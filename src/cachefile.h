@@ -0,0 +1,119 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CACHEFILE_H
+#define BITCOIN_CACHEFILE_H
+
+#include "clientversion.h"
+#include "streams.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+/** Version of the record layout written by CCacheFileWriter */
+static const int CACHEFILE_VERSION = 2;
+
+/** Outcome of CCacheFileReader::ReadHeader */
+enum CacheFileStatus {
+    CACHEFILE_OK,
+    CACHEFILE_IO_ERROR,    //!< header could not be read
+    CACHEFILE_OUTDATED,    //!< not a record file (pre-record cache) or written by another version
+    CACHEFILE_BAD_MAGIC,   //!< record file of another cache
+    CACHEFILE_BAD_NETWORK, //!< record file of another network
+};
+
+/**
+ * Writes a masternode/budget cache as a header followed by independent
+ * records. Every record carries a type, its serialized payload and a
+ * checksum of both, so a damaged record only loses itself and a
+ * reader can stream the file without holding all of it in memory.
+ *
+ * The data goes to a temporary file that replaces the cache on Commit(),
+ * an interrupted dump leaves the previous cache in place.
+ */
+class CCacheFileWriter
+{
+private:
+    boost::filesystem::path pathDB;
+    boost::filesystem::path pathTmp;
+    CAutoFile fileout;
+    unsigned int nRecords;
+    bool fError;
+
+public:
+    CCacheFileWriter(const boost::filesystem::path& pathIn, const std::string& strMagicMessage);
+
+    bool IsNull() const { return fileout.IsNull() || fError; }
+    unsigned int GetRecordCount() const { return nRecords; }
+
+    template <typename T>
+    void Write(unsigned char nType, const T& obj)
+    {
+        CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+        ssRecord << obj;
+        WriteRecord(nType, ssRecord);
+    }
+
+    void WriteRecord(unsigned char nType, const CDataStream& ssRecord);
+
+    /** Flush the records to disk and move the file over the previous cache */
+    bool Commit();
+};
+
+/** Streams the records written by CCacheFileWriter, skipping the ones that fail their checksum */
+class CCacheFileReader
+{
+private:
+    boost::filesystem::path pathDB;
+    CAutoFile filein;
+    unsigned int nRecords;
+    unsigned int nCorrupt;
+
+public:
+    CCacheFileReader(const boost::filesystem::path& pathIn);
+
+    bool IsNull() const { return filein.IsNull(); }
+    unsigned int GetRecordCount() const { return nRecords; }
+    unsigned int GetCorruptCount() const { return nCorrupt; }
+
+    /** Check the file type, cache magic message and network; the records are not touched */
+    CacheFileStatus ReadHeader(const std::string& strMagicMessage);
+
+    /**
+     * Read the next intact record into ssRecord. Returns false at the end
+     * of the file, or at a truncated record which ends the usable data.
+     */
+    bool Next(unsigned char& nType, CDataStream& ssRecord);
+};
+
+/** Write every entry of a map as a record of its own */
+template <typename K, typename V>
+void WriteCacheMap(CCacheFileWriter& fileout, unsigned char nType, const std::map<K, V>& mapIn)
+{
+    for (typename std::map<K, V>::const_iterator it = mapIn.begin(); it != mapIn.end(); ++it)
+        fileout.Write(nType, *it);
+}
+
+/** Deserialize a record that holds exactly one object; left over bytes mean it is not what nType claims */
+template <typename T>
+void ReadCacheRecord(CDataStream& ssRecord, T& obj)
+{
+    ssRecord >> obj;
+    if (!ssRecord.empty())
+        throw std::ios_base::failure("ReadCacheRecord() : unread data at the end of the record");
+}
+
+/** Add the entry of a record written by WriteCacheMap to the map */
+template <typename K, typename V>
+void LoadCacheMapRecord(CDataStream& ssRecord, std::map<K, V>& mapOut)
+{
+    std::pair<K, V> entry;
+    ReadCacheRecord(ssRecord, entry);
+    mapOut.insert(entry);
+}
+
+#endif // BITCOIN_CACHEFILE_H
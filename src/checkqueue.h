@@ -5,10 +5,15 @@
 #ifndef BITCOIN_CHECKQUEUE_H
 #define BITCOIN_CHECKQUEUE_H
 
+#include "utiltime.h"
+
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -16,7 +21,19 @@
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/** Utilization counters of one CCheckQueue worker (slot 0 is the master) */
+struct CCheckQueueWorkerStats {
+    uint64_t nChecks;
+    uint64_t nBatches;
+    uint64_t nSteals;
+    int64_t nBusyMicros;
+    int64_t nStartMicros;
+    unsigned int nBatchTarget;
+
+    CCheckQueueWorkerStats() : nChecks(0), nBatches(0), nSteals(0), nBusyMicros(0), nStartMicros(0), nBatchTarget(0) {}
+};
+
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
@@ -25,13 +42,35 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker owns a deque of pending checks. Added work is spread over
+  * all deques; a worker pops batches from the back of its own deque and,
+  * once that runs dry, steals half of another worker's deque from the
+  * front. The shared mutex is only taken to go to sleep and to wake up, so
+  * workers do not contend on it while there is work to do.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
+    //! Work owned by a single worker, and that worker's statistics
+    struct WorkerSlot {
+        boost::mutex mutex;
+        std::deque<T> queue;
+        CCheckQueueWorkerStats stats;
+    };
+
+    //! Slot 0 belongs to whichever thread is the master, the rest to worker threads
+    boost::scoped_array<WorkerSlot> slots;
+
+    //! Number of slots (master included)
+    const unsigned int nSlots;
+
+    //! Number of slots in use (master included)
+    std::atomic<unsigned int> nActive;
+
+    //! Protects sleeping and waking up; never held while popping or running checks
+    boost::mutex mutexSleep;
 
     //! Worker threads block on this when out of work
     boost::condition_variable condWorker;
@@ -39,121 +78,207 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
+
+    /**
+     * Number of verifications that haven't completed yet.
+     * This includes elements that are not anymore in a queue, but still in
+     * a worker's own batch.
+     */
+    std::atomic<unsigned int> nTodo;
+
+    //! Number of verifications still sitting in the worker deques
+    std::atomic<unsigned int> nQueued;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! Slot the next Add() starts distributing at
+    std::atomic<unsigned int> nNextSlot;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The nominal number of elements to be processed in one batch
+    const unsigned int nBatchSize;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    /**
+     * Per-worker batch size target. Cheap checks (signature cache hits) grow
+     * the target to amortize the deque locking, expensive ones shrink it so
+     * the remaining work can still be spread across all workers.
+     */
+    static void AdaptBatchTarget(CCheckQueueWorkerStats& stats, unsigned int nNow, int64_t nMicros, unsigned int nBatchSize)
+    {
+        if (nMicros < 100 && nNow >= stats.nBatchTarget)
+            stats.nBatchTarget = std::min(stats.nBatchTarget * 2, nBatchSize * 4);
+        else if (nMicros > 5000)
+            stats.nBatchTarget = std::max(stats.nBatchTarget / 2, 1U);
+    }
 
     /**
-     * Number of verifications that haven't completed yet.
-     * This includes elements that are not anymore in queue, but still in
-     * worker's own batches.
+     * Share of the queued work one worker takes at a time. Aim for
+     * increasingly smaller batches so all workers finish approximately
+     * simultaneously, never below 1 or above the worker's target.
      */
-    unsigned int nTodo;
+    unsigned int GetBatchSize(unsigned int nTarget) const
+    {
+        return std::max(1U, std::min(nTarget, nQueued.load() / (2 * nActive.load())));
+    }
+
+    //! Move up to nMax checks out of slot nVictim into vChecks. The owner pops from the back, thieves from the front.
+    unsigned int Take(unsigned int nVictim, bool fOwner, unsigned int nMax, std::vector<T>& vChecks)
+    {
+        WorkerSlot& slot = slots[nVictim];
+        boost::unique_lock<boost::mutex> lock(slot.mutex, boost::try_to_lock);
+        if (!lock.owns_lock()) {
+            if (!fOwner)
+                return 0;
+            lock.lock();
+        }
+        unsigned int nNow = std::min(nMax, (unsigned int)slot.queue.size());
+        if (!fOwner)
+            nNow = std::min(nNow, std::max(1U, (unsigned int)slot.queue.size() / 2));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap jobs out of the deque instead of copying to keep the lock short.
+            if (fOwner) {
+                vChecks[i].swap(slot.queue.back());
+                slot.queue.pop_back();
+            } else {
+                vChecks[i].swap(slot.queue.front());
+                slot.queue.pop_front();
+            }
+        }
+        if (nNow)
+            nQueued -= nNow;
+        return nNow;
+    }
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Find a batch of work for slot nSelf, stealing from the other slots if its own deque is empty
+    unsigned int Fetch(unsigned int nSelf, std::vector<T>& vChecks)
+    {
+        // Only the owner writes nBatchTarget, so it can be read without the slot lock
+        unsigned int nMax = GetBatchSize(slots[nSelf].stats.nBatchTarget);
+        unsigned int nNow = Take(nSelf, true, nMax, vChecks);
+        if (nNow)
+            return nNow;
+        unsigned int nSlotsActive = std::min(nActive.load(), nSlots);
+        for (unsigned int i = 1; i < nSlotsActive && nQueued.load(); i++) {
+            nNow = Take((nSelf + i) % nSlotsActive, false, nMax, vChecks);
+            if (nNow) {
+                boost::unique_lock<boost::mutex> lock(slots[nSelf].mutex);
+                slots[nSelf].stats.nSteals++;
+                return nNow;
+            }
+        }
+        return 0;
+    }
 
-    //! The maximum number of elements to be processed in one batch
-    unsigned int nBatchSize;
+    //! Run a batch and account for it; wakes the master when the last check completes
+    void Execute(unsigned int nSelf, std::vector<T>& vChecks)
+    {
+        CCheckQueueWorkerStats& stats = slots[nSelf].stats;
+        int64_t nStart = GetTimeMicros();
+        bool fOk = fAllOk.load();
+        BOOST_FOREACH (T& check, vChecks)
+            if (fOk)
+                fOk = check();
+        if (!fOk)
+            fAllOk = false;
+        int64_t nMicros = GetTimeMicros() - nStart;
+        unsigned int nNow = vChecks.size();
+        vChecks.clear();
+
+        {
+            boost::unique_lock<boost::mutex> lock(slots[nSelf].mutex);
+            stats.nChecks += nNow;
+            stats.nBatches++;
+            stats.nBusyMicros += nMicros;
+            AdaptBatchTarget(stats, nNow, nMicros, nBatchSize);
+        }
+
+        if (nTodo.fetch_sub(nNow) == nNow) {
+            // We processed the last element; inform the master he can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutexSleep);
+            condMaster.notify_one();
+        }
+    }
 
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nSelf)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        bool fMaster = nSelf == 0;
         std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        vChecks.reserve(nBatchSize * 4);
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+            if (Fetch(nSelf, vChecks)) {
+                Execute(nSelf, vChecks);
+                continue;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            boost::unique_lock<boost::mutex> lock(mutexSleep);
+            if (fMaster && nTodo.load() == 0) {
+                bool fRet = fAllOk.load();
+                // reset the status for new work later
+                fAllOk = true;
+                // return the current status
+                return fRet;
+            }
+            if (nQueued.load() == 0)
+                (fMaster ? condMaster : condWorker).wait(lock); // wait
         } while (true);
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue serving at most nMaxWorkers worker threads besides the master
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxWorkers = 32) : slots(new WorkerSlot[nMaxWorkers + 1]), nSlots(nMaxWorkers + 1), nActive(1), fAllOk(true), nTodo(0), nQueued(0), nNextSlot(0), nBatchSize(nBatchSizeIn)
+    {
+        for (unsigned int i = 0; i < nSlots; i++) {
+            slots[i].stats.nBatchTarget = nBatchSize;
+            slots[i].stats.nStartMicros = GetTimeMicros();
+        }
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        unsigned int nSelf = nActive++;
+        if (nSelf >= nSlots) {
+            // No slot left: this thread could never be handed work of its own, don't let it steal either
+            nActive--;
+            return;
+        }
+        slots[nSelf].stats.nStartMicros = GetTimeMicros();
+        Loop(nSelf);
     }
 
     //! Wait until execution finishes, and return whether all evaluations where successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+        // Spread the checks in contiguous chunks over the active slots, so every deque is locked once
+        unsigned int nSlotsActive = std::min(nActive.load(), nSlots);
+        unsigned int nChunk = (vChecks.size() + nSlotsActive - 1) / nSlotsActive;
+        unsigned int nSlot = nNextSlot++ % nSlotsActive;
         nTodo += vChecks.size();
+        {
+            // Count the work before it becomes visible, so Take() never drives nQueued below zero
+            boost::unique_lock<boost::mutex> lock(mutexSleep);
+            nQueued += vChecks.size();
+        }
+        for (unsigned int nPos = 0; nPos < vChecks.size(); nPos += nChunk, nSlot = (nSlot + 1) % nSlotsActive) {
+            WorkerSlot& slot = slots[nSlot];
+            boost::unique_lock<boost::mutex> lock(slot.mutex);
+            unsigned int nEnd = std::min((unsigned int)vChecks.size(), nPos + nChunk);
+            for (unsigned int i = nPos; i < nEnd; i++) {
+                slot.queue.push_back(T());
+                vChecks[i].swap(slot.queue.back());
+            }
+        }
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -163,12 +288,22 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nTodo.load() == 0 && nQueued.load() == 0 && fAllOk.load() == true);
+    }
+
+    //! Snapshot of the per-worker counters (slot 0 is the master)
+    void GetStats(std::vector<CCheckQueueWorkerStats>& vStats)
+    {
+        unsigned int nSlotsActive = std::min(nActive.load(), nSlots);
+        vStats.assign(nSlotsActive, CCheckQueueWorkerStats());
+        for (unsigned int i = 0; i < nSlotsActive; i++) {
+            boost::unique_lock<boost::mutex> lock(slots[i].mutex);
+            vStats[i] = slots[i].stats;
+        }
     }
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
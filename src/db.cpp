@@ -217,6 +217,42 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
     dbenv.lsn_reset(strFile.c_str(), 0);
 }
 
+void CDBEnv::RecordWrite(int64_t nMicros)
+{
+    LOCK(cs_stats);
+    stats.nWrites++;
+    stats.nWriteMicros += nMicros;
+    stats.nMaxWriteMicros = std::max(stats.nMaxWriteMicros, nMicros);
+}
+
+void CDBEnv::RecordCommit(int64_t nMicros)
+{
+    LOCK(cs_stats);
+    stats.nCommits++;
+    stats.nCommitMicros += nMicros;
+}
+
+void CDBEnv::RecordCheckpoint(int64_t nMicros)
+{
+    LOCK(cs_stats);
+    stats.nCheckpoints++;
+    stats.nCheckpointMicros += nMicros;
+}
+
+void CDBEnv::RecordFlush(int64_t nMicros)
+{
+    LOCK(cs_stats);
+    stats.nFlushes++;
+    stats.nFlushMicros += nMicros;
+    stats.nLastFlush = GetTime();
+}
+
+CDBWriteStats CDBEnv::GetWriteStats() const
+{
+    LOCK(cs_stats);
+    return stats;
+}
+
 
 CDB::CDB(const std::string& strFilename, const char* pszMode) : pdb(NULL), activeTxn(NULL)
 {
@@ -286,7 +322,10 @@ void CDB::Flush()
     if (fReadOnly)
         nMinutes = 1;
 
+    int64_t nStart = GetTimeMicros();
     bitdb.dbenv.txn_checkpoint(nMinutes ? GetArg("-dblogsize", 100) * 1024 : 0, nMinutes, 0);
+    if (!fReadOnly)
+        bitdb.RecordCheckpoint(GetTimeMicros() - nStart);
 }
 
 void CDB::Close()
@@ -10,6 +10,7 @@
 #include "serialize.h"
 #include "streams.h"
 #include "sync.h"
+#include "utiltime.h"
 #include "version.h"
 
 #include <map>
@@ -29,6 +30,22 @@ extern unsigned int nWalletDBUpdated;
 
 void ThreadFlushWalletDB(const std::string& strWalletFile);
 
+/** Latency counters of the database writes, checkpoints and flushes */
+struct CDBWriteStats {
+    uint64_t nWrites;
+    int64_t nWriteMicros;
+    int64_t nMaxWriteMicros;
+    uint64_t nCommits;
+    int64_t nCommitMicros;
+    uint64_t nCheckpoints;
+    int64_t nCheckpointMicros;
+    uint64_t nFlushes;
+    int64_t nFlushMicros;
+    int64_t nLastFlush;
+
+    CDBWriteStats() : nWrites(0), nWriteMicros(0), nMaxWriteMicros(0), nCommits(0), nCommitMicros(0), nCheckpoints(0), nCheckpointMicros(0), nFlushes(0), nFlushMicros(0), nLastFlush(0) {}
+};
+
 
 class CDBEnv
 {
@@ -39,6 +56,9 @@ private:
     // shutdown problems/crashes caused by a static initialized internal pointer.
     std::string strPath;
 
+    mutable CCriticalSection cs_stats;
+    CDBWriteStats stats;
+
     void EnvShutdown();
 
 public:
@@ -88,6 +108,12 @@ public:
             return NULL;
         return ptxn;
     }
+
+    void RecordWrite(int64_t nMicros);
+    void RecordCommit(int64_t nMicros);
+    void RecordCheckpoint(int64_t nMicros);
+    void RecordFlush(int64_t nMicros);
+    CDBWriteStats GetWriteStats() const;
 };
 
 extern CDBEnv bitdb;
@@ -169,7 +195,9 @@ protected:
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
+        int64_t nStart = GetTimeMicros();
         int ret = pdb->put(activeTxn, &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
+        bitdb.RecordWrite(GetTimeMicros() - nStart);
 
         // Clear memory in case it was a private key
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -192,7 +220,9 @@ protected:
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
+        int64_t nStart = GetTimeMicros();
         int ret = pdb->del(activeTxn, &datKey, 0);
+        bitdb.RecordWrite(GetTimeMicros() - nStart);
 
         // Clear memory
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -283,7 +313,9 @@ public:
     {
         if (!pdb || !activeTxn)
             return false;
+        int64_t nStart = GetTimeMicros();
         int ret = activeTxn->commit(0);
+        bitdb.RecordCommit(GetTimeMicros() - nStart);
         activeTxn = NULL;
         return (ret == 0);
     }
@@ -283,9 +283,10 @@ bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTarget
 bool CheckStake(const CDataStream& ssUniqueID, CAmount nValueIn, const uint64_t nStakeModifier, const uint256& bnTarget,
                 unsigned int nTimeBlockFrom, unsigned int& nTimeTx, uint256& hashProofOfStake)
 {
-    CDataStream ss(SER_GETHASH, 0);
+    // Hash straight into the writer, the staker calls this for every drift second of every input
+    CHashWriter ss(SER_GETHASH, 0);
     ss << nStakeModifier << nTimeBlockFrom << ssUniqueID << nTimeTx;
-    hashProofOfStake = Hash(ss.begin(), ss.end());
+    hashProofOfStake = ss.GetHash();
     //LogPrintf("%s: modifier:%d nTimeBlockFrom:%d nTimeTx:%d hash:%s\n", __func__, nStakeModifier, nTimeBlockFrom, nTimeTx, hashProofOfStake.GetHex());
 
     return stakeTargetHit(hashProofOfStake, nValueIn, bnTarget);
@@ -309,12 +310,20 @@ bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockF
     if (!stakeInput->GetModifier(nStakeModifier))
         return error("failed to get kernel stake modifier");
 
-    bool fSuccess = false;
+    unsigned int nHashes = 0;
+    bool fSuccess = FindStakeKernel(stakeInput->GetUniqueness(), stakeInput->GetValue(), nStakeModifier, bnTargetPerCoinDay,
+                                    nTimeBlockFrom, chainActive.Height(), nTimeTx, hashProofOfStake, nHashes);
+
+    mapHashedBlocks.clear();
+    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    return fSuccess;
+}
+
+bool FindStakeKernel(const CDataStream& ssUniqueID, CAmount nValueIn, uint64_t nStakeModifier, const uint256& bnTargetPerCoinDay,
+                     unsigned int nTimeBlockFrom, int nHeightStart, unsigned int& nTimeTx, uint256& hashProofOfStake, unsigned int& nHashes)
+{
     unsigned int nTryTime = 0;
-    int nHeightStart = chainActive.Height();
     int nHashDrift = 45;
-    CDataStream ssUniqueID = stakeInput->GetUniqueness();
-    CAmount nValueIn = stakeInput->GetValue();
     for (int i = 0; i < nHashDrift; i++) //iterate the hashing
     {
         //new block came in, move on
@@ -323,20 +332,18 @@ bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockF
 
         //hash this iteration
         nTryTime = nTimeTx + nHashDrift - i;
+        nHashes++;
 
         // if stake hash does not meet the target then continue to next iteration
         if (!CheckStake(ssUniqueID, nValueIn, nStakeModifier, bnTargetPerCoinDay, nTimeBlockFrom, nTryTime, hashProofOfStake))
             continue;
 
-        fSuccess = true; // if we make it this far then we have successfully created a stake hash
         //LogPrintf("%s: hashproof=%s\n", __func__, hashProofOfStake.GetHex());
         nTimeTx = nTryTime;
-        break;
+        return true; // if we make it this far then we have successfully created a stake hash
     }
 
-    mapHashedBlocks.clear();
-    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
-    return fSuccess;
+    return false;
 }
 
 // Check kernel hash target and coinstake signature
@@ -27,6 +27,11 @@ bool CheckStake(const CDataStream& ssUniqueID, CAmount nValueIn, const uint64_t
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
 bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int& nTimeTx, uint256& hashProofOfStake);
 
+// Search the hash drift window below nTimeTx for a kernel, giving up once the chain moves past nHeightStart.
+// Only reads the chain height, so the staker can run it for several inputs at once.
+bool FindStakeKernel(const CDataStream& ssUniqueID, CAmount nValueIn, uint64_t nStakeModifier, const uint256& bnTargetPerCoinDay,
+                     unsigned int nTimeBlockFrom, int nHeightStart, unsigned int& nTimeTx, uint256& hashProofOfStake, unsigned int& nHashes);
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, std::unique_ptr<CStakeInput>& stake);
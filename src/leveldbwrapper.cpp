@@ -4,9 +4,16 @@
 
 #include "leveldbwrapper.h"
 
+#include "sync.h"
 #include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <map>
+#include <vector>
 
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -27,14 +34,59 @@ void HandleError(const leveldb::Status& status) throw(leveldb_error)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+CLevelDBOptions::CLevelDBOptions(size_t nCacheSize)
+{
+    nBlockCache = nCacheSize / 2;
+    nWriteBuffer = nCacheSize / 4;
+    nMaxOpenFiles = DB_MIN_OPEN_FILES;
+    nBloomBits = 10;
+    fCompression = false;
+}
+
+void ApplyDBOptionArgs(const std::string& strName, CLevelDBOptions& dboptions)
+{
+    const std::string strPrefix = strName + ":";
+    BOOST_FOREACH (const std::string& strArg, mapMultiArgs["-dbopt"]) {
+        if (strArg.compare(0, strPrefix.size(), strPrefix) != 0)
+            continue;
+        std::string strOption = strArg.substr(strPrefix.size());
+        size_t nEq = strOption.find('=');
+        if (nEq == std::string::npos) {
+            LogPrintf("Ignoring malformed -dbopt=%s\n", strArg);
+            continue;
+        }
+        std::string strKey = strOption.substr(0, nEq);
+        int64_t nValue = atoi64(strOption.substr(nEq + 1));
+        if (nValue < 0) {
+            LogPrintf("Ignoring negative -dbopt=%s\n", strArg);
+            continue;
+        }
+        if (strKey == "blockcache")
+            dboptions.nBlockCache = nValue << 20;
+        else if (strKey == "writebuffer")
+            dboptions.nWriteBuffer = nValue << 20;
+        else if (strKey == "maxopenfiles") {
+            dboptions.nMaxOpenFiles = std::min(std::max(nValue, (int64_t)DB_MIN_OPEN_FILES), (int64_t)DB_MAX_OPEN_FILES);
+            if (dboptions.nMaxOpenFiles != nValue)
+                LogPrintf("Limiting -dbopt=%s to %d open files, the range LevelDB supports\n", strArg, dboptions.nMaxOpenFiles);
+        }
+        else if (strKey == "bloombits")
+            dboptions.nBloomBits = (int)nValue;
+        else if (strKey == "compression")
+            dboptions.fCompression = nValue != 0;
+        else
+            LogPrintf("Ignoring unknown -dbopt=%s\n", strArg);
+    }
+}
+
+static leveldb::Options GetOptions(const CLevelDBOptions& dboptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = leveldb::NewLRUCache(dboptions.nBlockCache);
+    options.write_buffer_size = dboptions.nWriteBuffer;
+    options.filter_policy = dboptions.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(dboptions.nBloomBits) : NULL;
+    options.compression = dboptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dboptions.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -43,14 +95,24 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+/**
+ * Registry of open databases, for the stats and compaction RPCs. Each entry
+ * counts the ForEachLevelDB callers currently using it; a database being
+ * closed waits for that count to drop to zero.
+ */
+static CWaitableCriticalSection cs_leveldbs;
+static CConditionVariable cvLevelDBReleased;
+static std::map<CLevelDBWrapper*, int> mapLevelDBs;
+
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe) : strName(path.filename().string()), dboptions(nCacheSize)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    ApplyDBOptionArgs(strName, dboptions);
+    options = GetOptions(dboptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -66,10 +128,21 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    LogPrint("coindb", "LevelDB %s: blockcache=%u writebuffer=%u maxopenfiles=%d bloombits=%d compression=%d\n", strName,
+        dboptions.nBlockCache, dboptions.nWriteBuffer, dboptions.nMaxOpenFiles, dboptions.nBloomBits, dboptions.fCompression);
+
+    boost::unique_lock<boost::mutex> lock(cs_leveldbs);
+    mapLevelDBs[this] = 0;
 }
 
 CLevelDBWrapper::~CLevelDBWrapper()
 {
+    {
+        boost::unique_lock<boost::mutex> lock(cs_leveldbs);
+        while (mapLevelDBs[this] > 0)
+            cvLevelDBReleased.wait(lock);
+        mapLevelDBs.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -86,3 +159,58 @@ bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync) throw(leveldb
     HandleError(status);
     return true;
 }
+
+bool CLevelDBWrapper::GetProperty(const std::string& strProperty, std::string& strValue) const
+{
+    return pdb->GetProperty(strProperty, &strValue);
+}
+
+uint64_t CLevelDBWrapper::GetApproximateSize() const
+{
+    // All keys are serialized with a leading type character, so this range covers the whole database
+    leveldb::Range range(leveldb::Slice(""), leveldb::Slice("\xff\xff\xff\xff"));
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
+void CLevelDBWrapper::CompactFull()
+{
+    int64_t nStart = GetTimeMillis();
+    pdb->CompactRange(NULL, NULL);
+    LogPrintf("Compacted LevelDB %s in %dms\n", strName, GetTimeMillis() - nStart);
+}
+
+static void ReleaseLevelDBs(const std::vector<CLevelDBWrapper*>& vDBs)
+{
+    boost::unique_lock<boost::mutex> lock(cs_leveldbs);
+    BOOST_FOREACH (CLevelDBWrapper* pdbwrapper, vDBs)
+        mapLevelDBs[pdbwrapper]--;
+    cvLevelDBReleased.notify_all();
+}
+
+int ForEachLevelDB(const std::string& strName, boost::function<void(CLevelDBWrapper&)> fn)
+{
+    // Pin the matching databases and call fn without the registry lock, so a long
+    // compaction does not stall databases being opened or looked up meanwhile
+    std::vector<CLevelDBWrapper*> vDBs;
+    {
+        boost::unique_lock<boost::mutex> lock(cs_leveldbs);
+        for (std::map<CLevelDBWrapper*, int>::iterator it = mapLevelDBs.begin(); it != mapLevelDBs.end(); ++it) {
+            if (!strName.empty() && it->first->GetName() != strName)
+                continue;
+            it->second++;
+            vDBs.push_back(it->first);
+        }
+    }
+
+    try {
+        BOOST_FOREACH (CLevelDBWrapper* pdbwrapper, vDBs)
+            fn(*pdbwrapper);
+    } catch (...) {
+        ReleaseLevelDBs(vDBs);
+        throw;
+    }
+    ReleaseLevelDBs(vDBs);
+    return vDBs.size();
+}
@@ -12,6 +12,7 @@
 #include "version.h"
 
 #include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
 
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
@@ -24,6 +25,34 @@ public:
 
 void HandleError(const leveldb::Status& status) throw(leveldb_error);
 
+/** LevelDB clips max_open_files to this range (64 table files plus 10 for logs and manifests) */
+static const int DB_MIN_OPEN_FILES = 74;
+static const int DB_MAX_OPEN_FILES = 50000;
+
+/**
+ * Tunable options of a single LevelDB database. Defaults are derived from the
+ * cache size handed to the database and can be overridden per database with
+ * -dbopt=<name>:<option>=<value>, where <name> is the database directory name
+ * (chainstate, index, sporks, ...).
+ */
+struct CLevelDBOptions {
+    //! LRU block cache size in bytes
+    size_t nBlockCache;
+    //! memtable size in bytes (up to two may be held in memory simultaneously)
+    size_t nWriteBuffer;
+    //! open file limit, within [DB_MIN_OPEN_FILES, DB_MAX_OPEN_FILES]
+    int nMaxOpenFiles;
+    //! bits per key of the bloom filter, 0 disables it
+    int nBloomBits;
+    //! Snappy compression of table blocks (only effective if LevelDB was built with Snappy)
+    bool fCompression;
+
+    CLevelDBOptions(size_t nCacheSize);
+};
+
+/** Apply -dbopt=<name>:<option>=<value> overrides for the named database */
+void ApplyDBOptionArgs(const std::string& strName, CLevelDBOptions& dboptions);
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -64,6 +93,12 @@ public:
 class CLevelDBWrapper
 {
 private:
+    //! name of the database (its directory name), used for tuning options and stats
+    std::string strName;
+
+    //! tuning options this database was opened with
+    CLevelDBOptions dboptions;
+
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
 
@@ -168,6 +203,26 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    const std::string& GetName() const { return strName; }
+    const CLevelDBOptions& GetDBOptions() const { return dboptions; }
+
+    //! Query a LevelDB internal property such as "leveldb.stats" or "leveldb.num-files-at-level0"
+    bool GetProperty(const std::string& strProperty, std::string& strValue) const;
+
+    //! Approximate on-disk size of the whole key range in bytes
+    uint64_t GetApproximateSize() const;
+
+    //! Compact the whole key range, dropping deleted and overwritten entries
+    void CompactFull();
 };
 
+/**
+ * Call fn for every open database, or only for the one named strName if it is
+ * not empty. fn runs without the registry lock held; a database closed
+ * meanwhile waits in its destructor until fn is done with it, so fn must not
+ * close databases itself. Returns the number of databases visited.
+ */
+int ForEachLevelDB(const std::string& strName, boost::function<void(CLevelDBWrapper&)> fn);
+
 #endif // BITCOIN_LEVELDBWRAPPER_H
@@ -12,6 +12,7 @@
 #endif
 #include "addrman.h"
 #include "alert.h"
+#include "blockfilter.h"
 #include "blocksignature.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -24,6 +25,7 @@
 #include "merkleblock.h"
 #include "net.h"
 #include "obfuscation.h"
+#include "perfstats.h"
 #include "pow.h"
 #include "pos.h" // Old from Kore, will be deprecated
 #include "spork.h"
@@ -79,9 +81,12 @@ int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nPrefetchThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
@@ -98,6 +103,9 @@ CFeeRate minRelayTxFee = CFeeRate(10000);
 
 CTxMemPool mempool(::minRelayTxFee);
 
+/** Script verification worker pool, shared by ConnectBlock and AcceptToMemoryPool (both run under cs_main) */
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
 struct COrphanTx {
     CTransaction tx;
     NodeId fromPeer;
@@ -1180,9 +1188,42 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
+/**
+ * CheckInputs for a loose transaction, dispatching the script checks of
+ * multi-input transactions to the script verification threads instead of
+ * running them one by one while cs_main is held. On failure the inputs are
+ * re-checked serially so that state carries the same reject reason and DoS
+ * score as the single-threaded path.
+ */
+static bool CheckInputsParallel(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads || tx.vin.size() < MIN_PARALLEL_MEMPOOL_INPUTS)
+        return CheckInputs(tx, state, view, true, flags, true);
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, view, true, flags, true, &vChecks))
+        return false;
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    bool fOk = control.Wait();
+    LogPrint("mempool", "%s: verified %u inputs of %s in parallel: %.2fms\n", __func__, (unsigned)tx.vin.size(),
+        tx.GetHash().ToString(), 0.001 * (GetTimeMicros() - nTimeStart));
+    if (fOk)
+        return true;
+
+    // Signatures that did verify are in the signature cache by now, so this is cheap
+    if (CheckInputs(tx, state, view, true, flags, true))
+        return error("%s : parallel script check failed but serial check passed for %s", __func__, tx.GetHash().ToString());
+    return false;
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
 {
     AssertLockHeld(cs_main);
+    CPerfTimer perfTimer(PERF_MEMPOOL_ACCEPT);
     if (pfMissingInputs)
         *pfMissingInputs = false;
 
@@ -1386,7 +1427,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        if (!CheckInputsParallel(tx, state, view, STANDARD_SCRIPT_VERIFY_FLAGS)) {
             return error("AcceptToMemoryPool: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1632,38 +1673,37 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
     CBlockIndex* pindexSlow = NULL;
-    {
-        LOCK(cs_main);
-        {
-            if (mempool.lookup(hash, txOut)) {
-                return true;
-            }
-        }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut.GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
+    if (mempool.lookup(hash, txOut))
+        return true;
 
-            // transaction not found in the index, nothing more can be done
-            return false;
+    // The tx index and the block files are never rewritten under an entry, read them without cs_main
+    if (fTxIndex) {
+        CDiskTxPos postx;
+        if (pblocktree->ReadTxIndex(hash, postx)) {
+            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+            if (file.IsNull())
+                return error("%s: OpenBlockFile failed", __func__);
+            CBlockHeader header;
+            try {
+                file >> header;
+                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                file >> txOut;
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+            hashBlock = header.GetHash();
+            if (txOut.GetHash() != hash)
+                return error("%s : txid mismatch", __func__);
+            return true;
         }
 
+        // transaction not found in the index, nothing more can be done
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
             int nHeight = -1;
             {
@@ -2317,6 +2357,50 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
+/** Address index type of the address an output pays to, and its hash; ADDRESS_TYPE_NONE if it isn't indexed */
+static unsigned int GetAddressIndexKey(const CScript& script, uint160& hashBytes)
+{
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 2, script.begin() + 22));
+        return ADDRESS_TYPE_SCRIPTHASH;
+    }
+    if (script.IsNormalPaymentScript()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 3, script.begin() + 23));
+        return ADDRESS_TYPE_PUBKEYHASH;
+    }
+    // Pay-to-pubkey, used by most coinstakes, is indexed under the address of the key
+    if (((script.size() == 35 && script[0] == 33) || (script.size() == 67 && script[0] == 65)) && script.back() == OP_CHECKSIG) {
+        hashBytes = Hash160(script.begin() + 1, script.end() - 1);
+        return ADDRESS_TYPE_PUBKEYHASH;
+    }
+    return ADDRESS_TYPE_NONE;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+bool GetAddressIndex(const uint160& addressHash, unsigned int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int nStart, int nEnd)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, nStart, nEnd))
+        return error("%s : unable to get txids for address", __func__);
+    return true;
+}
+
+bool GetAddressUnspent(const uint160& addressHash, unsigned int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("%s : unable to get unspent outputs for address", __func__);
+    return true;
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
@@ -2338,12 +2422,31 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    // The indexes are left alone when only checking (pfClean is set by VerifyDB)
+    bool fUpdateAddressIndex = fAddressIndex && pfClean == NULL;
+    bool fUpdateSpentIndex = fSpentIndex && pfClean == NULL;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
 
         uint256 hash = tx.GetHash();
 
+        if (fUpdateAddressIndex) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut& out = tx.vout[k];
+                uint160 hashBytes;
+                unsigned int type = GetAddressIndexKey(out.scriptPubKey, hashBytes);
+                if (type == ADDRESS_TYPE_NONE)
+                    continue;
+                addressIndex.push_back(make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
+                addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, hashBytes, hash, k), CAddressUnspentValue()));
+            }
+        }
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly. Note that transactions with only provably unspendable outputs won't
         // have outputs available even in the block itself, so we handle that case
@@ -2396,10 +2499,30 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 if (coins->vout.size() < out.n + 1)
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
+
+                if (fUpdateAddressIndex || fUpdateSpentIndex) {
+                    uint160 hashBytes;
+                    unsigned int type = GetAddressIndexKey(undo.txout.scriptPubKey, hashBytes);
+                    if (fUpdateAddressIndex && type != ADDRESS_TYPE_NONE) {
+                        addressIndex.push_back(make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, hash, j, true), undo.txout.nValue * -1));
+                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, hashBytes, out.hash, out.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins->nHeight)));
+                    }
+                    if (fUpdateSpentIndex)
+                        spentIndex.push_back(make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
+                }
             }
         }
     }
 
+    if (fUpdateAddressIndex) {
+        if (!pblocktree->EraseAddressIndex(addressIndex))
+            return state.Abort("Failed to delete address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return state.Abort("Failed to write address unspent index");
+    }
+    if (fUpdateSpentIndex && !pblocktree->UpdateSpentIndex(spentIndex))
+        return state.Abort("Failed to write spent index");
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2436,14 +2559,108 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck()
 {
     RenameThread("kore-scriptch");
     scriptcheckqueue.Thread();
 }
 
+void GetScriptCheckQueueStats(std::vector<CCheckQueueWorkerStats>& vStats)
+{
+    scriptcheckqueue.GetStats(vStats);
+}
+
+/**
+ * Closure representing one coins database lookup made ahead of ConnectBlock.
+ * The result is discarded; the point is to pull the record into LevelDB's
+ * block cache (and the OS page cache) while cs_main is not held.
+ */
+class CCoinsPrefetch
+{
+private:
+    CCoinsView* pview;
+    uint256 txid;
+
+public:
+    CCoinsPrefetch() : pview(NULL), txid(0) {}
+    CCoinsPrefetch(CCoinsView* pviewIn, const uint256& txidIn) : pview(pviewIn), txid(txidIn) {}
+
+    bool operator()()
+    {
+        CCoins coins;
+        pview->GetCoins(txid, coins);
+        return true;
+    }
+
+    void swap(CCoinsPrefetch& check)
+    {
+        std::swap(pview, check.pview);
+        std::swap(txid, check.txid);
+    }
+};
+
+static CCheckQueue<CCoinsPrefetch> prefetchqueue(16);
+static CCriticalSection cs_prefetch;
+static CCoinsView* pcoinsPrefetchView = NULL;
+static int64_t nTimePrefetch = 0;
+
+void ThreadInputPrefetch()
+{
+    RenameThread("kore-prefetch");
+    prefetchqueue.Thread();
+}
+
+void SetInputPrefetchView(CCoinsView* pview)
+{
+    LOCK(cs_prefetch);
+    pcoinsPrefetchView = pview;
+}
+
+void PrefetchBlockInputs(const CBlock& block)
+{
+    if (!nPrefetchThreads)
+        return;
+
+    // Only one block is prefetched at a time; a concurrent caller simply connects without it.
+    TRY_LOCK(cs_prefetch, lockPrefetch);
+    if (!lockPrefetch || pcoinsPrefetchView == NULL)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::set<uint256> setInBlock;
+    std::set<uint256> setFetch;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        setInBlock.insert(tx.GetHash());
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+#ifdef ZEROCOIN
+            if (txin.scriptSig.IsZerocoinSpend())
+                continue;
+#endif
+            // Outputs created earlier in this block are not on disk yet
+            if (!setInBlock.count(txin.prevout.hash))
+                setFetch.insert(txin.prevout.hash);
+        }
+    }
+    if (setFetch.empty())
+        return;
+
+    std::vector<CCoinsPrefetch> vChecks;
+    vChecks.reserve(setFetch.size());
+    BOOST_FOREACH (const uint256& txid, setFetch)
+        vChecks.push_back(CCoinsPrefetch(pcoinsPrefetchView, txid));
+
+    CCheckQueueControl<CCoinsPrefetch> control(&prefetchqueue);
+    control.Add(vChecks);
+    control.Wait();
+
+    int64_t nTimeEnd = GetTimeMicros();
+    nTimePrefetch += nTimeEnd - nTimeStart;
+    LogPrint("prefetch", "Prefetch %u input txs for block %s: %.2fms [%.2fs]\n", (unsigned)setFetch.size(),
+        block.GetHash().ToString(), 0.001 * (nTimeEnd - nTimeStart), nTimePrefetch * 0.000001);
+}
+
 bool RecalculateKORESupply(int nHeightStart)
 {
     if (nHeightStart > chainActive.Height())
@@ -2509,6 +2726,9 @@ bool ReindexAccumulators(list<uint256>& listMissingCheckpoints, string& strError
 
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
+static int64_t nTimeFetchInputs = 0;
+static int64_t nTimeScripts = 0;
+static int64_t nTimeUndo = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
@@ -2516,6 +2736,7 @@ static int64_t nTimeTotal = 0;
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
 {
     AssertLockHeld(cs_main);
+    CPerfTimer perfTimer(PERF_CONNECT_BLOCK);
     // Check it again in case a previous version let a bad block in
     if (!fAlreadyChecked && !CheckBlock(block, state, !fJustCheck, !fJustCheck))
         return false;
@@ -2594,6 +2815,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
     vector<uint256> vSpendsInBlock;
     uint256 hashBlock = block.GetHash();
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    int64_t nTimeBlockFetch = 0;
+    int64_t nTimeBlockScript = 0;
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = block.vtx[i];
 
@@ -2621,10 +2847,30 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         } else 
 #endif        
         if (!tx.IsCoinBase()) {
-            if (!view.HaveInputs(tx))
+            // The first access pulls the inputs into the view; this is the part the prefetcher warms up
+            int64_t nTimeFetchStart = GetTimeMicros();
+            bool fHaveInputs = view.HaveInputs(tx);
+            nTimeBlockFetch += GetTimeMicros() - nTimeFetchStart;
+            if (!fHaveInputs)
                 return state.DoS(100, error("ConnectBlock() : inputs missing/spent"),
                     REJECT_INVALID, "bad-txns-inputs-missingorspent");
 
+            if (fAddressIndex || fSpentIndex) {
+                const uint256 txhash = tx.GetHash();
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const CTxIn& input = tx.vin[j];
+                    const CTxOut& prevout = view.GetOutputFor(input);
+                    uint160 hashBytes;
+                    unsigned int type = GetAddressIndexKey(prevout.scriptPubKey, hashBytes);
+                    if (fAddressIndex && type != ADDRESS_TYPE_NONE) {
+                        addressIndex.push_back(make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
+                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, type, hashBytes)));
+                }
+            }
+
             // Check that the inputs are not marked as invalid/fraudulent
             for (CTxIn in : tx.vin) {
                 if (!ValidOutPoint(in.prevout, pindex->nHeight)) {
@@ -2646,8 +2892,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             std::vector<CScriptCheck> vChecks;
             unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+            int64_t nTimeScriptStart = GetTimeMicros();
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
+            nTimeBlockScript += GetTimeMicros() - nTimeScriptStart;
             control.Add(vChecks);
         }
         nValueOut += tx.GetValueOut();
@@ -2658,6 +2906,19 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
+        if (fAddressIndex) {
+            const uint256 txhash = tx.GetHash();
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                uint160 hashBytes;
+                unsigned int type = GetAddressIndexKey(out.scriptPubKey, hashBytes);
+                if (type == ADDRESS_TYPE_NONE)
+                    continue;
+                addressIndex.push_back(make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
+                addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+            }
+        }
+
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
@@ -2687,11 +2948,19 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                          REJECT_INVALID, "bad-cb-amount");
     }
 
+    int64_t nTimeWaitStart = GetTimeMicros();
     if (!control.Wait())
         return state.DoS(100, false);
     int64_t nTime2 = GetTimeMicros();
+    nTimeBlockScript += nTime2 - nTimeWaitStart;
     nTimeVerify += nTime2 - nTimeStart;
+    nTimeFetchInputs += nTimeBlockFetch;
+    nTimeScripts += nTimeBlockScript;
+    RecordPerfSample(PERF_INPUT_FETCH, nTimeBlockFetch);
+    RecordPerfSample(PERF_SCRIPT_CHECK, nTimeBlockScript);
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
+    LogPrint("bench", "      - Fetch inputs: %.2fms [%.2fs]\n", 0.001 * nTimeBlockFetch, nTimeFetchInputs * 0.000001);
+    LogPrint("bench", "      - Script checks: %.2fms [%.2fs]\n", 0.001 * nTimeBlockScript, nTimeScripts * 0.000001);
 
     //IMPORTANT NOTE: Nothing before this point should actually store to disk (or even memory)
     if (fJustCheck)
@@ -2714,6 +2983,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
     }
+    int64_t nTimeUndoEnd = GetTimeMicros();
+    nTimeUndo += nTimeUndoEnd - nTime2;
+    RecordPerfSample(PERF_UNDO_WRITE, nTimeUndoEnd - nTime2);
+    LogPrint("bench", "    - Undo write: %.2fms [%.2fs]\n", 0.001 * (nTimeUndoEnd - nTime2), nTimeUndo * 0.000001);
 #ifdef ZEROCOIN
     //Record zKORE serials
     set<uint256> setAddedTx;
@@ -2757,6 +3030,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (fAddressIndex) {
+        if (!pblocktree->WriteAddressIndex(addressIndex))
+            return state.Abort("Failed to write address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return state.Abort("Failed to write address unspent index");
+    }
+
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(spentIndex))
+            return state.Abort("Failed to write spent index");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2795,6 +3079,7 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
         if ((mode == FLUSH_STATE_ALWAYS) ||
             ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
+            CPerfTimer perfTimer(PERF_COINS_FLUSH);
             // Typical CCoins structures on disk are around 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
@@ -2915,6 +3200,7 @@ bool static DisconnectTip(CValidationState& state)
     mempool.check(pcoinsTip);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
+    BlockFilterIndexDisconnectTip(pindexDelete);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     BOOST_FOREACH (const CTransaction& tx, block.vtx) {
@@ -2990,14 +3276,18 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     mempool.check(pcoinsTip);
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    BlockFilterIndexConnectTip(*pblock, pindexNew);
     // Tell wallet about transactions that went from mempool
     // to conflicted:
-    BOOST_FOREACH (const CTransaction& tx, txConflicted) {
-        SyncWithWallets(tx, NULL);
-    }
-    // ... and about transactions that got confirmed:
-    BOOST_FOREACH (const CTransaction& tx, pblock->vtx) {
-        SyncWithWallets(tx, pblock);
+    {
+        CPerfTimer perfTimer(PERF_WALLET_NOTIFY);
+        BOOST_FOREACH (const CTransaction& tx, txConflicted) {
+            SyncWithWallets(tx, NULL);
+        }
+        // ... and about transactions that got confirmed:
+        BOOST_FOREACH (const CTransaction& tx, pblock->vtx) {
+            SyncWithWallets(tx, pblock);
+        }
     }
 
     int64_t nTime6 = GetTimeMicros();
@@ -3843,6 +4133,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
+    CPerfTimer perfTimer(PERF_HEADER_CHECK);
     // Check for duplicate
     uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
@@ -3941,7 +4232,10 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         unique_ptr<CStakeInput> stake;
 
 //#ifdef LICO_FORK
-        if (!CheckProofOfStake(block, hashProofOfStake, stake))
+        int64_t nTimeKernel = GetTimeMicros();
+        bool fKernelOk = CheckProofOfStake(block, hashProofOfStake, stake);
+        RecordPerfSample(PERF_POS_KERNEL, GetTimeMicros() - nTimeKernel);
+        if (!fKernelOk)
             return state.DoS(100, error("%s: proof of stake check failed", __func__));
 //#endif
 //        if (!CheckProofOfStake_Legacy( mapBlockIndex[block.hashPrevBlock], block.vtx[1], block.nBits, hashProofOfStake, stake))
@@ -4060,6 +4354,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
 {
     // Preliminary checks
     int64_t nStartTime = GetTimeMillis();
+    CPerfTimer perfTimer(PERF_PROCESS_BLOCK);
     bool checked = CheckBlock(*pblock, state);
 
 #ifdef ZEROCOIN
@@ -4092,6 +4387,10 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         }
     }
 
+    // Warm the coins database with this block's inputs before taking cs_main for AcceptBlock/ConnectTip
+    if (checked)
+        PrefetchBlockInputs(*pblock);
+
     {
         LOCK(cs_main);   // Replaces the former TRY_LOCK loop because busy waiting wastes too much resources
 
@@ -4336,6 +4635,12 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address and spent indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -4470,6 +4775,10 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -5994,6 +6303,85 @@ int ActiveProtocol()
 }
 
 // requires LOCK(cs_vRecvMsg)
+static bool HasMessageSignature(const std::string& strCommand)
+{
+    return strCommand == "mnb" || strCommand == "mnp" || strCommand == "mnw" ||
+           strCommand == "mvote" || strCommand == "fbvote" || strCommand == "txlvote";
+}
+
+// requires LOCK(cs_vRecvMsg)
+static bool HasValidChecksum(const CNetMessage& msg)
+{
+    uint256 hash = Hash(msg.vRecv.begin(), msg.vRecv.begin() + msg.hdr.nMessageSize);
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    return nChecksum == msg.hdr.nChecksum;
+}
+
+/**
+ * Recover the signers of the masternode broadcasts, pings and votes waiting in the
+ * receive queue on the message signature check threads, so their handlers find them
+ * cached instead of recovering one key after the other. Every message is looked at
+ * once: pfrom->nRecvMsgPrecached skips the ones seen by an earlier call.
+ */
+static void PrecacheMessageSignatures(CNode* pfrom)
+{
+    std::deque<CNetMessage>::iterator itBegin = pfrom->vRecvMsg.begin() + std::min(pfrom->nRecvMsgPrecached, pfrom->vRecvMsg.size());
+    std::deque<CNetMessage>::iterator itEnd = itBegin;
+    int nSigned = 0;
+    while (itEnd != pfrom->vRecvMsg.end() && itEnd->complete()) {
+        if (HasMessageSignature(itEnd->hdr.GetCommand()))
+            nSigned++;
+        ++itEnd;
+    }
+    pfrom->nRecvMsgPrecached = itEnd - pfrom->vRecvMsg.begin();
+    if (nSigned < 2)
+        return;
+
+    std::vector<CMessageSignatureCheck> vChecks;
+    vChecks.reserve(nSigned * 2);
+    for (std::deque<CNetMessage>::iterator it = itBegin; it != itEnd; ++it) {
+        std::string strCommand = it->hdr.GetCommand();
+        if (!HasMessageSignature(strCommand) || !it->hdr.IsValid() || !HasValidChecksum(*it))
+            continue;
+
+        // read from a copy, the handler still has to process the message
+        CDataStream vRecv(it->vRecv.begin(), it->vRecv.end(), it->vRecv.GetType(), it->vRecv.GetVersion());
+        try {
+            if (strCommand == "mnb") {
+                CMasternodeBroadcast mnb;
+                vRecv >> mnb;
+                vChecks.push_back(CMessageSignatureCheck(mnb.sig, mnb.GetNewStrMessage()));
+                vChecks.push_back(CMessageSignatureCheck(mnb.lastPing.vchSig, mnb.lastPing.GetStrMessage()));
+            } else if (strCommand == "mnp") {
+                CMasternodePing mnp;
+                vRecv >> mnp;
+                vChecks.push_back(CMessageSignatureCheck(mnp.vchSig, mnp.GetStrMessage()));
+            } else if (strCommand == "mnw") {
+                CMasternodePaymentWinner winner;
+                vRecv >> winner;
+                vChecks.push_back(CMessageSignatureCheck(winner.vchSig, winner.GetStrMessage()));
+            } else if (strCommand == "mvote") {
+                CBudgetVote vote;
+                vRecv >> vote;
+                vChecks.push_back(CMessageSignatureCheck(vote.vchSig, vote.GetStrMessage()));
+            } else if (strCommand == "fbvote") {
+                CFinalizedBudgetVote vote;
+                vRecv >> vote;
+                vChecks.push_back(CMessageSignatureCheck(vote.vchSig, vote.GetStrMessage()));
+            } else if (strCommand == "txlvote") {
+                CConsensusVote vote;
+                vRecv >> vote;
+                vChecks.push_back(CMessageSignatureCheck(vote.vchMasterNodeSignature, vote.GetStrMessage()));
+            }
+        } catch (const std::exception&) {
+            // malformed, its handler will deal with it
+        }
+    }
+
+    obfuScationSigner.PrecacheSignatures(vChecks);
+}
+
 bool ProcessMessages(CNode* pfrom)
 {
     //if (fDebug)
@@ -6015,6 +6403,8 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    PrecacheMessageSignatures(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -6096,8 +6486,11 @@ bool ProcessMessages(CNode* pfrom)
     }
 
     // In case the connection got shut down, its receive buffer was wiped
-    if (!pfrom->fDisconnect)
+    if (!pfrom->fDisconnect) {
+        size_t nProcessed = it - pfrom->vRecvMsg.begin();
+        pfrom->nRecvMsgPrecached -= std::min(nProcessed, pfrom->nRecvMsgPrecached);
         pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
+    }
 
     return fOk;
 }
@@ -12,6 +12,7 @@
 #include "config/bitcoin-config.h"
 #endif
 
+#include "addressindex.h"
 #include "amount.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -26,6 +27,7 @@
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "spentindex.h"
 #include "sync.h"
 #include "tinyformat.h"
 #include "txmempool.h"
@@ -57,6 +59,7 @@ class CValidationInterface;
 class CValidationState;
 
 struct CBlockTemplate;
+struct CCheckQueueWorkerStats;
 struct CNodeStateStats;
 
 /** Default for -blockmaxsize and -blockminsize, which control the range of sizes the mining code will create **/
@@ -91,6 +94,16 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Loose transactions with at least this many inputs have their scripts verified on the script-checking threads */
+static const unsigned int MIN_PARALLEL_MEMPOOL_INPUTS = 4;
+/** Maximum number of input prefetch threads allowed */
+static const int MAX_PREFETCH_THREADS = 16;
+/** -prefetchthreads default (number of threads warming block inputs before ConnectBlock, 0 = disabled) */
+static const int DEFAULT_PREFETCH_THREADS = 2;
+/** -addressindex default */
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** -spentindex default */
+static const bool DEFAULT_SPENTINDEX = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -139,7 +152,10 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nPrefetchThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern unsigned int nCoinCacheSize;
@@ -226,6 +242,18 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Per-worker utilization of the script verification threads (slot 0 is the validating thread itself) */
+void GetScriptCheckQueueStats(std::vector<CCheckQueueWorkerStats>& vStats);
+/** Run an instance of the block input prefetch thread */
+void ThreadInputPrefetch();
+/** Set the coins view the prefetch threads read from (must be safe for concurrent reads), or NULL to disable */
+void SetInputPrefetchView(CCoinsView* pview);
+/**
+ * Warm the coins database caches with every input referenced by block, using
+ * the prefetch threads. Must be called without cs_main held; does nothing if
+ * another prefetch is already running.
+ */
+void PrefetchBlockInputs(const CBlock& block);
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -233,6 +261,10 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false);
+/** Look up the address and spent indexes (-addressindex, -spentindex) */
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+bool GetAddressIndex(const uint160& addressHash, unsigned int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int nStart = 0, int nEnd = 0);
+bool GetAddressUnspent(const uint160& addressHash, unsigned int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
 /** Find the best known block, and make it the tip of the block chain */
 
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -7,12 +7,14 @@
 #include "main.h"
 
 #include "addrman.h"
+#include "cachefile.h"
 #include "masternode-budget.h"
 #include "masternode-sync.h"
 #include "masternode.h"
 #include "masternodeman.h"
 #include "obfuscation.h"
 #include "util.h"
+#include <limits>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -273,118 +275,63 @@ CBudgetDB::CBudgetDB()
 
 bool CBudgetDB::Write(const CBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
-
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
+    // one record per proposal, budget and vote, written next to the old cache and moved over it
+    CCacheFileWriter fileout(pathDB, strMagicMessage);
+    objToSave.WriteCacheRecords(fileout);
+    if (!fileout.Commit())
+        return error("%s : Failed to write file %s", __func__, pathDB.string());
 
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint("mnbudget","Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("mnbudget","Written %u records to budget.dat  %dms\n", fileout.GetRecordCount(), GetTimeMillis() - nStart);
 
     return true;
 }
 
 CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
 {
-    LOCK(objToLoad.cs);
-
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    CCacheFileReader filein(pathDB);
     if (filein.IsNull()) {
         error("%s : Failed to open file %s", __func__, pathDB.string());
         return FileError;
     }
 
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
+    switch (filein.ReadHeader(strMagicMessage)) {
+    case CACHEFILE_OK:
+        break;
+    case CACHEFILE_BAD_MAGIC:
+        error("%s : Invalid masternode cache magic message", __func__);
+        return IncorrectMagicMessage;
+    case CACHEFILE_BAD_NETWORK:
+        error("%s : Invalid network magic number", __func__);
+        return IncorrectMagicNumber;
+    default:
+        error("%s : Outdated or unreadable budget cache", __func__);
+        return IncorrectFormat;
     }
 
+    // the header is all a dry run needs, the records are only checked while loading them
+    if (fDryRun)
+        return Ok;
 
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
+    // proposals and votes were verified before they were cached, their signatures are not checked again
+    unsigned char nType;
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    while (filein.Next(nType, ssRecord)) {
+        try {
+            objToLoad.LoadCacheRecord(nType, ssRecord);
+        } catch (std::exception& e) {
+            LogPrint("mnbudget","%s : Skipping unreadable record - %s\n", __func__, e.what());
         }
-
-        // de-serialize data into CBudgetManager object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
-        objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
     }
 
-    LogPrint("mnbudget","Loaded info from budget.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("mnbudget","Loaded %u records from budget.dat (%u corrupt)  %dms\n", filein.GetRecordCount(), filein.GetCorruptCount(), GetTimeMillis() - nStart);
+    LogPrint("mnbudget","  %s\n", objToLoad.ToString());
+    LogPrint("mnbudget","Budget manager - cleaning....\n");
+    objToLoad.CheckAndRemove();
+    LogPrint("mnbudget","Budget manager - result:\n");
     LogPrint("mnbudget","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("mnbudget","Budget manager - cleaning....\n");
-        objToLoad.CheckAndRemove();
-        LogPrint("mnbudget","Budget manager - result:\n");
-        LogPrint("mnbudget","  %s\n", objToLoad.ToString());
-    }
 
     return Ok;
 }
@@ -448,6 +395,7 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
     }
 
     mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
+    InvalidateBudgetCache();
     LogPrint("mnbudget","CBudgetManager::AddProposal - proposal %s added\n", budgetProposal.GetName ().c_str ());
     return true;
 }
@@ -516,6 +464,8 @@ void CBudgetManager::CheckAndRemove()
         ++it2;
     }
     // Remove invalid entries by overwriting complete map
+    if (tmpMapProposals.size() != mapProposals.size())
+        InvalidateBudgetCache();
     mapFinalizedBudgets.swap(tmpMapFinalizedBudgets);
     mapProposals.swap(tmpMapProposals);
 
@@ -662,7 +612,8 @@ TrxValidationStatus CBudgetManager::IsTransactionValid(const CTransaction& txNew
 
     TrxValidationStatus transactionStatus = TrxValidationStatus::InValid;
     int nHighestCount = 0;
-    int nFivePercent = mnodeman.CountEnabled(ActiveProtocol()) / 20;
+    int nEnabled = mnodeman.CountEnabled(ActiveProtocol());
+    int nFivePercent = nEnabled / 20;
     std::vector<CFinalizedBudget*> ret;
 
     LogPrint("mnbudget","CBudgetManager::IsTransactionValid - checking %lli finalized budgets\n", mapFinalizedBudgets.size());
@@ -691,7 +642,7 @@ TrxValidationStatus CBudgetManager::IsTransactionValid(const CTransaction& txNew
     // check the highest finalized budgets (+/- 10% to assist in consensus)
 
     std::string strProposals = "";
-    int nCountThreshold = nHighestCount - mnodeman.CountEnabled(ActiveProtocol()) / 10;
+    int nCountThreshold = nHighestCount - nEnabled / 10;
     bool fThreshold = false;
     it = mapFinalizedBudgets.begin();
     while (it != mapFinalizedBudgets.end()) {
@@ -742,7 +693,8 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
+        if ((*it).second.CleanAndRemove(false))
+            InvalidateBudgetCache();
 
         CBudgetProposal* pbudgetProposal = &((*it).second);
         vBudgetProposalRet.push_back(pbudgetProposal);
@@ -765,11 +717,42 @@ struct sortProposalsByVotes {
     }
 };
 
+bool CBudgetManager::GetCachedBudget(int nBlockStart, int nThreshold, unsigned int nMnVersion, std::vector<CBudgetProposal*>& vBudgetProposalsRet)
+{
+    if (fCachedBudgetDirty || nBlockStart != nCachedBudgetStart || nThreshold != nCachedBudgetThreshold ||
+        nMnVersion != nCachedBudgetMnVersion || GetTime() >= nCachedBudgetExpires)
+        return false;
+
+    vBudgetProposalsRet.clear();
+    BOOST_FOREACH (const uint256& nHash, vCachedBudget) {
+        std::map<uint256, CBudgetProposal>::iterator it = mapProposals.find(nHash);
+        if (it == mapProposals.end())
+            return false;
+        vBudgetProposalsRet.push_back(&((*it).second));
+    }
+
+    return true;
+}
+
 //Need to review this function
 std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 {
     LOCK(cs);
 
+    std::vector<CBudgetProposal*> vBudgetProposalsRet;
+
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (pindexPrev == NULL) return vBudgetProposalsRet;
+
+    int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
+    int nBlockEnd = nBlockStart + GetBudgetPaymentCycleBlocks() - 1;
+    int nThreshold = mnodeman.CountEnabled(ActiveProtocol()) / 10;
+    // votes of masternodes that left the list (or joined it) only get re-checked by CleanAndRemove below
+    unsigned int nMnVersion = mnodeman.GetRankingVersion();
+
+    if (GetCachedBudget(nBlockStart, nThreshold, nMnVersion, vBudgetProposalsRet))
+        return vBudgetProposalsRet;
+
     // ------- Sort budgets by Yes Count
 
     std::vector<std::pair<CBudgetProposal*, int> > vBudgetPorposalsSort;
@@ -785,31 +768,28 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 
     // ------- Grab The Budgets In Order
 
-    std::vector<CBudgetProposal*> vBudgetProposalsRet;
-
     CAmount nBudgetAllocated = 0;
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    if (pindexPrev == NULL) return vBudgetProposalsRet;
-
-    int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
-    int nBlockEnd = nBlockStart + GetBudgetPaymentCycleBlocks() - 1;
     CAmount nTotalBudget = GetTotalBudget(nBlockStart);
-
+    int64_t nExpires = std::numeric_limits<int64_t>::max();
 
     std::vector<std::pair<CBudgetProposal*, int> >::iterator it2 = vBudgetPorposalsSort.begin();
     while (it2 != vBudgetPorposalsSort.end()) {
         CBudgetProposal* pbudgetProposal = (*it2).first;
 
+        // the result changes once this proposal is old enough to be considered
+        if (!pbudgetProposal->IsEstablished())
+            nExpires = std::min(nExpires, pbudgetProposal->GetEstablishedTime());
+
         LogPrint("mnbudget","CBudgetManager::GetBudget() - Processing Budget %s\n", pbudgetProposal->strProposalName.c_str());
         //prop start/end should be inside this period
         if (pbudgetProposal->fValid && pbudgetProposal->nBlockStart <= nBlockStart &&
             pbudgetProposal->nBlockEnd >= nBlockEnd &&
-            pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > mnodeman.CountEnabled(ActiveProtocol()) / 10 &&
+            pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > nThreshold &&
             pbudgetProposal->IsEstablished()) {
 
             LogPrint("mnbudget","CBudgetManager::GetBudget() -   Check 1 passed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                       pbudgetProposal->fValid, pbudgetProposal->nBlockStart, nBlockStart, pbudgetProposal->nBlockEnd,
-                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnodeman.CountEnabled(ActiveProtocol()) / 10,
+                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), nThreshold,
                       pbudgetProposal->IsEstablished());
 
             if (pbudgetProposal->GetAmount() + nBudgetAllocated <= nTotalBudget) {
@@ -825,13 +805,22 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         else {
             LogPrint("mnbudget","CBudgetManager::GetBudget() -   Check 1 failed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                       pbudgetProposal->fValid, pbudgetProposal->nBlockStart, nBlockStart, pbudgetProposal->nBlockEnd,
-                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnodeman.CountEnabled(ActiveProtocol()) / 10,
+                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), nThreshold,
                       pbudgetProposal->IsEstablished());
         }
 
         ++it2;
     }
 
+    vCachedBudget.clear();
+    BOOST_FOREACH (CBudgetProposal* pbudgetProposal, vBudgetProposalsRet)
+        vCachedBudget.push_back(pbudgetProposal->GetHash());
+    nCachedBudgetStart = nBlockStart;
+    nCachedBudgetThreshold = nThreshold;
+    nCachedBudgetMnVersion = nMnVersion;
+    nCachedBudgetExpires = nExpires;
+    fCachedBudgetDirty = false;
+
     return vBudgetProposalsRet;
 }
 
@@ -958,7 +947,8 @@ void CBudgetManager::NewBlock()
     LogPrint("mnbudget","CBudgetManager::NewBlock - mapProposals cleanup - size: %d\n", mapProposals.size());
     std::map<uint256, CBudgetProposal>::iterator it2 = mapProposals.begin();
     while (it2 != mapProposals.end()) {
-        (*it2).second.CleanAndRemove(false);
+        if ((*it2).second.CleanAndRemove(false))
+            InvalidateBudgetCache();
         ++it2;
     }
 
@@ -1283,10 +1273,15 @@ void CBudgetManager::MarkSynced()
 }
 
 
-void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
+void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial, const CSyncDigest* pdigest)
 {
     LOCK(cs);
 
+    // with a digest from the peer, only the items in buckets that differ are announced
+    CSyncDigest digestOurs;
+    if (pdigest)
+        GetSyncDigest(digestOurs);
+
     /*
         Sync with a client on the network
 
@@ -1303,16 +1298,22 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
     while (it1 != mapSeenMasternodeBudgetProposals.end()) {
         CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
         if (pbudgetProposal && pbudgetProposal->fValid && (nProp == 0 || (*it1).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, (*it1).second.GetHash()));
-            nInvCount++;
+            uint256 hash = (*it1).second.GetHash();
+            if (!pdigest || !digestOurs.Matches(*pdigest, hash)) {
+                pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, hash));
+                nInvCount++;
+            }
 
             //send votes
             std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
             while (it2 != pbudgetProposal->mapVotes.end()) {
                 if ((*it2).second.fValid) {
                     if ((fPartial && !(*it2).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, (*it2).second.GetHash()));
-                        nInvCount++;
+                        hash = (*it2).second.GetHash();
+                        if (!pdigest || !digestOurs.Matches(*pdigest, hash)) {
+                            pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, hash));
+                            nInvCount++;
+                        }
                     }
                 }
                 ++it2;
@@ -1331,16 +1332,22 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
     while (it3 != mapSeenFinalizedBudgets.end()) {
         CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
         if (pfinalizedBudget && pfinalizedBudget->fValid && (nProp == 0 || (*it3).first == nProp)) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, (*it3).second.GetHash()));
-            nInvCount++;
+            uint256 hash = (*it3).second.GetHash();
+            if (!pdigest || !digestOurs.Matches(*pdigest, hash)) {
+                pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, hash));
+                nInvCount++;
+            }
 
             //send votes
             std::map<uint256, CFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
             while (it4 != pfinalizedBudget->mapVotes.end()) {
                 if ((*it4).second.fValid) {
                     if ((fPartial && !(*it4).second.fSynced) || !fPartial) {
-                        pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, (*it4).second.GetHash()));
-                        nInvCount++;
+                        hash = (*it4).second.GetHash();
+                        if (!pdigest || !digestOurs.Matches(*pdigest, hash)) {
+                            pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, hash));
+                            nInvCount++;
+                        }
                     }
                 }
                 ++it4;
@@ -1353,6 +1360,52 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
     LogPrint("mnbudget", "CBudgetManager::Sync - sent %d items\n", nInvCount);
 }
 
+int CBudgetManager::GetSyncDigest(CSyncDigest& digest)
+{
+    LOCK(cs);
+
+    // the items a full Sync() announces
+    int nItems = 0;
+    std::map<uint256, CBudgetProposalBroadcast>::iterator it1 = mapSeenMasternodeBudgetProposals.begin();
+    while (it1 != mapSeenMasternodeBudgetProposals.end()) {
+        CBudgetProposal* pbudgetProposal = FindProposal((*it1).first);
+        if (pbudgetProposal && pbudgetProposal->fValid) {
+            digest.Add((*it1).second.GetHash());
+            nItems++;
+
+            std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
+            while (it2 != pbudgetProposal->mapVotes.end()) {
+                if ((*it2).second.fValid) {
+                    digest.Add((*it2).second.GetHash());
+                    nItems++;
+                }
+                ++it2;
+            }
+        }
+        ++it1;
+    }
+
+    std::map<uint256, CFinalizedBudgetBroadcast>::iterator it3 = mapSeenFinalizedBudgets.begin();
+    while (it3 != mapSeenFinalizedBudgets.end()) {
+        CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it3).first);
+        if (pfinalizedBudget && pfinalizedBudget->fValid) {
+            digest.Add((*it3).second.GetHash());
+            nItems++;
+
+            std::map<uint256, CFinalizedBudgetVote>::iterator it4 = pfinalizedBudget->mapVotes.begin();
+            while (it4 != pfinalizedBudget->mapVotes.end()) {
+                if ((*it4).second.fValid) {
+                    digest.Add((*it4).second.GetHash());
+                    nItems++;
+                }
+                ++it4;
+            }
+        }
+        ++it3;
+    }
+    return nItems;
+}
+
 bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string& strError)
 {
     LOCK(cs);
@@ -1377,7 +1430,11 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
     }
 
 
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    if (!mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError))
+        return false;
+
+    InvalidateBudgetCache();
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1413,6 +1470,10 @@ CBudgetProposal::CBudgetProposal()
     nBlockEnd = 0;
     nAmount = 0;
     nTime = 0;
+    nAlloted = 0;
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
     fValid = true;
 }
 
@@ -1425,6 +1486,10 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     address = addressIn;
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
+    nAlloted = 0;
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
     fValid = true;
 }
 
@@ -1439,6 +1504,10 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nTime = other.nTime;
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
+    nAlloted = other.nAlloted;
+    nYeas = other.nYeas;
+    nNays = other.nNays;
+    nAbstains = other.nAbstains;
     fValid = true;
 }
 
@@ -1546,78 +1615,74 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
         return false;
     }
 
+    if (mapVotes.count(hash))
+        CountVote(mapVotes[hash], -1);
     mapVotes[hash] = vote;
+    CountVote(vote, 1);
     LogPrint("mnbudget", "CBudgetProposal::AddOrUpdateVote - %s %s\n", strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
 }
 
 // If masternode voted for a proposal, but is now invalid -- remove the vote
-void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
-{
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-
-    while (it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
-        ++it;
-    }
-}
-
-double CBudgetProposal::GetRatio()
+// Returns true if the tallies changed
+bool CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
 {
-    int yeas = 0;
-    int nays = 0;
-
+    bool fChanged = false;
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES) yeas++;
-        if ((*it).second.nVote == VOTE_NO) nays++;
+        bool fVoteValid = (*it).second.SignatureValid(fSignatureCheck);
+        if (fVoteValid != (*it).second.fValid) {
+            CountVote((*it).second, -1);
+            (*it).second.fValid = fVoteValid;
+            CountVote((*it).second, 1);
+            fChanged = true;
+        }
         ++it;
     }
 
-    if (yeas + nays == 0) return 0.0f;
-
-    return ((double)(yeas) / (double)(yeas + nays));
+    return fChanged;
 }
 
-int CBudgetProposal::GetYeas()
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nDelta)
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
-        ++it;
-    }
+    if (!vote.fValid) return;
 
-    return ret;
+    if (vote.nVote == VOTE_YES) nYeas += nDelta;
+    if (vote.nVote == VOTE_NO) nNays += nDelta;
+    if (vote.nVote == VOTE_ABSTAIN) nAbstains += nDelta;
 }
 
-int CBudgetProposal::GetNays()
+void CBudgetProposal::RecountVotes()
 {
-    int ret = 0;
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
 
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
+        CountVote((*it).second, 1);
         ++it;
     }
-
-    return ret;
 }
 
-int CBudgetProposal::GetAbstains()
+double CBudgetProposal::GetRatio()
 {
-    int ret = 0;
+    int yeas = 0;
+    int nays = 0;
 
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
+        if ((*it).second.nVote == VOTE_YES) yeas++;
+        if ((*it).second.nVote == VOTE_NO) nays++;
         ++it;
     }
 
-    return ret;
+    if (yeas + nays == 0) return 0.0f;
+
+    return ((double)(yeas) / (double)(yeas + nays));
 }
 
 int CBudgetProposal::GetBlockStartCycle()
@@ -1717,6 +1782,11 @@ void CBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -1724,7 +1794,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("mnbudget","CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1742,7 +1812,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
@@ -2222,6 +2292,11 @@ void CFinalizedBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CFinalizedBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -2229,7 +2304,7 @@ bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("mnbudget","CFinalizedBudgetVote::Sign - Error upon calling SignMessage");
@@ -2248,7 +2323,7 @@ bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
@@ -2275,3 +2350,53 @@ std::string CBudgetManager::ToString() const
 
     return info.str();
 }
+
+void CBudgetManager::WriteCacheRecords(CCacheFileWriter& fileout) const
+{
+    LOCK(cs);
+
+    WriteCacheMap(fileout, CACHE_SEEN_PROPOSAL, mapSeenMasternodeBudgetProposals);
+    WriteCacheMap(fileout, CACHE_SEEN_PROPOSAL_VOTE, mapSeenMasternodeBudgetVotes);
+    WriteCacheMap(fileout, CACHE_SEEN_FINALIZED_BUDGET, mapSeenFinalizedBudgets);
+    WriteCacheMap(fileout, CACHE_SEEN_FINALIZED_BUDGET_VOTE, mapSeenFinalizedBudgetVotes);
+    WriteCacheMap(fileout, CACHE_ORPHAN_PROPOSAL_VOTE, mapOrphanMasternodeBudgetVotes);
+    WriteCacheMap(fileout, CACHE_ORPHAN_FINALIZED_BUDGET_VOTE, mapOrphanFinalizedBudgetVotes);
+    WriteCacheMap(fileout, CACHE_PROPOSAL, mapProposals);
+    WriteCacheMap(fileout, CACHE_FINALIZED_BUDGET, mapFinalizedBudgets);
+}
+
+bool CBudgetManager::LoadCacheRecord(unsigned char nType, CDataStream& ssRecord)
+{
+    LOCK(cs);
+
+    switch (nType) {
+    case CACHE_SEEN_PROPOSAL:
+        LoadCacheMapRecord(ssRecord, mapSeenMasternodeBudgetProposals);
+        break;
+    case CACHE_SEEN_PROPOSAL_VOTE:
+        LoadCacheMapRecord(ssRecord, mapSeenMasternodeBudgetVotes);
+        break;
+    case CACHE_SEEN_FINALIZED_BUDGET:
+        LoadCacheMapRecord(ssRecord, mapSeenFinalizedBudgets);
+        break;
+    case CACHE_SEEN_FINALIZED_BUDGET_VOTE:
+        LoadCacheMapRecord(ssRecord, mapSeenFinalizedBudgetVotes);
+        break;
+    case CACHE_ORPHAN_PROPOSAL_VOTE:
+        LoadCacheMapRecord(ssRecord, mapOrphanMasternodeBudgetVotes);
+        break;
+    case CACHE_ORPHAN_FINALIZED_BUDGET_VOTE:
+        LoadCacheMapRecord(ssRecord, mapOrphanFinalizedBudgetVotes);
+        break;
+    case CACHE_PROPOSAL:
+        LoadCacheMapRecord(ssRecord, mapProposals);
+        InvalidateBudgetCache();
+        break;
+    case CACHE_FINALIZED_BUDGET:
+        LoadCacheMapRecord(ssRecord, mapFinalizedBudgets);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
@@ -21,11 +21,13 @@ using namespace std;
 extern CCriticalSection cs_budget;
 
 class CBudgetManager;
+class CCacheFileWriter;
 class CFinalizedBudgetBroadcast;
 class CFinalizedBudget;
 class CBudgetProposal;
 class CBudgetProposalBroadcast;
 class CTxBudgetPayment;
+class CSyncDigest;
 
 #define VOTE_ABSTAIN 0
 #define VOTE_YES 1
@@ -73,6 +75,7 @@ public:
     CBudgetVote();
     CBudgetVote(CTxIn vin, uint256 nProposalHash, int nVoteIn);
 
+    std::string GetStrMessage() const;
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
@@ -125,6 +128,7 @@ public:
     CFinalizedBudgetVote();
     CFinalizedBudgetVote(CTxIn vinIn, uint256 nBudgetHashIn);
 
+    std::string GetStrMessage() const;
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
@@ -185,6 +189,18 @@ private:
     // XX42    map<uint256, CTransaction> mapCollateral;
     map<uint256, uint256> mapCollateralTxids;
 
+    // GetBudget() result for one payment cycle, kept until a vote, a proposal or the
+    // masternode list changes, or another proposal becomes established. The list
+    // decides which votes are valid, so its ranking version is part of the key.
+    std::vector<uint256> vCachedBudget;
+    int nCachedBudgetStart;
+    int nCachedBudgetThreshold;
+    unsigned int nCachedBudgetMnVersion;
+    int64_t nCachedBudgetExpires;
+    bool fCachedBudgetDirty;
+
+    bool GetCachedBudget(int nBlockStart, int nThreshold, unsigned int nMnVersion, std::vector<CBudgetProposal*>& vBudgetProposalsRet);
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -200,12 +216,32 @@ public:
     std::map<uint256, CFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
     std::map<uint256, CFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;
 
+    //! Record types of the budget cache file
+    enum CacheRecord {
+        CACHE_SEEN_PROPOSAL = 1,
+        CACHE_SEEN_PROPOSAL_VOTE,
+        CACHE_SEEN_FINALIZED_BUDGET,
+        CACHE_SEEN_FINALIZED_BUDGET_VOTE,
+        CACHE_ORPHAN_PROPOSAL_VOTE,
+        CACHE_ORPHAN_FINALIZED_BUDGET_VOTE,
+        CACHE_PROPOSAL,
+        CACHE_FINALIZED_BUDGET
+    };
+
     CBudgetManager()
     {
         mapProposals.clear();
         mapFinalizedBudgets.clear();
+        nCachedBudgetStart = 0;
+        nCachedBudgetThreshold = 0;
+        nCachedBudgetMnVersion = 0;
+        nCachedBudgetExpires = 0;
+        fCachedBudgetDirty = true;
     }
 
+    /// Drop the cached GetBudget() result, needed whenever proposals or their tallies change
+    void InvalidateBudgetCache() { fCachedBudgetDirty = true; }
+
     void ClearSeen()
     {
         mapSeenMasternodeBudgetProposals.clear();
@@ -219,7 +255,8 @@ public:
 
     void ResetSync();
     void MarkSynced();
-    void Sync(CNode* node, uint256 nProp, bool fPartial = false);
+    void Sync(CNode* node, uint256 nProp, bool fPartial = false, const CSyncDigest* pdigest = NULL);
+    int GetSyncDigest(CSyncDigest& digest);
 
     void Calculate();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
@@ -259,10 +296,14 @@ public:
         mapSeenFinalizedBudgetVotes.clear();
         mapOrphanMasternodeBudgetVotes.clear();
         mapOrphanFinalizedBudgetVotes.clear();
+        InvalidateBudgetCache();
     }
     void CheckAndRemove();
     std::string ToString() const;
 
+    void WriteCacheRecords(CCacheFileWriter& fileout) const;
+    bool LoadCacheRecord(unsigned char nType, CDataStream& ssRecord);
+
 
     ADD_SERIALIZE_METHODS;
 
@@ -278,6 +319,8 @@ public:
 
         READWRITE(mapProposals);
         READWRITE(mapFinalizedBudgets);
+        if (ser_action.ForRead())
+            InvalidateBudgetCache();
     }
 };
 
@@ -467,6 +510,13 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+    // running tallies of the valid votes in mapVotes
+    int nYeas;
+    int nNays;
+    int nAbstains;
+
+    void CountVote(const CBudgetVote& vote, int nDelta);
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -497,15 +547,17 @@ public:
 
     bool IsValid(std::string& strError, bool fCheckCollateral = true);
 
-    bool IsEstablished()
+    int64_t GetEstablishedTime()
     {
         // Proposals must be at least a day old to make it into a budget
-        if (Params().NetworkID() == CBaseChainParams::MAIN) return (nTime < GetTime() - (60 * 60 * 24));
+        if (Params().NetworkID() == CBaseChainParams::MAIN) return nTime + (60 * 60 * 24);
 
         // For testing purposes - 1 minute
-        return (nTime < GetTime() - (60 * 1));
+        return nTime + (60 * 1);
     }
 
+    bool IsEstablished() { return GetEstablishedTime() < GetTime(); }
+
     std::string GetName() { return strProposalName; }
     std::string GetURL() { return strURL; }
     int GetBlockStart() { return nBlockStart; }
@@ -517,14 +569,15 @@ public:
     int GetBlockCurrentCycle();
     int GetBlockEndCycle();
     double GetRatio();
-    int GetYeas();
-    int GetNays();
-    int GetAbstains();
+    int GetYeas() { return nYeas; }
+    int GetNays() { return nNays; }
+    int GetAbstains() { return nAbstains; }
+    void RecountVotes();
     CAmount GetAmount() { return nAmount; }
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() { return nAlloted; }
 
-    void CleanAndRemove(bool fSignatureCheck);
+    bool CleanAndRemove(bool fSignatureCheck);
 
     uint256 GetHash()
     {
@@ -558,6 +611,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 };
 
@@ -586,6 +641,8 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        first.RecountVotes();
+        second.RecountVotes();
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
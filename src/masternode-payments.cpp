@@ -5,6 +5,7 @@
 
 #include "masternode-payments.h"
 #include "addrman.h"
+#include "cachefile.h"
 #include "masternode-budget.h"
 #include "masternode-sync.h"
 #include "masternodeman.h"
@@ -37,29 +38,13 @@ bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
+    // one record per vote and block, written next to the old cache and moved over it
+    CCacheFileWriter fileout(pathDB, strMagicMessage);
+    objToSave.WriteCacheRecords(fileout);
+    if (!fileout.Commit())
+        return error("%s : Failed to write file %s", __func__, pathDB.string());
 
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint("masternode","Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","Written %u records to mnpayments.dat  %dms\n", fileout.GetRecordCount(), GetTimeMillis() - nStart);
 
     return true;
 }
@@ -67,81 +52,48 @@ bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
 CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    CCacheFileReader filein(pathDB);
     if (filein.IsNull()) {
         error("%s : Failed to open file %s", __func__, pathDB.string());
         return FileError;
     }
 
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode payement cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
+    switch (filein.ReadHeader(strMagicMessage)) {
+    case CACHEFILE_OK:
+        break;
+    case CACHEFILE_BAD_MAGIC:
+        error("%s : Invalid masternode payement cache magic message", __func__);
+        return IncorrectMagicMessage;
+    case CACHEFILE_BAD_NETWORK:
+        error("%s : Invalid network magic number", __func__);
+        return IncorrectMagicNumber;
+    default:
+        error("%s : Outdated or unreadable masternode payment cache", __func__);
+        return IncorrectFormat;
+    }
 
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
+    // the header is all a dry run needs, the records are only checked while loading them
+    if (fDryRun)
+        return Ok;
 
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
+    // votes were verified before they were cached, their signatures are not checked again
+    unsigned char nType;
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    while (filein.Next(nType, ssRecord)) {
+        try {
+            objToLoad.LoadCacheRecord(nType, ssRecord);
+        } catch (std::exception& e) {
+            LogPrint("masternode","%s : Skipping unreadable record - %s\n", __func__, e.what());
         }
-
-        // de-serialize data into CMasternodePayments object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
-        objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
     }
+    objToLoad.RebuildPaidIndex();
 
-    LogPrint("masternode","Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","Loaded %u records from mnpayments.dat (%u corrupt)  %dms\n", filein.GetRecordCount(), filein.GetCorruptCount(), GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", objToLoad.ToString());
+    LogPrint("masternode","Masternode payments manager - cleaning....\n");
+    objToLoad.CleanPaymentList();
+    LogPrint("masternode","Masternode payments manager - result:\n");
     LogPrint("masternode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode payments manager - cleaning....\n");
-        objToLoad.CleanPaymentList();
-        LogPrint("masternode","Masternode payments manager - result:\n");
-        LogPrint("masternode","  %s\n", objToLoad.ToString());
-    }
 
     return Ok;
 }
@@ -453,14 +405,19 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
     }
 }
 
+std::string CMasternodePaymentWinner::GetStrMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
-    std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CMasternodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -531,17 +488,106 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
 
         mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
 
-        if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
-            CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
-            mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
-        }
+        AddPayeeVote(winnerIn.nBlockHeight, winnerIn.payee);
+    }
+
+    return true;
+}
+
+void CMasternodePayments::AddPayeeVote(int nBlockHeight, const CScript& payee)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    if (!mapMasternodeBlocks.count(nBlockHeight)) {
+        CMasternodeBlockPayees blockPayees(nBlockHeight);
+        mapMasternodeBlocks[nBlockHeight] = blockPayees;
+    }
+
+    CMasternodeBlockPayees& blockPayees = mapMasternodeBlocks[nBlockHeight];
+    blockPayees.AddPayee(payee, 1);
+    if (blockPayees.HasPayeeWithVotes(payee, MNPAYMENTS_PAID_VOTES))
+        mapPayeePaidHeights[payee].insert(nBlockHeight);
+}
+
+void CMasternodePayments::RemovePaidHeights(int nBlockHeight)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if (it == mapMasternodeBlocks.end())
+        return;
+
+    LOCK(cs_vecPayments);
+    BOOST_FOREACH (const CMasternodePayee& p, it->second.vecPayments) {
+        std::map<CScript, std::set<int> >::iterator mi = mapPayeePaidHeights.find(p.scriptPubKey);
+        if (mi == mapPayeePaidHeights.end())
+            continue;
+        mi->second.erase(nBlockHeight);
+        if (mi->second.empty())
+            mapPayeePaidHeights.erase(mi);
     }
+}
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+void CMasternodePayments::RebuildPaidIndex()
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_vecPayments);
+
+    mapPayeePaidHeights.clear();
+    for (std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin(); it != mapMasternodeBlocks.end(); ++it) {
+        BOOST_FOREACH (const CMasternodePayee& p, it->second.vecPayments)
+            if (p.nVotes >= MNPAYMENTS_PAID_VOTES)
+                mapPayeePaidHeights[p.scriptPubKey].insert(it->first);
+    }
+}
 
+void CMasternodePayments::WriteCacheRecords(CCacheFileWriter& fileout) const
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+
+    WriteCacheMap(fileout, CACHE_PAYEE_VOTE, mapMasternodePayeeVotes);
+    WriteCacheMap(fileout, CACHE_BLOCK_PAYEES, mapMasternodeBlocks);
+}
+
+/** Callers rebuild the paid index once all records are loaded */
+bool CMasternodePayments::LoadCacheRecord(unsigned char nType, CDataStream& ssRecord)
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+
+    switch (nType) {
+    case CACHE_PAYEE_VOTE:
+        LoadCacheMapRecord(ssRecord, mapMasternodePayeeVotes);
+        break;
+    case CACHE_BLOCK_PAYEES:
+        LoadCacheMapRecord(ssRecord, mapMasternodeBlocks);
+        break;
+    default:
+        return false;
+    }
     return true;
 }
 
+/**
+ * Height of the most recent of the last nMaxBlocks blocks up to nTipHeight
+ * that payee has MNPAYMENTS_PAID_VOTES votes for, or 0 if there is none.
+ * Payees are tracked by height, so blocks (dis)connecting only move nTipHeight.
+ */
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nTipHeight, int nMaxBlocks)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    std::map<CScript, std::set<int> >::const_iterator mi = mapPayeePaidHeights.find(payee);
+    if (mi == mapPayeePaidHeights.end())
+        return 0;
+
+    std::set<int>::const_iterator it = mi->second.upper_bound(nTipHeight);
+    if (it == mi->second.begin())
+        return 0;
+    --it;
+    if (*it <= 0 || *it <= nTipHeight - nMaxBlocks)
+        return 0;
+    return *it;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -673,6 +719,7 @@ void CMasternodePayments::CleanPaymentList()
             LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
             mapMasternodePayeeVotes.erase(it++);
+            RemovePaidHeights(winner.nBlockHeight);
             mapMasternodeBlocks.erase(winner.nBlockHeight);
         } else {
             ++it;
@@ -796,9 +843,7 @@ bool CMasternodePaymentWinner::SignatureValid()
     CMasternode* pmn = mnodeman.Find(vinMasternode);
 
     if (pmn != NULL) {
-        std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+        std::string strMessage = GetStrMessage();
 
         std::string errorMessage = "";
         if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
@@ -811,7 +856,7 @@ bool CMasternodePaymentWinner::SignatureValid()
     return false;
 }
 
-void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
+void CMasternodePayments::Sync(CNode* node, int nCountNeeded, const CSyncDigest* pdigest)
 {
     LOCK(cs_mapMasternodePayeeVotes);
 
@@ -825,19 +870,53 @@ void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
     int nCount = (mnodeman.CountEnabled() * 1.25);
     if (nCountNeeded > nCount) nCountNeeded = nCount;
 
+    // with a digest from the peer, only the votes in buckets that differ are announced
+    CSyncDigest digestOurs;
+    if (pdigest)
+        GetSyncDigest(nCountNeeded, digestOurs);
+
     int nInvCount = 0;
     std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
     while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
+        const CMasternodePaymentWinner& winner = (*it).second;
         if (winner.nBlockHeight >= nHeight - nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
-            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, winner.GetHash()));
-            nInvCount++;
+            if (!pdigest || !digestOurs.Matches(*pdigest, (*it).first)) {
+                node->PushInventory(CInv(MSG_MASTERNODE_WINNER, (*it).first));
+                nInvCount++;
+            }
         }
         ++it;
     }
     node->PushMessage("ssc", MASTERNODE_SYNC_MNW, nInvCount);
 }
 
+int CMasternodePayments::GetSyncDigest(int nCountNeeded, CSyncDigest& digest)
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+
+    int nHeight;
+    {
+        TRY_LOCK(cs_main, locked);
+        if (!locked || chainActive.Tip() == NULL) return 0;
+        nHeight = chainActive.Tip()->nHeight;
+    }
+
+    int nCount = (mnodeman.CountEnabled() * 1.25);
+    if (nCountNeeded > nCount) nCountNeeded = nCount;
+
+    int nItems = 0;
+    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
+    while (it != mapMasternodePayeeVotes.end()) {
+        const CMasternodePaymentWinner& winner = (*it).second;
+        if (winner.nBlockHeight >= nHeight - nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
+            digest.Add((*it).first);
+            nItems++;
+        }
+        ++it;
+    }
+    return nItems;
+}
+
 std::string CMasternodePayments::ToString() const
 {
     std::ostringstream info;
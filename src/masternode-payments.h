@@ -17,14 +17,18 @@ extern CCriticalSection cs_vecPayments;
 extern CCriticalSection cs_mapMasternodeBlocks;
 extern CCriticalSection cs_mapMasternodePayeeVotes;
 
+class CCacheFileWriter;
 class CMasternodePayments;
 class CMasternodePaymentWinner;
 class CMasternodeBlockPayees;
+class CSyncDigest;
 
 extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+// votes a payee needs for a block before it counts as paid there (see GetLastPaidHeight)
+#define MNPAYMENTS_PAID_VOTES 2
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -192,6 +196,7 @@ public:
         return ss.GetHash();
     }
 
+    std::string GetStrMessage() const;
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
@@ -236,11 +241,22 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    //! Heights each payee has MNPAYMENTS_PAID_VOTES votes for, mirrors mapMasternodeBlocks
+    std::map<CScript, std::set<int> > mapPayeePaidHeights;
+
+    void RemovePaidHeights(int nBlockHeight);
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
     std::map<uint256, int> mapMasternodesLastVote; //prevout.hash + prevout.n, nBlockHeight
 
+    //! Record types of the masternode payments cache file
+    enum CacheRecord {
+        CACHE_PAYEE_VOTE = 1,
+        CACHE_BLOCK_PAYEES
+    };
+
     CMasternodePayments()
     {
         nSyncedFromPeer = 0;
@@ -252,12 +268,19 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeePaidHeights.clear();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
+    void AddPayeeVote(int nBlockHeight, const CScript& payee);
+    void RebuildPaidIndex();
+    void WriteCacheRecords(CCacheFileWriter& fileout) const;
+    bool LoadCacheRecord(unsigned char nType, CDataStream& ssRecord);
+    int GetLastPaidHeight(const CScript& payee, int nTipHeight, int nMaxBlocks);
     bool ProcessBlock(int nBlockHeight);
 
-    void Sync(CNode* node, int nCountNeeded);
+    void Sync(CNode* node, int nCountNeeded, const CSyncDigest* pdigest = NULL);
+    int GetSyncDigest(int nCountNeeded, CSyncDigest& digest);
     void CleanPaymentList();
     int LastPayment(CMasternode& mn);
 
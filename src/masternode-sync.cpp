@@ -216,9 +216,75 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         }
 
         LogPrint("masternode", "CMasternodeSync:ProcessMessage - ssc - got inventory count %d %d\n", nItemID, nCount);
+
+        // a peer answering our digest only announces what we lack, which may be nothing at all
+        int nAsset = (nItemID == MASTERNODE_SYNC_BUDGET_PROP || nItemID == MASTERNODE_SYNC_BUDGET_FIN) ? MASTERNODE_SYNC_BUDGET : nItemID;
+        if (pfrom->HasFulfilledRequest(strprintf("mnsyncdigest%d", nAsset))) {
+            if (nAsset == MASTERNODE_SYNC_LIST) lastMasternodeList = GetTime();
+            if (nAsset == MASTERNODE_SYNC_MNW) lastMasternodeWinner = GetTime();
+            if (nAsset == MASTERNODE_SYNC_BUDGET) lastBudgetItem = GetTime();
+        }
+    } else if (strCommand == "mnsyncdigest") { //Sync request with a digest of the peer's items
+        if (fLiteMode) return;
+
+        int nItemID;
+        int nCountNeeded;
+        CSyncDigest digest;
+        vRecv >> nItemID >> nCountNeeded >> digest;
+
+        if (nItemID == MASTERNODE_SYNC_LIST) {
+            mnodeman.Sync(pfrom, digest);
+            return;
+        }
+
+        // the same once per connection limit as "mnget" and "mnvs"
+        std::string strRequest;
+        if (nItemID == MASTERNODE_SYNC_MNW)
+            strRequest = "mnget";
+        else if (nItemID == MASTERNODE_SYNC_BUDGET)
+            strRequest = "mnvs";
+        else
+            return;
+
+        if (Params().NetworkID() == CBaseChainParams::MAIN) {
+            if (pfrom->HasFulfilledRequest(strRequest)) {
+                LogPrint("masternode", "mnsyncdigest - peer already asked me for %s\n", strRequest);
+                Misbehaving(pfrom->GetId(), 20);
+                return;
+            }
+        }
+        pfrom->FulfilledRequest(strRequest);
+
+        if (nItemID == MASTERNODE_SYNC_MNW)
+            masternodePayments.Sync(pfrom, nCountNeeded, &digest);
+        else
+            budget.Sync(pfrom, 0, false, &digest);
+        LogPrint("masternode", "mnsyncdigest - Sent differing %s items to peer %i\n", strRequest, pfrom->GetId());
     }
 }
 
+bool CMasternodeSync::RequestDigest(CNode* pnode, int nItemID, int nCountNeeded)
+{
+    if (pnode->nVersion < MASTERNODE_SYNC_DIGEST_VERSION) return false;
+
+    CSyncDigest digest;
+    int nItems = 0;
+    if (nItemID == MASTERNODE_SYNC_LIST)
+        nItems = mnodeman.GetSyncDigest(digest);
+    else if (nItemID == MASTERNODE_SYNC_MNW)
+        nItems = masternodePayments.GetSyncDigest(nCountNeeded, digest);
+    else if (nItemID == MASTERNODE_SYNC_BUDGET)
+        nItems = budget.GetSyncDigest(digest);
+
+    // with nothing to compare the peer would send everything anyway
+    if (nItems == 0) return false;
+
+    pnode->FulfilledRequest(strprintf("mnsyncdigest%d", nItemID));
+    pnode->PushMessage("mnsyncdigest", nItemID, nCountNeeded, digest);
+    LogPrint("masternode", "CMasternodeSync::RequestDigest - asset %d, %d items, peer %i\n", nItemID, nItems, pnode->GetId());
+    return true;
+}
+
 void CMasternodeSync::ClearFulfilledRequest()
 {
     TRY_LOCK(cs_vNodes, lockRecv);
@@ -229,6 +295,9 @@ void CMasternodeSync::ClearFulfilledRequest()
         pnode->ClearFulfilledRequest("mnsync");
         pnode->ClearFulfilledRequest("mnwsync");
         pnode->ClearFulfilledRequest("busync");
+        pnode->ClearFulfilledRequest(strprintf("mnsyncdigest%d", MASTERNODE_SYNC_LIST));
+        pnode->ClearFulfilledRequest(strprintf("mnsyncdigest%d", MASTERNODE_SYNC_MNW));
+        pnode->ClearFulfilledRequest(strprintf("mnsyncdigest%d", MASTERNODE_SYNC_BUDGET));
     }
 }
 
@@ -359,7 +428,8 @@ void CMasternodeSync::Process()
                 if (pindexPrev == NULL) return;
 
                 int nMnCount = mnodeman.CountEnabled();
-                pnode->PushMessage("mnget", nMnCount); //sync payees
+                if (!RequestDigest(pnode, MASTERNODE_SYNC_MNW, nMnCount))
+                    pnode->PushMessage("mnget", nMnCount); //sync payees
                 RequestedMasternodeAttempt++;
 
                 return;
@@ -396,7 +466,8 @@ void CMasternodeSync::Process()
                 if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
 
                 uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync masternode votes
+                if (!RequestDigest(pnode, MASTERNODE_SYNC_BUDGET, 0))
+                    pnode->PushMessage("mnvs", n); //sync masternode votes
                 RequestedMasternodeAttempt++;
 
                 return;
@@ -5,6 +5,11 @@
 #ifndef MASTERNODE_SYNC_H
 #define MASTERNODE_SYNC_H
 
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
 #define MASTERNODE_SYNC_INITIAL 0
 #define MASTERNODE_SYNC_SPORKS 1
 #define MASTERNODE_SYNC_LIST 2
@@ -18,9 +23,51 @@
 #define MASTERNODE_SYNC_TIMEOUT 5
 #define MASTERNODE_SYNC_THRESHOLD 2
 
+#define MASTERNODE_SYNC_DIGEST_BUCKETS 128
+
 class CMasternodeSync;
 extern CMasternodeSync masternodeSync;
 
+//
+// CSyncDigest : Order independent digest of a set of inventory hashes, split in buckets so
+// peers syncing masternode assets only announce the items in buckets where they differ
+//
+
+class CSyncDigest
+{
+public:
+    std::vector<uint256> vBuckets;
+
+    CSyncDigest() : vBuckets(MASTERNODE_SYNC_DIGEST_BUCKETS) {}
+
+    static unsigned int GetBucket(const uint256& hash)
+    {
+        return hash.GetLow64() % MASTERNODE_SYNC_DIGEST_BUCKETS;
+    }
+
+    void Add(const uint256& hash)
+    {
+        vBuckets[GetBucket(hash)] ^= hash;
+    }
+
+    /// Whether the bucket of hash is the same in both digests, malformed digests match nothing
+    bool Matches(const CSyncDigest& other, const uint256& hash) const
+    {
+        if (other.vBuckets.size() != vBuckets.size())
+            return false;
+        unsigned int nBucket = GetBucket(hash);
+        return vBuckets[nBucket] == other.vBuckets[nBucket];
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(vBuckets);
+    }
+};
+
 //
 // CMasternodeSync : Sync masternode assets in stages
 //
@@ -67,6 +114,9 @@ public:
     bool IsBudgetFinEmpty();
     bool IsBudgetPropEmpty();
 
+    /// Ask pnode for the items of asset nItemID we lack by sending our digest, false if it can't be used
+    bool RequestDigest(CNode* pnode, int nItemID, int nCountNeeded);
+
     void Reset();
     void Process();
     bool IsSynced();
@@ -140,11 +140,14 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb)
     if (mnb.sigTime > sigTime) {
         pubKeyMasternode = mnb.pubKeyMasternode;
         pubKeyCollateralAddress = mnb.pubKeyCollateralAddress;
+        mnodeman.IndexMasternode(*this);
         sigTime = mnb.sigTime;
         sig = mnb.sig;
         protocolVersion = mnb.protocolVersion;
         addr = mnb.addr;
         lastTimeChecked = 0;
+        // sigTime and protocol decide whether it's ranked
+        mnodeman.MarkRankingChanged();
         int nDoS = 0;
         if (mnb.lastPing == CMasternodePing() || (mnb.lastPing != CMasternodePing() && mnb.lastPing.CheckAndUpdate(nDoS, false))) {
             lastPing = mnb.lastPing;
@@ -186,7 +189,32 @@ uint256 CMasternode::CalculateScore(int mod, int64_t nBlockHeight)
     return r;
 }
 
+//
+// Whether the outpoint is unspent in the chain or created by a mempool transaction, and not spent in the mempool
+//
+static bool IsCollateralUnspent(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_main);
+
+    CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+    CCoins coins;
+    if (!viewMemPool.GetCoins(outpoint.hash, coins) || !coins.IsAvailable(outpoint.n))
+        return false;
+
+    LOCK(mempool.cs);
+    return !mempool.mapNextTx.count(outpoint);
+}
+
 void CMasternode::Check(bool forceCheck)
+{
+    int nActiveStatePrev = activeState;
+    UpdateActiveState(forceCheck);
+    // entering or leaving a state changes which masternodes rank for SwiftX and budgets
+    if (activeState != nActiveStatePrev)
+        mnodeman.MarkRankingChanged();
+}
+
+void CMasternode::UpdateActiveState(bool forceCheck)
 {
     if (ShutdownRequested()) return;
 
@@ -214,21 +242,18 @@ void CMasternode::Check(bool forceCheck)
     }
 
     if (!unitTest) {
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut( (MASTERNODE_MIN_COINS - 0.01) * COIN, obfuScationPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-        tx.nTime = GetAdjustedTime();
-
-        {
+        // the collateral is looked up once, mnodeman follows it through SyncTransaction from then on
+        int nStatus = mnodeman.GetCollateralStatus(vin.prevout);
+        if (nStatus == CMasternodeMan::COLLATERAL_UNVERIFIED) {
             TRY_LOCK(cs_main, lockMain);
             if (!lockMain) return;
 
-            if (!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
-                activeState = MASTERNODE_VIN_SPENT;
-                return;
-            }
+            nStatus = IsCollateralUnspent(vin.prevout) ? CMasternodeMan::COLLATERAL_UNSPENT : CMasternodeMan::COLLATERAL_SPENT;
+            mnodeman.SetCollateralStatus(vin.prevout, nStatus);
+        }
+        if (nStatus == CMasternodeMan::COLLATERAL_SPENT) {
+            activeState = MASTERNODE_VIN_SPENT;
+            return;
         }
     }
 
@@ -236,11 +261,16 @@ void CMasternode::Check(bool forceCheck)
 }
 
 int64_t CMasternode::SecondsSincePayment()
+{
+    return SecondsSincePayment(mnodeman.CountEnabled() * 1.25);
+}
+
+int64_t CMasternode::SecondsSincePayment(int nMaxBlocks)
 {
     CScript pubkeyScript;
     pubkeyScript = GetScriptForDestination(pubKeyCollateralAddress.GetID());
 
-    int64_t sec = (GetAdjustedTime() - GetLastPaid());
+    int64_t sec = (GetAdjustedTime() - GetLastPaid(nMaxBlocks));
     int64_t month = 60 * 60 * 24 * 30;
     if (sec < month) return sec; //if it's less than 30 days, give seconds
 
@@ -254,6 +284,12 @@ int64_t CMasternode::SecondsSincePayment()
 }
 
 int64_t CMasternode::GetLastPaid()
+{
+    return GetLastPaid(mnodeman.CountEnabled() * 1.25);
+}
+
+//! Time of the last block within nMaxBlocks of the tip that paid this masternode, or 0
+int64_t CMasternode::GetLastPaid(int nMaxBlocks)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
     if (pindexPrev == NULL) return false;
@@ -269,36 +305,18 @@ int64_t CMasternode::GetLastPaid()
     // use a deterministic offset to break a tie -- 2.5 minutes
     int64_t nOffset = hash.GetCompact(false) % 150;
 
-    if (chainActive.Tip() == NULL) return false;
-
-    const CBlockIndex* BlockReading = chainActive.Tip();
-
-    int nMnCount = mnodeman.CountEnabled() * 1.25;
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if (n >= nMnCount) {
-            return 0;
-        }
-        n++;
-
-        if (masternodePayments.mapMasternodeBlocks.count(BlockReading->nHeight)) {
-            /*
-                Search for this payee, with at least 2 votes. This will aid in consensus allowing the network
-                to converge on the same payees quickly, then keep the same schedule.
-            */
-            if (masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2)) {
-                return BlockReading->nTime + nOffset;
-            }
-        }
-
-        if (BlockReading->pprev == NULL) {
-            assert(BlockReading);
-            break;
-        }
-        BlockReading = BlockReading->pprev;
-    }
+    /*
+        Search for this payee, with at least 2 votes. This will aid in consensus allowing the network
+        to converge on the same payees quickly, then keep the same schedule.
+    */
+    int nHeight = masternodePayments.GetLastPaidHeight(mnpayee, pindexPrev->nHeight, nMaxBlocks);
+    if (nHeight == 0)
+        return 0;
 
-    return 0;
+    const CBlockIndex* pindex = pindexPrev->GetAncestor(nHeight);
+    if (pindex == NULL)
+        return 0;
+    return pindex->nTime + nOffset;
 }
 
 std::string CMasternode::GetStatus()
@@ -727,13 +745,18 @@ CMasternodePing::CMasternodePing(CTxIn& newVin)
 }
 
 
+std::string CMasternodePing::GetStrMessage() const
+{
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
 bool CMasternodePing::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CMasternodePing::Sign() - Error: %s\n", errorMessage);
@@ -749,7 +772,7 @@ bool CMasternodePing::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 }
 
 bool CMasternodePing::VerifySignature(CPubKey& pubKeyMasternode, int &nDos) {
-	std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+	std::string strMessage = GetStrMessage();
 	std::string errorMessage = "";
 
 	if(!obfuScationSigner.VerifyMessage(pubKeyMasternode, vchSig, strMessage, errorMessage)){
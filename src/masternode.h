@@ -62,6 +62,7 @@ public:
     }
 
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true, bool fCheckSigTimeOnly = false);
+    std::string GetStrMessage() const;
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool VerifySignature(CPubKey& pubKeyMasternode, int &nDos);
     void Relay();
@@ -113,6 +114,8 @@ private:
     mutable CCriticalSection cs;
     int64_t lastTimeChecked;
 
+    void UpdateActiveState(bool forceCheck);
+
 public:
     enum state {
         MASTERNODE_PRE_ENABLED,
@@ -221,6 +224,7 @@ public:
     }
 
     int64_t SecondsSincePayment();
+    int64_t SecondsSincePayment(int nMaxBlocks);
 
     bool UpdateFromNewBroadcast(CMasternodeBroadcast& mnb);
 
@@ -284,6 +288,7 @@ public:
     }
 
     int64_t GetLastPaid();
+    int64_t GetLastPaid(int nMaxBlocks);
     bool IsValidNetAddr();
 };
 
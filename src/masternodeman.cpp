@@ -6,7 +6,9 @@
 #include "masternodeman.h"
 #include "activemasternode.h"
 #include "addrman.h"
+#include "cachefile.h"
 #include "masternode.h"
+#include "masternode-sync.h"
 #include "obfuscation.h"
 #include "spork.h"
 #include "util.h"
@@ -19,8 +21,8 @@
 CMasternodeMan mnodeman;
 
 struct CompareLastPaid {
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-        const pair<int64_t, CTxIn>& t2) const
+    bool operator()(const pair<int64_t, CMasternode*>& t1,
+        const pair<int64_t, CMasternode*>& t2) const
     {
         return t1.first < t2.first;
     }
@@ -56,30 +58,13 @@ bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
+    // one record per masternode and map entry, written next to the old cache and moved over it
+    CCacheFileWriter fileout(pathMN, strMagicMessage);
+    mnodemanToSave.WriteCacheRecords(fileout);
+    if (!fileout.Commit())
+        return error("%s : Failed to write file %s", __func__, pathMN.string());
 
-    LogPrint("masternode","Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","Written %u records to mncache.dat  %dms\n", fileout.GetRecordCount(), GetTimeMillis() - nStart);
     LogPrint("masternode","  %s\n", mnodemanToSave.ToString());
 
     return true;
@@ -88,80 +73,48 @@ bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    CCacheFileReader filein(pathMN);
     if (filein.IsNull()) {
         error("%s : Failed to open file %s", __func__, pathMN.string());
         return FileError;
     }
 
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathMN);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssMasternodes(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
+    switch (filein.ReadHeader(strMagicMessage)) {
+    case CACHEFILE_OK:
+        break;
+    case CACHEFILE_BAD_MAGIC:
+        error("%s : Invalid masternode cache magic message", __func__);
+        return IncorrectMagicMessage;
+    case CACHEFILE_BAD_NETWORK:
+        error("%s : Invalid network magic number", __func__);
+        return IncorrectMagicNumber;
+    default:
+        error("%s : Outdated or unreadable masternode cache", __func__);
+        return IncorrectFormat;
     }
 
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-
-        ssMasternodes >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode cache magic message", __func__);
-            return IncorrectMagicMessage;
+    // the header is all a dry run needs, the records are only checked while loading them
+    if (fDryRun)
+        return Ok;
+
+    // entries were verified before they were cached, their signatures are not checked again
+    unsigned char nType;
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    while (filein.Next(nType, ssRecord)) {
+        try {
+            mnodemanToLoad.LoadCacheRecord(nType, ssRecord);
+        } catch (std::exception& e) {
+            LogPrint("masternode","%s : Skipping unreadable record - %s\n", __func__, e.what());
         }
-
-        // de-serialize file header (network specific magic number) and ..
-        ssMasternodes >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-        // de-serialize data into CMasternodeMan object
-        ssMasternodes >> mnodemanToLoad;
-    } catch (std::exception& e) {
-        mnodemanToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
     }
+    mnodemanToLoad.RebuildIndexes();
 
-    LogPrint("masternode","Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","Loaded %u records from mncache.dat (%u corrupt)  %dms\n", filein.GetRecordCount(), filein.GetCorruptCount(), GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
+    LogPrint("masternode","Masternode manager - cleaning....\n");
+    mnodemanToLoad.CheckAndRemove(true);
+    LogPrint("masternode","Masternode manager - result:\n");
     LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode manager - cleaning....\n");
-        mnodemanToLoad.CheckAndRemove(true);
-        LogPrint("masternode","Masternode manager - result:\n");
-        LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
-    }
 
     return Ok;
 }
@@ -193,11 +146,63 @@ void DumpMasternodes()
     LogPrint("masternode","Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
-CMasternodeMan::CMasternodeMan()
+CMasternodeMan::CMasternodeMan() : nRankingVersion(0)
 {
     nDsqCount = 0;
 }
 
+void CMasternodeMan::WriteCacheRecords(CCacheFileWriter& fileout) const
+{
+    LOCK(cs);
+
+    BOOST_FOREACH (const CMasternode& mn, vMasternodes)
+        fileout.Write(CACHE_MASTERNODE, mn);
+    WriteCacheMap(fileout, CACHE_ASKED_US, mAskedUsForMasternodeList);
+    WriteCacheMap(fileout, CACHE_WE_ASKED, mWeAskedForMasternodeList);
+    WriteCacheMap(fileout, CACHE_WE_ASKED_ENTRY, mWeAskedForMasternodeListEntry);
+    fileout.Write(CACHE_DSQ_COUNT, nDsqCount);
+    WriteCacheMap(fileout, CACHE_SEEN_BROADCAST, mapSeenMasternodeBroadcast);
+    WriteCacheMap(fileout, CACHE_SEEN_PING, mapSeenMasternodePing);
+}
+
+bool CMasternodeMan::LoadCacheRecord(unsigned char nType, CDataStream& ssRecord)
+{
+    LOCK(cs);
+
+    switch (nType) {
+    case CACHE_MASTERNODE: {
+        CMasternode mn;
+        ReadCacheRecord(ssRecord, mn);
+        vMasternodes.push_back(mn);
+        break;
+    }
+    case CACHE_ASKED_US:
+        LoadCacheMapRecord(ssRecord, mAskedUsForMasternodeList);
+        break;
+    case CACHE_WE_ASKED:
+        LoadCacheMapRecord(ssRecord, mWeAskedForMasternodeList);
+        break;
+    case CACHE_WE_ASKED_ENTRY:
+        LoadCacheMapRecord(ssRecord, mWeAskedForMasternodeListEntry);
+        break;
+    case CACHE_DSQ_COUNT: {
+        int64_t nDsqCountTmp;
+        ReadCacheRecord(ssRecord, nDsqCountTmp);
+        nDsqCount = nDsqCountTmp;
+        break;
+    }
+    case CACHE_SEEN_BROADCAST:
+        LoadCacheMapRecord(ssRecord, mapSeenMasternodeBroadcast);
+        break;
+    case CACHE_SEEN_PING:
+        LoadCacheMapRecord(ssRecord, mapSeenMasternodePing);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
 bool CMasternodeMan::Add(CMasternode& mn)
 {
     LOCK(cs);
@@ -209,12 +214,126 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        IndexMasternode(vMasternodes.size() - 1);
+        MarkRankingChanged();
         return true;
     }
 
     return false;
 }
 
+void CMasternodeMan::IndexMasternode(size_t nPos)
+{
+    LOCK(cs);
+
+    const CMasternode& mn = vMasternodes[nPos];
+    mapIndexByOutpoint.insert(make_pair(mn.vin.prevout, nPos));
+    {
+        LOCK(cs_collateral);
+        mapCollateralStatus.insert(make_pair(mn.vin.prevout, (int)COLLATERAL_UNVERIFIED));
+    }
+
+    // an existing entry is kept only if it is still valid and belongs to an earlier Masternode
+    CScript payee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+    std::map<CScript, size_t>::iterator itPayee = mapIndexByPayee.find(payee);
+    if (itPayee == mapIndexByPayee.end())
+        mapIndexByPayee.insert(make_pair(payee, nPos));
+    else if (itPayee->second >= nPos ||
+             GetScriptForDestination(vMasternodes[itPayee->second].pubKeyCollateralAddress.GetID()) != payee)
+        itPayee->second = nPos;
+
+    std::map<CPubKey, size_t>::iterator itPubKey = mapIndexByPubKey.find(mn.pubKeyMasternode);
+    if (itPubKey == mapIndexByPubKey.end())
+        mapIndexByPubKey.insert(make_pair(mn.pubKeyMasternode, nPos));
+    else if (itPubKey->second >= nPos ||
+             vMasternodes[itPubKey->second].pubKeyMasternode != mn.pubKeyMasternode)
+        itPubKey->second = nPos;
+}
+
+void CMasternodeMan::IndexMasternode(const CMasternode& mn)
+{
+    LOCK(cs);
+
+    std::map<COutPoint, size_t>::iterator it = mapIndexByOutpoint.find(mn.vin.prevout);
+    if (it != mapIndexByOutpoint.end() && &vMasternodes[it->second] == &mn)
+        IndexMasternode(it->second);
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    // cs_collateral is held throughout so a spend SyncTransaction reports meanwhile is not lost
+    LOCK2(cs, cs_collateral);
+
+    // only called when Masternodes were removed or replaced
+    MarkRankingChanged();
+
+    std::map<COutPoint, int> mapCollateralStatusOld;
+    mapCollateralStatusOld.swap(mapCollateralStatus);
+
+    mapIndexByOutpoint.clear();
+    mapIndexByPayee.clear();
+    mapIndexByPubKey.clear();
+    for (size_t nPos = 0; nPos < vMasternodes.size(); nPos++)
+        IndexMasternode(nPos);
+
+    // keep what is known about the collaterals that are still listed
+    for (std::map<COutPoint, int>::iterator it = mapCollateralStatus.begin(); it != mapCollateralStatus.end(); ++it) {
+        std::map<COutPoint, int>::const_iterator itOld = mapCollateralStatusOld.find(it->first);
+        if (itOld != mapCollateralStatusOld.end())
+            it->second = itOld->second;
+    }
+}
+
+int CMasternodeMan::GetCollateralStatus(const COutPoint& outpoint) const
+{
+    LOCK(cs_collateral);
+
+    std::map<COutPoint, int>::const_iterator it = mapCollateralStatus.find(outpoint);
+    if (it == mapCollateralStatus.end())
+        return COLLATERAL_UNVERIFIED;
+    return it->second;
+}
+
+void CMasternodeMan::SetCollateralStatus(const COutPoint& outpoint, int nStatus)
+{
+    // SyncTransaction runs with cs_main held, so nothing can change the collateral in between
+    AssertLockHeld(cs_main);
+    LOCK(cs_collateral);
+
+    std::map<COutPoint, int>::iterator it = mapCollateralStatus.find(outpoint);
+    if (it != mapCollateralStatus.end())
+        it->second = nStatus;
+}
+
+void CMasternodeMan::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    // transactions get here without a block when they enter the mempool, and when they leave
+    // a disconnected block or the mempool; in the latter cases only those not (re)added are gone
+    bool fRemoved = pblock == NULL && !mempool.exists(tx.GetHash());
+
+    LOCK(cs_collateral);
+    if (mapCollateralStatus.empty())
+        return;
+
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        std::map<COutPoint, int>::iterator it = mapCollateralStatus.find(txin.prevout);
+        if (it != mapCollateralStatus.end()) {
+            LogPrint("masternode", "CMasternodeMan::SyncTransaction - collateral %s spent by %s\n", txin.prevout.ToString(), tx.GetHash().ToString());
+            it->second = COLLATERAL_SPENT;
+        }
+    }
+
+    if (fRemoved) {
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            std::map<COutPoint, int>::iterator it = mapCollateralStatus.find(COutPoint(tx.GetHash(), i));
+            if (it != mapCollateralStatus.end()) {
+                LogPrint("masternode", "CMasternodeMan::SyncTransaction - collateral %s removed\n", it->first.ToString());
+                it->second = COLLATERAL_SPENT;
+            }
+        }
+    }
+}
+
 void CMasternodeMan::AskForMN(CNode* pnode, CTxIn& vin)
 {
     std::map<COutPoint, int64_t>::iterator i = mWeAskedForMasternodeListEntry.find(vin.prevout);
@@ -247,6 +366,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
+    bool fRemoved = false;
     vector<CMasternode>::iterator it = vMasternodes.begin();
     while (it != vMasternodes.end()) {
         if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
@@ -279,10 +399,13 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            fRemoved = true;
         } else {
             ++it;
         }
     }
+    if (fRemoved)
+        RebuildIndexes();
 
     // check who's asked for the Masternode list
     map<CNetAddr, int64_t>::iterator it1 = mAskedUsForMasternodeList.begin();
@@ -340,6 +463,14 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    MarkRankingChanged();
+    mapIndexByOutpoint.clear();
+    mapIndexByPayee.clear();
+    mapIndexByPubKey.clear();
+    {
+        LOCK(cs_collateral);
+        mapCollateralStatus.clear();
+    }
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -430,43 +561,135 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("dseg", CTxIn());
+    if (!masternodeSync.RequestDigest(pnode, MASTERNODE_SYNC_LIST, 0))
+        pnode->PushMessage("dseg", CTxIn());
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
 
-CMasternode* CMasternodeMan::Find(const CScript& payee)
+bool CMasternodeMan::AllowListRequest(CNode* pnode)
 {
     LOCK(cs);
-    CScript payee2;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
+    //local network
+    bool isLocal = (pnode->addr.IsRFC1918() || pnode->addr.IsLocal());
+
+    if (!isLocal && Params().NetworkID() == CBaseChainParams::MAIN) {
+        std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pnode->addr);
+        if (i != mAskedUsForMasternodeList.end()) {
+            int64_t t = (*i).second;
+            if (GetTime() < t) {
+                Misbehaving(pnode->GetId(), 34);
+                LogPrint("masternode","dseg - peer already asked me for the list\n");
+                return false;
+            }
+        }
+        int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
+        mAskedUsForMasternodeList[pnode->addr] = askAgain;
     }
-    return NULL;
+    return true;
 }
 
-CMasternode* CMasternodeMan::Find(const CTxIn& vin)
+void CMasternodeMan::GetSyncBroadcasts(std::vector<CMasternodeBroadcast>& vBroadcasts)
 {
     LOCK(cs);
 
+    vBroadcasts.reserve(vMasternodes.size());
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
+        if (mn.addr.IsRFC1918()) continue; //local network
+        if (mn.IsEnabled())
+            vBroadcasts.push_back(CMasternodeBroadcast(mn));
+    }
+}
+
+int CMasternodeMan::GetSyncDigest(CSyncDigest& digest)
+{
+    std::vector<CMasternodeBroadcast> vBroadcasts;
+    GetSyncBroadcasts(vBroadcasts);
+    BOOST_FOREACH (CMasternodeBroadcast& mnb, vBroadcasts)
+        digest.Add(mnb.GetHash());
+    return vBroadcasts.size();
+}
+
+void CMasternodeMan::Sync(CNode* pnode, const CSyncDigest& digest)
+{
+    LOCK(cs);
+
+    if (!AllowListRequest(pnode)) return;
+
+    std::vector<CMasternodeBroadcast> vBroadcasts;
+    GetSyncBroadcasts(vBroadcasts);
+    std::vector<uint256> vHashes;
+    vHashes.reserve(vBroadcasts.size());
+    CSyncDigest digestOurs;
+    BOOST_FOREACH (CMasternodeBroadcast& mnb, vBroadcasts) {
+        vHashes.push_back(mnb.GetHash());
+        digestOurs.Add(vHashes.back());
+    }
+
+    int nInvCount = 0;
+    for (unsigned int i = 0; i < vBroadcasts.size(); i++) {
+        if (digestOurs.Matches(digest, vHashes[i])) continue;
+
+        pnode->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, vHashes[i]));
+        nInvCount++;
+
+        if (!mapSeenMasternodeBroadcast.count(vHashes[i])) mapSeenMasternodeBroadcast.insert(make_pair(vHashes[i], vBroadcasts[i]));
+    }
+
+    pnode->PushMessage("ssc", MASTERNODE_SYNC_LIST, nInvCount);
+    LogPrint("masternode", "mnsyncdigest - Sent %d of %d Masternode entries to peer %i\n", nInvCount, vBroadcasts.size(), pnode->GetId());
+}
+
+CMasternode* CMasternodeMan::Find(const CScript& payee)
+{
+    LOCK(cs);
+
+    std::map<CScript, size_t>::iterator it = mapIndexByPayee.find(payee);
+    if (it == mapIndexByPayee.end())
+        return NULL;
+    if (GetScriptForDestination(vMasternodes[it->second].pubKeyCollateralAddress.GetID()) == payee)
+        return &vMasternodes[it->second];
+
+    // the indexed Masternode changed its collateral key since, fall back to a scan and fix the entry
+    mapIndexByPayee.erase(it);
+    for (size_t nPos = 0; nPos < vMasternodes.size(); nPos++) {
+        if (GetScriptForDestination(vMasternodes[nPos].pubKeyCollateralAddress.GetID()) == payee) {
+            mapIndexByPayee.insert(make_pair(payee, nPos));
+            return &vMasternodes[nPos];
+        }
     }
     return NULL;
 }
 
+CMasternode* CMasternodeMan::Find(const CTxIn& vin)
+{
+    LOCK(cs);
+
+    std::map<COutPoint, size_t>::iterator it = mapIndexByOutpoint.find(vin.prevout);
+    if (it == mapIndexByOutpoint.end())
+        return NULL;
+    return &vMasternodes[it->second];
+}
+
 
 CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
+    std::map<CPubKey, size_t>::iterator it = mapIndexByPubKey.find(pubKeyMasternode);
+    if (it == mapIndexByPubKey.end())
+        return NULL;
+    if (vMasternodes[it->second].pubKeyMasternode == pubKeyMasternode)
+        return &vMasternodes[it->second];
+
+    // the indexed Masternode changed its key since, fall back to a scan and fix the entry
+    mapIndexByPubKey.erase(it);
+    for (size_t nPos = 0; nPos < vMasternodes.size(); nPos++) {
+        if (vMasternodes[nPos].pubKeyMasternode == pubKeyMasternode) {
+            mapIndexByPubKey.insert(make_pair(pubKeyMasternode, nPos));
+            return &vMasternodes[nPos];
+        }
     }
     return NULL;
 }
@@ -479,13 +702,15 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     LOCK(cs);
 
     CMasternode* pBestMasternode = NULL;
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeLastPaid;
+    std::vector<pair<int64_t, CMasternode*> > vecMasternodeLastPaid;
 
     /*
         Make a vector with all of the last paid times
     */
 
     int nMnCount = CountEnabled();
+    int nLastPaidBlocks = nMnCount * 1.25;
+    vecMasternodeLastPaid.reserve(vMasternodes.size());
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
         mn.Check();
         if (!mn.IsEnabled()) continue;
@@ -502,7 +727,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         //make sure it has as many confirmations as there are masternodes
         if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(), mn.vin));
+        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(nLastPaidBlocks), &mn));
     }
 
     nCount = (int)vecMasternodeLastPaid.size();
@@ -520,9 +745,8 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     int nTenthNetwork = CountEnabled() / 10;
     int nCountTenth = 0;
     uint256 nHigh = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeLastPaid) {
-        CMasternode* pmn = Find(s.second);
-        if (!pmn) break;
+    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode*) & s, vecMasternodeLastPaid) {
+        CMasternode* pmn = s.second;
 
         uint256 n = pmn->CalculateScore(1, nBlockHeight - 100);
         if (n > nHigh) {
@@ -591,15 +815,14 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     return winner;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+bool CMasternodeMan::GetMasternodeScores(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, std::vector<pair<int64_t, CTxIn> >& vecMasternodeScores, int64_t* pnValidUntil)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
     //make sure we know about this block
     uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    if (!GetBlockHash(hash, nBlockHeight)) return false;
 
     // scan for winner
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
@@ -612,6 +835,8 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
             nMasternode_Age = GetAdjustedTime() - mn.sigTime;
             if ((nMasternode_Age) < nMasternode_Min_Age) {
                 if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
+                if (pnValidUntil)
+                    *pnValidUntil = std::min(*pnValidUntil, mn.sigTime + nMasternode_Min_Age);
                 continue;                                                   // Skip masternodes younger than (default) 1 hour
             }
         }
@@ -627,6 +852,14 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
 
+    return true;
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetMasternodeScores(nBlockHeight, minProtocol, fOnlyActive, vecMasternodeScores)) return -1;
+
     int rank = 0;
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
         rank++;
@@ -638,6 +871,21 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     return -1;
 }
 
+bool CMasternodeMan::GetMasternodeRanking(int64_t nBlockHeight, int minProtocol, std::vector<CTxIn>& vecRanked, int64_t& nValidUntil)
+{
+    LOCK(cs);
+
+    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetMasternodeScores(nBlockHeight, minProtocol, true, vecMasternodeScores, &nValidUntil)) return false;
+
+    vecRanked.clear();
+    vecRanked.reserve(vecMasternodeScores.size());
+    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores)
+        vecRanked.push_back(s.second);
+
+    return true;
+}
+
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
     std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
@@ -647,6 +895,8 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
 
+    LOCK(cs);
+
     // scan for winner
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
         mn.Check();
@@ -802,22 +1052,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vin;
 
         if (vin == CTxIn()) { //only should ask for this once
-            //local network
-            bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
-
-            if (!isLocal && Params().NetworkID() == CBaseChainParams::MAIN) {
-                std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMasternodeList.find(pfrom->addr);
-                if (i != mAskedUsForMasternodeList.end()) {
-                    int64_t t = (*i).second;
-                    if (GetTime() < t) {
-                        Misbehaving(pfrom->GetId(), 34);
-                        LogPrint("masternode","dseg - peer already asked me for the list\n");
-                        return;
-                    }
-                }
-                int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
-                mAskedUsForMasternodeList[pfrom->addr] = askAgain;
-            }
+            if (!AllowListRequest(pfrom)) return;
         } //else, asking for a specific node which is ok
 
 
@@ -946,6 +1181,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                         pmn->addr = addr;
                         //fake ping
                         pmn->lastPing = CMasternodePing(vin);
+                        IndexMasternode(*pmn);
                     }
                     pmn->nLastDsee = sigTime;
                     pmn->Check();
@@ -1139,6 +1375,7 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            RebuildIndexes();
             break;
         }
         ++it;
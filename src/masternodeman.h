@@ -13,13 +13,18 @@
 #include "net.h"
 #include "sync.h"
 #include "util.h"
+#include "validationinterface.h"
+
+#include <atomic>
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
 
 using namespace std;
 
+class CCacheFileWriter;
 class CMasternodeMan;
+class CSyncDigest;
 
 extern CMasternodeMan mnodeman;
 void DumpMasternodes();
@@ -48,7 +53,7 @@ public:
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
-class CMasternodeMan
+class CMasternodeMan : public CValidationInterface
 {
 private:
     // critical section to protect the inner data structures
@@ -59,6 +64,11 @@ private:
 
     // map to hold all MNs
     std::vector<CMasternode> vMasternodes;
+    // positions in vMasternodes by collateral outpoint, payee script and masternode pubkey;
+    // payee and pubkey entries can go stale when a masternode changes keys and are verified on use
+    std::map<COutPoint, size_t> mapIndexByOutpoint;
+    std::map<CScript, size_t> mapIndexByPayee;
+    std::map<CPubKey, size_t> mapIndexByPubKey;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -66,7 +76,39 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // critical section protecting the collateral status, never held while taking cs or cs_main
+    mutable CCriticalSection cs_collateral;
+
+    // status of the collateral of every listed Masternode, kept up to date by SyncTransaction
+    std::map<COutPoint, int> mapCollateralStatus;
+
+    /// Index the keys of the entry at nPos, the first entry in vMasternodes wins on duplicates
+    void IndexMasternode(size_t nPos);
+
+    /// Whether pnode may ask for the full list now, punishes peers asking too often
+    bool AllowListRequest(CNode* pnode);
+
+    /// Broadcasts of the Masternodes a list sync announces
+    void GetSyncBroadcasts(std::vector<CMasternodeBroadcast>& vBroadcasts);
+
+    // bumped by every change that can move a Masternode in or out of a ranking
+    std::atomic<unsigned int> nRankingVersion;
+
+    /// Scores of the Masternodes GetMasternodeRank ranks, best first; false if the block is unknown.
+    /// pnValidUntil, if given, is lowered to the adjusted time a Masternode skipped for its age becomes eligible
+    bool GetMasternodeScores(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, std::vector<pair<int64_t, CTxIn> >& vecMasternodeScores, int64_t* pnValidUntil = NULL);
+
+protected:
+    /// Mark watched collaterals spent by tx, or gone with it when tx left the chain and the mempool
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+
 public:
+    enum CollateralStatus {
+        COLLATERAL_UNVERIFIED,
+        COLLATERAL_UNSPENT,
+        COLLATERAL_SPENT
+    };
+
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
     // Keep track of all pings I've seen
@@ -89,14 +131,46 @@ public:
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
+
+        if (ser_action.ForRead())
+            RebuildIndexes();
     }
 
+    /// Record types of the masternode cache file
+    enum CacheRecord {
+        CACHE_MASTERNODE = 1,
+        CACHE_ASKED_US,
+        CACHE_WE_ASKED,
+        CACHE_WE_ASKED_ENTRY,
+        CACHE_DSQ_COUNT,
+        CACHE_SEEN_BROADCAST,
+        CACHE_SEEN_PING
+    };
+
     CMasternodeMan();
     CMasternodeMan(CMasternodeMan& other);
 
+    /// Write the cache as one record per masternode and map entry
+    void WriteCacheRecords(CCacheFileWriter& fileout) const;
+
+    /// Apply one record written by WriteCacheRecords, unknown record types are ignored
+    bool LoadCacheRecord(unsigned char nType, CDataStream& ssRecord);
+
     /// Add an entry
     bool Add(CMasternode& mn);
 
+    /// Refresh the indexes after the keys of a listed Masternode changed
+    void IndexMasternode(const CMasternode& mn);
+
+    /// Rebuild all indexes, needed whenever entries are erased from vMasternodes
+    void RebuildIndexes();
+
+    /// Status of a collateral, COLLATERAL_UNVERIFIED if it was never looked up or isn't watched
+    int GetCollateralStatus(const COutPoint& outpoint) const;
+
+    /// Record the result of looking up a watched collateral, must be called with cs_main held
+    void SetCollateralStatus(const COutPoint& outpoint, int nStatus);
+
     /// Ask (source) node for mnb
     void AskForMN(CNode* pnode, CTxIn& vin);
 
@@ -115,6 +189,12 @@ public:
 
     void DsegUpdate(CNode* pnode);
 
+    /// Digest of the broadcasts a full list sync announces, returns their number
+    int GetSyncDigest(CSyncDigest& digest);
+
+    /// Answer a list sync request, announcing only the broadcasts in buckets where digest differs from ours
+    void Sync(CNode* pnode, const CSyncDigest& digest);
+
     /// Find an entry
     CMasternode* Find(const CScript& payee);
     CMasternode* Find(const CTxIn& vin);
@@ -137,6 +217,12 @@ public:
 
     std::vector<pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
+    /// The active Masternodes in rank order, as GetMasternodeRank ranks them; false if the block is unknown.
+    /// Unless GetRankingVersion() changes, the ranking holds until the adjusted time nValidUntil.
+    bool GetMasternodeRanking(int64_t nBlockHeight, int minProtocol, std::vector<CTxIn>& vecRanked, int64_t& nValidUntil);
+    /// Changes whenever a Masternode is added or removed, changes its active state or is updated by a new broadcast
+    unsigned int GetRankingVersion() const { return nRankingVersion; }
+    void MarkRankingChanged() { nRankingVersion++; }
     CMasternode* GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
 
     void ProcessMasternodeConnections();
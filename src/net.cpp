@@ -460,8 +460,10 @@ void CNode::CloseSocketDisconnect()
 
     // in case this fails, we'll empty the recv buffer when the CNode is deleted
     TRY_LOCK(cs_vRecvMsg, lockRecv);
-    if (lockRecv)
+    if (lockRecv) {
         vRecvMsg.clear();
+        nRecvMsgPrecached = 0;
+    }
 }
 
 bool CNode::DisconnectOldProtocol(int nVersionRequired, string strLastCommand)
@@ -2233,6 +2235,7 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nServices = 0;
     hSocket = hSocketIn;
     nRecvVersion = INIT_PROTO_VERSION;
+    nRecvMsgPrecached = 0;
     nLastSend = 0;
     nLastRecv = 0;
     nSendBytes = 0;
@@ -295,6 +295,7 @@ public:
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
+    size_t nRecvMsgPrecached; // leading vRecvMsg entries already seen by the signature precache
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
     int nRecvVersion;
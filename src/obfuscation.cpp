@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "obfuscation.h"
+#include "checkqueue.h"
 #include "coincontrol.h"
 #include "init.h"
 #include "main.h"
@@ -16,6 +17,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 
 #include <algorithm>
 #include <boost/assign/list_of.hpp>
@@ -2160,22 +2162,117 @@ bool CObfuScationSigner::SignMessage(std::string strMessage, std::string& errorM
     return true;
 }
 
-bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+namespace {
+
+/**
+ * Signers recovered from masternode message signatures. The same broadcasts, pings and
+ * votes are relayed to us by many peers, this saves recovering the key again for each copy.
+ */
+class CMessageSignatureCache
+{
+private:
+    //! Hash of (message hash, signature) to the key that signed it
+    std::map<uint256, CKeyID> mapSigners;
+    boost::shared_mutex cs_msgsigcache;
+
+    static uint256 GetKey(const uint256& hashMessage, const std::vector<unsigned char>& vchSig)
+    {
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << hashMessage << vchSig;
+        return ss.GetHash();
+    }
+
+public:
+    bool Get(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, CKeyID& keyIDRet)
+    {
+        uint256 hash = GetKey(hashMessage, vchSig);
+        boost::shared_lock<boost::shared_mutex> lock(cs_msgsigcache);
+
+        std::map<uint256, CKeyID>::const_iterator it = mapSigners.find(hash);
+        if (it == mapSigners.end())
+            return false;
+        keyIDRet = it->second;
+        return true;
+    }
+
+    void Set(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        uint256 hash = GetKey(hashMessage, vchSig);
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+
+        // About 50 bytes per entry, enough for the votes of a few thousand masternodes
+        while (mapSigners.size() >= 50000) {
+            // Evict a random entry, so nobody can predict which signatures stay cached
+            std::map<uint256, CKeyID>::iterator it = mapSigners.lower_bound(GetRandHash());
+            if (it == mapSigners.end())
+                it = mapSigners.begin();
+            mapSigners.erase(it);
+        }
+        mapSigners[hash] = keyID;
+    }
+};
+
+CMessageSignatureCache messageSignatureCache;
+CCheckQueue<CMessageSignatureCheck> msgsigcheckqueue(16);
+
+//! Recover the signer of a message signature, through the cache
+bool RecoverMessageSigner(const std::string& strMessage, const std::vector<unsigned char>& vchSig, CKeyID& keyIDRet)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    uint256 hashMessage = ss.GetHash();
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+    if (messageSignatureCache.Get(hashMessage, vchSig, keyIDRet))
+        return true;
+
+    CPubKey pubkey;
+    if (!pubkey.RecoverCompact(hashMessage, vchSig))
+        return false;
+    keyIDRet = pubkey.GetID();
+    messageSignatureCache.Set(hashMessage, vchSig, keyIDRet);
+    return true;
+}
+
+} // anon namespace
+
+bool CMessageSignatureCheck::operator()()
+{
+    // only warms the cache, VerifyMessage reports the result later on
+    CKeyID keyID;
+    RecoverMessageSigner(strMessage, vchSig, keyID);
+    return true;
+}
+
+void ThreadMessageSignatureCheck()
+{
+    RenameThread("kore-msgsigch");
+    msgsigcheckqueue.Thread();
+}
+
+bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+{
+    CKeyID keyID;
+    if (!RecoverMessageSigner(strMessage, vchSig, keyID)) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    if (fDebug && keyID != pubkey.GetID())
+        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", keyID.ToString(), pubkey.GetID().ToString());
+
+    return (keyID == pubkey.GetID());
+}
+
+void CObfuScationSigner::PrecacheSignatures(std::vector<CMessageSignatureCheck>& vChecks)
+{
+    // without check threads the handlers might as well verify one at a time
+    if (nScriptCheckThreads == 0 || vChecks.size() < 2)
+        return;
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    CCheckQueueControl<CMessageSignatureCheck> control(&msgsigcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
 }
 
 bool CObfuscationQueue::Sign()
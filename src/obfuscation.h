@@ -242,6 +242,31 @@ public:
     int64_t sigTime;
 };
 
+/** A signed masternode message whose signer is recovered ahead of VerifyMessage, on the
+ * message signature check threads
+ */
+class CMessageSignatureCheck
+{
+private:
+    std::vector<unsigned char> vchSig;
+    std::string strMessage;
+
+public:
+    CMessageSignatureCheck() {}
+    CMessageSignatureCheck(const std::vector<unsigned char>& vchSigIn, const std::string& strMessageIn) : vchSig(vchSigIn), strMessage(strMessageIn) {}
+
+    bool operator()();
+
+    void swap(CMessageSignatureCheck& check)
+    {
+        vchSig.swap(check.vchSig);
+        strMessage.swap(check.strMessage);
+    }
+};
+
+/** Run an instance of the message signature checking thread */
+void ThreadMessageSignatureCheck();
+
 /** Helper object for signing and checking signatures
  */
 class CObfuScationSigner
@@ -257,6 +282,8 @@ public:
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
+    /// Recover the signers of a batch of messages on the check threads, so VerifyMessage finds them cached
+    void PrecacheSignatures(std::vector<CMessageSignatureCheck>& vChecks);
 };
 
 /** Used to keep track of current status of Obfuscation pool
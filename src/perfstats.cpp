@@ -0,0 +1,89 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "perfstats.h"
+
+#include <atomic>
+
+namespace
+{
+CPerfCounters perfCounters[PERF_STAGE_COUNT];
+
+const char* const perfStageNames[PERF_STAGE_COUNT] = {
+    "processblock",
+    "headercheck",
+    "poskernel",
+    "connectblock",
+    "inputfetch",
+    "scriptcheck",
+    "undowrite",
+    "coinsflush",
+    "walletnotify",
+    "mempoolaccept",
+    "swifttxvote",
+    "swifttxlock",
+};
+
+int GetHistogramBucket(uint64_t nMicros)
+{
+    int nBucket = 0;
+    while (nMicros > 0 && nBucket < PERF_HISTOGRAM_BUCKETS - 1) {
+        nMicros >>= 1;
+        nBucket++;
+    }
+    return nBucket;
+}
+} // anon namespace
+
+void CPerfCounters::Record(int64_t nMicrosIn)
+{
+    uint64_t nMicros = nMicrosIn > 0 ? nMicrosIn : 0;
+    // Relaxed ordering is enough: the counters are only ever read as independent statistics
+    nCount.fetch_add(1, std::memory_order_relaxed);
+    nTotalMicros.fetch_add(nMicros, std::memory_order_relaxed);
+    vHistogram[GetHistogramBucket(nMicros)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t nMax = nMaxMicros.load(std::memory_order_relaxed);
+    while (nMicros > nMax && !nMaxMicros.compare_exchange_weak(nMax, nMicros, std::memory_order_relaxed)) {
+    }
+}
+
+void CPerfCounters::Get(CPerfStageStats& stats) const
+{
+    stats.nCount = nCount.load(std::memory_order_relaxed);
+    stats.nTotalMicros = nTotalMicros.load(std::memory_order_relaxed);
+    stats.nMaxMicros = nMaxMicros.load(std::memory_order_relaxed);
+    stats.vHistogram.resize(PERF_HISTOGRAM_BUCKETS);
+    for (int i = 0; i < PERF_HISTOGRAM_BUCKETS; i++)
+        stats.vHistogram[i] = vHistogram[i].load(std::memory_order_relaxed);
+}
+
+void CPerfCounters::Reset()
+{
+    nCount = 0;
+    nTotalMicros = 0;
+    nMaxMicros = 0;
+    for (int i = 0; i < PERF_HISTOGRAM_BUCKETS; i++)
+        vHistogram[i] = 0;
+}
+
+const char* GetPerfStageName(PerfStage stage)
+{
+    return perfStageNames[stage];
+}
+
+void RecordPerfSample(PerfStage stage, int64_t nMicros)
+{
+    perfCounters[stage].Record(nMicros);
+}
+
+void GetPerfStageStats(PerfStage stage, CPerfStageStats& stats)
+{
+    perfCounters[stage].Get(stats);
+}
+
+void ResetPerfStats()
+{
+    for (int nStage = 0; nStage < PERF_STAGE_COUNT; nStage++)
+        perfCounters[nStage].Reset();
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PERFSTATS_H
+#define BITCOIN_PERFSTATS_H
+
+#include "utiltime.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+/** Validation stages whose timings are collected for getperfstats */
+enum PerfStage {
+    PERF_PROCESS_BLOCK,  //!< ProcessNewBlock, end to end
+    PERF_HEADER_CHECK,   //!< AcceptBlockHeader
+    PERF_POS_KERNEL,     //!< proof-of-stake kernel check in AcceptBlock
+    PERF_CONNECT_BLOCK,  //!< ConnectBlock, end to end
+    PERF_INPUT_FETCH,    //!< fetching block inputs into the coins view
+    PERF_SCRIPT_CHECK,   //!< block script verification, including waiting for the worker threads
+    PERF_UNDO_WRITE,     //!< writing block undo data
+    PERF_COINS_FLUSH,    //!< flushing block index and coins cache to disk
+    PERF_WALLET_NOTIFY,  //!< SyncWithWallets after connecting a block
+    PERF_MEMPOOL_ACCEPT, //!< AcceptToMemoryPool
+    PERF_SWIFTTX_VOTE,   //!< ProcessConsensusVote, checking and counting one SwiftX lock vote
+    PERF_SWIFTTX_LOCK,   //!< from learning of a SwiftX lock until it has SWIFTTX_SIGNATURES_REQUIRED votes
+    PERF_STAGE_COUNT
+};
+
+/** Histogram bucket i counts samples below 2^i microseconds; the last bucket is open ended (>= ~2s) */
+static const int PERF_HISTOGRAM_BUCKETS = 23;
+
+struct CPerfStageStats {
+    uint64_t nCount;
+    uint64_t nTotalMicros;
+    uint64_t nMaxMicros;
+    std::vector<uint64_t> vHistogram;
+
+    CPerfStageStats() : nCount(0), nTotalMicros(0), nMaxMicros(0), vHistogram(PERF_HISTOGRAM_BUCKETS, 0) {}
+};
+
+/** Lock free counters behind CPerfStageStats, safe to update from any thread */
+class CPerfCounters
+{
+private:
+    std::atomic<uint64_t> nCount;
+    std::atomic<uint64_t> nTotalMicros;
+    std::atomic<uint64_t> nMaxMicros;
+    std::atomic<uint64_t> vHistogram[PERF_HISTOGRAM_BUCKETS];
+
+public:
+    CPerfCounters() { Reset(); }
+
+    void Record(int64_t nMicros);
+    /** Not an atomic snapshot across counters */
+    void Get(CPerfStageStats& stats) const;
+    void Reset();
+};
+
+/** Name of a stage as reported by getperfstats */
+const char* GetPerfStageName(PerfStage stage);
+
+/** Add one timing sample. Lock free; safe to call from any thread. */
+void RecordPerfSample(PerfStage stage, int64_t nMicros);
+
+/** Read the counters of one stage (not an atomic snapshot across counters) */
+void GetPerfStageStats(PerfStage stage, CPerfStageStats& stats);
+
+/** Zero all counters */
+void ResetPerfStats();
+
+/** Records the time between construction and destruction as a sample of a stage */
+class CPerfTimer
+{
+private:
+    PerfStage stage;
+    int64_t nStart;
+
+public:
+    CPerfTimer(PerfStage stageIn) : stage(stageIn), nStart(GetTimeMicros()) {}
+    ~CPerfTimer() { RecordPerfSample(stage, GetTimeMicros() - nStart); }
+};
+
+#endif // BITCOIN_PERFSTATS_H
@@ -290,6 +290,32 @@ static bool rest_chaininfo(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_perfstats(HTTPRequest* req, const std::string& strURIPart)
+{
+    // Timing data helps with fingerprinting and load estimation; never hand it to remote peers
+    if (!req->GetPeer().IsLocal())
+        return RESTERR(req, HTTP_FORBIDDEN, "perfstats are only served to local clients");
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+
+    switch (rf) {
+    case RF_JSON: {
+        UniValue rpcParams(UniValue::VARR);
+        UniValue perfStatsObject = getperfstats(rpcParams, false);
+        string strJSON = perfStatsObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_mempool_info(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -601,6 +627,7 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/perfstats", rest_perfstats},
 };
 
 bool StartREST()
@@ -6,6 +6,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockfilter.h"
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "main.h"
@@ -21,6 +22,9 @@
 #include <stdint.h>
 #include <univalue.h>
 
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
 using namespace std;
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
@@ -175,6 +179,12 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose) {
+        int nHeight;
+        {
+            LOCK(cs_main);
+            nHeight = chainActive.Height();
+        }
+
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
         BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
@@ -186,7 +196,7 @@ UniValue mempoolToJSON(bool fVerbose = false)
             info.push_back(Pair("time", e.GetTime()));
             info.push_back(Pair("height", (int)e.GetHeight()));
             info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+            info.push_back(Pair("currentpriority", e.GetPriority(nHeight)));
             const CTransaction& tx = e.GetTx();
             set<string> setDepends;
             BOOST_FOREACH (const CTxIn& txin, tx.vin) {
@@ -249,8 +259,6 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("getrawmempool", "true") + HelpExampleRpc("getrawmempool", "true"));
 
-    LOCK(cs_main);
-
     bool fVerbose = false;
     if (params.size() > 0)
         fVerbose = params[0].get_bool();
@@ -336,8 +344,6 @@ UniValue getblock(const UniValue& params, bool fHelp)
             HelpExampleCli("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\"") +
             HelpExampleRpc("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\""));
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(strHash);
 
@@ -345,13 +351,20 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CBlockIndex* pblockindex;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+        pblockindex = mapBlockIndex[hash];
+        pos = pblockindex->GetBlockPos();
+    }
 
-    if (!ReadBlockFromDisk(block, pblockindex))
+    // Block data is never moved once written, the read does not need cs_main
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pos) || block.GetHash() != hash)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     if (!fVerbose) {
@@ -361,6 +374,7 @@ UniValue getblock(const UniValue& params, bool fHelp)
         return strHex;
     }
 
+    LOCK(cs_main);
     return blockToJSON(block, pblockindex);
 }
 
@@ -400,6 +414,8 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
+    LOCK(cs_main);
+
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
@@ -455,6 +471,209 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static void CompactLevelDB(CLevelDBWrapper& db, uint64_t& nSize)
+{
+    db.CompactFull();
+    nSize = db.GetApproximateSize();
+}
+
+static void LevelDBStatsToJSON(CLevelDBWrapper& db, UniValue& result)
+{
+    UniValue entry(UniValue::VOBJ);
+    const CLevelDBOptions& dboptions = db.GetDBOptions();
+    UniValue options(UniValue::VOBJ);
+    options.push_back(Pair("blockcache", (uint64_t)dboptions.nBlockCache));
+    options.push_back(Pair("writebuffer", (uint64_t)dboptions.nWriteBuffer));
+    options.push_back(Pair("maxopenfiles", dboptions.nMaxOpenFiles));
+    options.push_back(Pair("bloombits", dboptions.nBloomBits));
+    options.push_back(Pair("compression", dboptions.fCompression));
+    entry.push_back(Pair("options", options));
+    entry.push_back(Pair("approximate_size", db.GetApproximateSize()));
+
+    UniValue levels(UniValue::VARR);
+    std::string strValue;
+    for (int nLevel = 0; db.GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), strValue); nLevel++)
+        levels.push_back(atoi(strValue));
+    entry.push_back(Pair("files_per_level", levels));
+    if (db.GetProperty("leveldb.stats", strValue))
+        entry.push_back(Pair("stats", strValue));
+    result.push_back(Pair(db.GetName(), entry));
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getdbstats ( \"name\" )\n"
+            "\nReturns LevelDB internal statistics of the open databases.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"     (string, optional) Only report this database (chainstate, index, sporks, ...)\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                 (json object) One entry per database\n"
+            "    \"options\": {            (json object) The tuning options in effect (see -dbopt)\n"
+            "      \"blockcache\": n,      (numeric) Block cache size in bytes\n"
+            "      \"writebuffer\": n,     (numeric) Write buffer size in bytes\n"
+            "      \"maxopenfiles\": n,    (numeric) Maximum number of open table files\n"
+            "      \"bloombits\": n,       (numeric) Bloom filter bits per key, 0 if disabled\n"
+            "      \"compression\": true|false (boolean) Whether Snappy compression is requested\n"
+            "    },\n"
+            "    \"approximate_size\": n,  (numeric) Approximate on-disk size in bytes\n"
+            "    \"files_per_level\": [n,...], (array) Number of table files at each level\n"
+            "    \"stats\": \"...\"          (string) The leveldb.stats compaction summary\n"
+            "  }, ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getdbstats", "") + HelpExampleCli("getdbstats", "\"chainstate\"") + HelpExampleRpc("getdbstats", "\"chainstate\""));
+
+    std::string strName = params.size() > 0 ? params[0].get_str() : "";
+    UniValue ret(UniValue::VOBJ);
+    if (!ForEachLevelDB(strName, boost::bind(&LevelDBStatsToJSON, _1, boost::ref(ret))) && !strName.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database " + strName);
+    return ret;
+}
+
+UniValue compactdb(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "compactdb \"name\"\n"
+            "\nCompacts the whole key range of a LevelDB database.\n"
+            "Note this call may take some time and competes with block processing for disk I/O.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"     (string, required) The database to compact (chainstate, index, sporks, ...)\n"
+
+            "\nResult:\n"
+            "n              (numeric) The approximate on-disk size in bytes after compaction\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("compactdb", "\"chainstate\"") + HelpExampleRpc("compactdb", "\"chainstate\""));
+
+    std::string strName = params[0].get_str();
+    if (strName.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Database name required");
+    uint64_t nSize = 0;
+    if (!ForEachLevelDB(strName, boost::bind(&CompactLevelDB, _1, boost::ref(nSize))))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database " + strName);
+    return nSize;
+}
+
+UniValue getblockfilter(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getblockfilter \"hash\"\n"
+            "\nReturns the compact script filter of a block (requires -blockfilterindex).\n"
+
+            "\nArguments:\n"
+            "1. \"hash\"          (string, required) The block hash\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"blockhash\": \"hash\",  (string) The block hash\n"
+            "  \"elements\": n,        (numeric) Number of distinct scripts in the filter\n"
+            "  \"filter\": \"hex\",      (string) The Golomb-Rice coded set of scripts, hex-encoded\n"
+            "  \"hash\": \"hash\"        (string) Double-SHA256 of the filter\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\""));
+
+    uint256 hash(params[0].get_str());
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        if (!pblockfilterdb)
+            throw JSONRPCError(RPC_MISC_ERROR, "Block filter index is disabled (start with -blockfilterindex)");
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pindex = mapBlockIndex[hash];
+    }
+
+    CBlockFilter filter;
+    if (!GetBlockFilter(pindex, filter))
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filter not available yet");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blockhash", filter.GetBlockHash().GetHex()));
+    ret.push_back(Pair("elements", (uint64_t)filter.GetElementCount()));
+    ret.push_back(Pair("filter", HexStr(filter.GetEncoded())));
+    ret.push_back(Pair("hash", filter.GetHash().GetHex()));
+    return ret;
+}
+
+UniValue scanblockfilters(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "scanblockfilters \"address\" ( startheight endheight )\n"
+            "\nLists the active chain blocks whose script filter matches an address or script (requires -blockfilterindex).\n"
+            "Filters have false positives, so a few of the listed blocks may not involve the address.\n"
+
+            "\nArguments:\n"
+            "1. \"address\"       (string, required) A KORE address or a hex-encoded scriptPubKey\n"
+            "2. startheight     (numeric, optional, default=0) First block height to scan\n"
+            "3. endheight       (numeric, optional, default=tip) Last block height to scan\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\": n,        (numeric) The block height\n"
+            "    \"hash\": \"hash\"      (string) The block hash\n"
+            "  }, ...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("scanblockfilters", "\"myaddress\" 100000") +
+            HelpExampleRpc("scanblockfilters", "\"myaddress\", 100000"));
+
+    CScript script;
+    CBitcoinAddress address(params[0].get_str());
+    if (address.IsValid()) {
+        script = GetScriptForDestination(address.Get());
+    } else if (IsHex(params[0].get_str())) {
+        std::vector<unsigned char> data(ParseHex(params[0].get_str()));
+        script = CScript(data.begin(), data.end());
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid KORE address or script");
+    }
+
+    // Collect the blocks under the lock, look up their filters without it
+    std::vector<CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        if (!pblockfilterdb)
+            throw JSONRPCError(RPC_MISC_ERROR, "Block filter index is disabled (start with -blockfilterindex)");
+        int nStart = params.size() > 1 ? params[1].get_int() : 0;
+        int nEnd = params.size() > 2 ? params[2].get_int() : chainActive.Height();
+        if (nStart < 0 || nEnd > chainActive.Height() || nStart > nEnd)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        for (int nHeight = nStart; nHeight <= nEnd; nHeight++)
+            vBlocks.push_back(chainActive[nHeight]);
+    }
+
+    std::set<CScript> setScripts;
+    setScripts.insert(script);
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH (CBlockIndex* pindex, vBlocks) {
+        CBlockFilter filter;
+        if (!GetBlockFilter(pindex, filter))
+            throw JSONRPCError(RPC_MISC_ERROR, strprintf("Block filter of height %d not available yet", pindex->nHeight));
+        if (!filter.MatchAny(setScripts))
+            continue;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("height", pindex->nHeight));
+        entry.push_back(Pair("hash", pindex->GetBlockHash().GetHex()));
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -494,8 +713,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
             "\nAs a json rpc call\n" +
             HelpExampleRpc("gettxout", "\"txid\", 1"));
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
     std::string strHash = params[0].get_str();
@@ -505,27 +722,34 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
+    // pcoinsTip is a cache shared with block connection, only the lookup needs cs_main
     CCoins coins;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
-            return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
-    } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
-            return NullUniValue;
+    uint256 hashBestBlock;
+    int nBestHeight;
+    {
+        LOCK(cs_main);
+        if (fMempool) {
+            LOCK(mempool.cs);
+            CCoinsViewMemPool view(pcoinsTip, mempool);
+            if (!view.GetCoins(hash, coins))
+                return NullUniValue;
+            mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+        } else {
+            if (!pcoinsTip->GetCoins(hash, coins))
+                return NullUniValue;
+        }
+        CBlockIndex* pindex = mapBlockIndex.find(pcoinsTip->GetBestBlock())->second;
+        hashBestBlock = pindex->GetBlockHash();
+        nBestHeight = pindex->nHeight;
     }
     if (n < 0 || (unsigned int)n >= coins.vout.size() || coins.vout[n].IsNull())
         return NullUniValue;
 
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex* pindex = it->second;
-    ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
+    ret.push_back(Pair("bestblock", hashBestBlock.GetHex()));
     if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
     else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
+        ret.push_back(Pair("confirmations", nBestHeight - coins.nHeight + 1));
     ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
     UniValue o(UniValue::VOBJ);
     ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
@@ -30,6 +30,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     {
         {"stop", 0},
         {"setmocktime", 0},
+        {"getperfstats", 0},
+        {"getrpcinfo", 0},
+        {"getspentinfo", 0},
         {"getaddednodeinfo", 0},
         {"setgenerate", 0},
         {"setgenerate", 1},
@@ -56,6 +59,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"listtransactions", 1},
         {"listtransactions", 2},
         {"listtransactions", 3},
+        {"listtransactions", 4},
         {"listaccounts", 0},
         {"listaccounts", 1},
         {"walletpassphrase", 1},
@@ -74,6 +78,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"listunspent", 2},
         {"listunspent", 3},
         {"getblock", 1},
+        {"scanblockfilters", 1},
+        {"scanblockfilters", 2},
         {"getblockheader", 1},
         {"gettransaction", 1},
         {"getrawtransaction", 1},
@@ -143,10 +149,19 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"getfeeinfo", 0}
     };
 
+/** Params that take an object or a bare string; a value that isn't JSON is passed on as a string */
+static const CRPCConvertParam vRPCConvertParamsOrString[] =
+    {
+        {"getaddressbalance", 0},
+        {"getaddressutxos", 0},
+        {"getaddresstxids", 0},
+    };
+
 class CRPCConvertTable
 {
 private:
     std::set<std::pair<std::string, int> > members;
+    std::set<std::pair<std::string, int> > membersOrString;
 
 public:
     CRPCConvertTable();
@@ -155,6 +170,11 @@ public:
     {
         return (members.count(std::make_pair(method, idx)) > 0);
     }
+
+    bool convertOrString(const std::string& method, int idx)
+    {
+        return (membersOrString.count(std::make_pair(method, idx)) > 0);
+    }
 };
 
 CRPCConvertTable::CRPCConvertTable()
@@ -166,6 +186,11 @@ CRPCConvertTable::CRPCConvertTable()
         members.insert(std::make_pair(vRPCConvertParams[i].methodName,
             vRPCConvertParams[i].paramIdx));
     }
+
+    for (unsigned int i = 0; i < (sizeof(vRPCConvertParamsOrString) / sizeof(vRPCConvertParamsOrString[0])); i++) {
+        membersOrString.insert(std::make_pair(vRPCConvertParamsOrString[i].methodName,
+            vRPCConvertParamsOrString[i].paramIdx));
+    }
 }
 
 static CRPCConvertTable rpcCvtTable;
@@ -190,7 +215,14 @@ UniValue RPCConvertValues(const std::string &strMethod, const std::vector<std::s
     for (unsigned int idx = 0; idx < strParams.size(); idx++) {
         const std::string& strVal = strParams[idx];
 
-        if (!rpcCvtTable.convert(strMethod, idx)) {
+        if (rpcCvtTable.convertOrString(strMethod, idx)) {
+            // JSON if it parses, e.g. an object, otherwise the bare string
+            UniValue jVal;
+            if (jVal.read(std::string("[") + strVal + std::string("]")) && jVal.isArray() && jVal.size() == 1)
+                params.push_back(jVal[0]);
+            else
+                params.push_back(strVal);
+        } else if (!rpcCvtTable.convert(strMethod, idx)) {
             // insert string value directly
             params.push_back(strVal);
         } else {
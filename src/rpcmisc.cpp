@@ -6,12 +6,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "checkqueue.h"
 #include "clientversion.h"
 #include "init.h"
 #include "main.h"
 #include "masternode-sync.h"
 #include "net.h"
 #include "netbase.h"
+#include "perfstats.h"
 #include "rpcserver.h"
 #include "spork.h"
 #include "timedata.h"
@@ -563,6 +565,318 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+static bool GetAddressIndexKey(const std::string& strAddress, uint160& hashBytes, unsigned int& type)
+{
+    CTxDestination dest = CBitcoinAddress(strAddress).Get();
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        type = ADDRESS_TYPE_PUBKEYHASH;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        type = ADDRESS_TYPE_SCRIPTHASH;
+        return true;
+    }
+    return false;
+}
+
+static std::string AddressIndexKeyToString(const uint160& hashBytes, unsigned int type)
+{
+    if (type == ADDRESS_TYPE_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+//! Accept either a single address or {"addresses": [...]}
+static void ParseAddressIndexParam(const UniValue& param, std::vector<std::pair<uint160, unsigned int> >& vAddresses)
+{
+    std::vector<std::string> vstrAddresses;
+    if (param.isStr()) {
+        vstrAddresses.push_back(param.get_str());
+    } else if (param.isObject() && find_value(param.get_obj(), "addresses").isArray()) {
+        const UniValue& addresses = find_value(param.get_obj(), "addresses").get_array();
+        for (unsigned int i = 0; i < addresses.size(); i++)
+            vstrAddresses.push_back(addresses[i].get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or {\"addresses\": [...]}");
+    }
+
+    BOOST_FOREACH (const std::string& strAddress, vstrAddresses) {
+        uint160 hashBytes;
+        unsigned int type;
+        if (!GetAddressIndexKey(strAddress, hashBytes, type))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + strAddress);
+        vAddresses.push_back(std::make_pair(hashBytes, type));
+    }
+}
+
+static bool HeightSort(const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b)
+{
+    return a.second.blockHeight < b.second.blockHeight;
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\" | {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of one or more addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. \"address\"       (string) A KORE address, or an object with an \"addresses\" array\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,    (numeric) The current balance in satoshis\n"
+            "  \"received\": n    (numeric) The total number of satoshis received, including change\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"myaddress\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"myaddress\"]}"));
+
+    std::vector<std::pair<uint160, unsigned int> > vAddresses;
+    ParseAddressIndexParam(params[0], vAddresses);
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (std::vector<std::pair<uint160, unsigned int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex))
+            throw JSONRPCError(RPC_MISC_ERROR, "No information available for address (is -addressindex enabled?)");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itIndex = addressIndex.begin(); itIndex != addressIndex.end(); itIndex++) {
+            if (itIndex->second > 0)
+                nReceived += itIndex->second;
+            nBalance += itIndex->second;
+        }
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("balance", nBalance));
+    ret.push_back(Pair("received", nReceived));
+    return ret;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"address\" | {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the unspent outputs of one or more addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. \"address\"       (string) A KORE address, or an object with an \"addresses\" array\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The address\n"
+            "    \"txid\": \"txid\",        (string) The transaction id\n"
+            "    \"outputIndex\": n,      (numeric) The output index\n"
+            "    \"script\": \"hex\",       (string) The scriptPubKey\n"
+            "    \"satoshis\": n,         (numeric) The value of the output in satoshis\n"
+            "    \"height\": n            (numeric) The height of the block that created the output\n"
+            "  }, ...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"myaddress\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"myaddress\"]}"));
+
+    std::vector<std::pair<uint160, unsigned int> > vAddresses;
+    ParseAddressIndexParam(params[0], vAddresses);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (std::vector<std::pair<uint160, unsigned int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        if (!GetAddressUnspent(it->first, it->second, unspentOutputs))
+            throw JSONRPCError(RPC_MISC_ERROR, "No information available for address (is -addressindex enabled?)");
+    }
+    std::stable_sort(unspentOutputs.begin(), unspentOutputs.end(), HeightSort);
+
+    UniValue ret(UniValue::VARR);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", AddressIndexKeyToString(it->first.hashBytes, it->first.type)));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.index));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("satoshis", it->second.satoshis));
+        output.push_back(Pair("height", it->second.blockHeight));
+        ret.push_back(output);
+    }
+    return ret;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids \"address\" | {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the ids of the transactions that involve one or more addresses, in block order (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. \"address\"       (string) A KORE address, or an object with an \"addresses\" array\n"
+            "                     and optional \"start\" and \"end\" block heights\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  \"txid\"           (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"myaddress\"]}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"myaddress\"], \"start\": 1000, \"end\": 2000}"));
+
+    std::vector<std::pair<uint160, unsigned int> > vAddresses;
+    ParseAddressIndexParam(params[0], vAddresses);
+
+    int nStart = 0;
+    int nEnd = 0;
+    if (params[0].isObject()) {
+        const UniValue& start = find_value(params[0].get_obj(), "start");
+        const UniValue& end = find_value(params[0].get_obj(), "end");
+        if (start.isNum())
+            nStart = start.get_int();
+        if (end.isNum())
+            nEnd = end.get_int();
+        if (nStart < 0 || nEnd < 0 || (nEnd > 0 && nEnd < nStart))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start or end height");
+    }
+
+    // Order by height, then position in the block, across all addresses
+    std::set<std::pair<std::pair<int, unsigned int>, uint256> > setTxids;
+    for (std::vector<std::pair<uint160, unsigned int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex, nStart, nEnd))
+            throw JSONRPCError(RPC_MISC_ERROR, "No information available for address (is -addressindex enabled?)");
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itIndex = addressIndex.begin(); itIndex != addressIndex.end(); itIndex++)
+            setTxids.insert(std::make_pair(std::make_pair(itIndex->first.blockHeight, itIndex->first.txindex), itIndex->first.txhash));
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (std::set<std::pair<std::pair<int, unsigned int>, uint256> >::const_iterator it = setTxids.begin(); it != setTxids.end(); it++)
+        ret.push_back(it->second.GetHex());
+    return ret;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\": \"txid\", \"index\": n}\n"
+            "\nReturns the input that spent an output (requires -spentindex).\n"
+
+            "\nArguments:\n"
+            "1. {\"txid\": \"txid\", \"index\": n}  (object, required) The output\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"txid\",   (string) The spending transaction id\n"
+            "  \"index\": n,       (numeric) The spending input index\n"
+            "  \"height\": n       (numeric) The height of the block containing the spending transaction\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    const UniValue& txid = find_value(params[0].get_obj(), "txid");
+    const UniValue& index = find_value(params[0].get_obj(), "index");
+    if (!txid.isStr() || !index.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    CSpentIndexKey key(ParseHashV(txid, "txid"), index.get_int());
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info (is -spentindex enabled?)");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("txid", value.txid.GetHex()));
+    ret.push_back(Pair("index", (int)value.inputIndex));
+    ret.push_back(Pair("height", value.blockHeight));
+    return ret;
+}
+
+UniValue getperfstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getperfstats ( reset )\n"
+            "\nReturns timing statistics of block and transaction validation stages since startup (or the last reset).\n"
+
+            "\nArguments:\n"
+            "1. reset      (boolean, optional, default=false) Zero the counters after reading them\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"stages\": {\n"
+            "    \"name\": {             (json object) One entry per stage (processblock, headercheck, poskernel, connectblock,\n"
+            "                                inputfetch, scriptcheck, undowrite, coinsflush, walletnotify, mempoolaccept,\n"
+            "                                swifttxvote, swifttxlock)\n"
+            "      \"count\": n,         (numeric) Number of samples\n"
+            "      \"total_ms\": x.xxx,  (numeric) Total time spent\n"
+            "      \"avg_ms\": x.xxx,    (numeric) Average time per sample\n"
+            "      \"max_ms\": x.xxx,    (numeric) Slowest sample\n"
+            "      \"histogram\": [n,...] (array) Sample counts per bucket; bucket i counts samples below 2^i microseconds\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"scriptcheck_workers\": [ (array) Script verification threads, the first entry is the validating thread\n"
+            "    {\n"
+            "      \"checks\": n,        (numeric) Script checks run\n"
+            "      \"batches\": n,       (numeric) Batches run\n"
+            "      \"steals\": n,        (numeric) Batches stolen from another worker\n"
+            "      \"batch_target\": n,  (numeric) Current adaptive batch size target\n"
+            "      \"busy_ms\": x.xxx,   (numeric) Time spent running checks\n"
+            "      \"utilization\": x.xx (numeric) Busy time as a fraction of the thread's lifetime\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getperfstats", "") + HelpExampleCli("getperfstats", "true") + HelpExampleRpc("getperfstats", "true"));
+
+    UniValue stages(UniValue::VOBJ);
+    for (int nStage = 0; nStage < PERF_STAGE_COUNT; nStage++) {
+        CPerfStageStats stats;
+        GetPerfStageStats((PerfStage)nStage, stats);
+        UniValue stage(UniValue::VOBJ);
+        stage.push_back(Pair("count", stats.nCount));
+        stage.push_back(Pair("total_ms", 0.001 * stats.nTotalMicros));
+        stage.push_back(Pair("avg_ms", stats.nCount ? 0.001 * stats.nTotalMicros / stats.nCount : 0.0));
+        stage.push_back(Pair("max_ms", 0.001 * stats.nMaxMicros));
+        UniValue histogram(UniValue::VARR);
+        BOOST_FOREACH (uint64_t nSamples, stats.vHistogram)
+            histogram.push_back(nSamples);
+        stage.push_back(Pair("histogram", histogram));
+        stages.push_back(Pair(GetPerfStageName((PerfStage)nStage), stage));
+    }
+
+    UniValue workers(UniValue::VARR);
+    std::vector<CCheckQueueWorkerStats> vWorkerStats;
+    GetScriptCheckQueueStats(vWorkerStats);
+    int64_t nNow = GetTimeMicros();
+    BOOST_FOREACH (const CCheckQueueWorkerStats& stats, vWorkerStats) {
+        UniValue worker(UniValue::VOBJ);
+        worker.push_back(Pair("checks", stats.nChecks));
+        worker.push_back(Pair("batches", stats.nBatches));
+        worker.push_back(Pair("steals", stats.nSteals));
+        worker.push_back(Pair("batch_target", (uint64_t)stats.nBatchTarget));
+        worker.push_back(Pair("busy_ms", 0.001 * stats.nBusyMicros));
+        worker.push_back(Pair("utilization", nNow > stats.nStartMicros ? (double)stats.nBusyMicros / (nNow - stats.nStartMicros) : 0.0));
+        workers.push_back(worker);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("stages", stages));
+    ret.push_back(Pair("scriptcheck_workers", workers));
+
+    if (params.size() > 0 && params[0].get_bool())
+        ResetPerfStats();
+    return ret;
+}
+
 #ifdef ENABLE_WALLET
 UniValue getstakingstatus(const UniValue& params, bool fHelp)
 {
@@ -580,6 +894,9 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if masternode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"stakethreads\": n,                (numeric) threads the last staking round hashed kernels on\n"
+            "  \"hashespersec\": x.xx,             (numeric) kernel hashes per second in the last staking round\n"
+            "  \"averagehashespersec\": x.xx,      (numeric) kernel hashes per second over all staking rounds\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -607,6 +924,11 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
     else if (mapHashedBlocks.count(chainActive.Tip()->nHeight - 1) && nLastCoinStakeSearchInterval)
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
+    if (pwalletMain) {
+        obj.push_back(Pair("stakethreads", (int)pwalletMain->nLastStakeThreads));
+        obj.push_back(Pair("hashespersec", pwalletMain->nLastStakeHashMicros ? 1000000.0 * pwalletMain->nLastStakeHashes / pwalletMain->nLastStakeHashMicros : 0.0));
+        obj.push_back(Pair("averagehashespersec", pwalletMain->nStakeHashMicros ? 1000000.0 * pwalletMain->nStakeHashes / pwalletMain->nStakeHashMicros : 0.0));
+    }
 
     return obj;
 }
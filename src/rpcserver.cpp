@@ -10,6 +10,7 @@
 #include "base58.h"
 #include "init.h"
 #include "main.h"
+#include "perfstats.h"
 #include "random.h"
 #include "sync.h"
 #include "ui_interface.h"
@@ -26,6 +27,8 @@
 #include <boost/thread.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_upper()
 
+#include <list>
+
 #include <univalue.h>
 
 using namespace RPCServer;
@@ -42,6 +45,65 @@ static std::vector<RPCTimerInterface*> timerInterfaces;
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
 
+/** Call statistics of one RPC method, reported by getrpcinfo */
+struct CRPCCommandStats {
+    CPerfCounters timings;
+    std::atomic<uint64_t> nErrors;
+
+    CRPCCommandStats() : nErrors(0) {}
+};
+
+/* One entry per command, created by the CRPCTable constructor; only the counters change afterwards */
+static std::map<std::string, CRPCCommandStats> mapRPCCommandStats;
+
+struct CRPCActiveCommand {
+    std::string strMethod;
+    int64_t nStartMicros;
+};
+
+/* Commands being executed right now */
+static std::list<CRPCActiveCommand> listRPCActiveCommands;
+static CCriticalSection cs_rpcActiveCommands;
+
+/** Tracks a command in listRPCActiveCommands and records its duration when it goes out of scope */
+class CRPCCommandExecution
+{
+private:
+    std::list<CRPCActiveCommand>::iterator it;
+    CRPCCommandStats* pstats;
+    bool fSucceeded;
+
+public:
+    CRPCCommandExecution(const std::string& strMethod) : pstats(NULL), fSucceeded(false)
+    {
+        std::map<std::string, CRPCCommandStats>::iterator itStats = mapRPCCommandStats.find(strMethod);
+        if (itStats != mapRPCCommandStats.end())
+            pstats = &itStats->second;
+
+        CRPCActiveCommand command;
+        command.strMethod = strMethod;
+        command.nStartMicros = GetTimeMicros();
+        LOCK(cs_rpcActiveCommands);
+        it = listRPCActiveCommands.insert(listRPCActiveCommands.end(), command);
+    }
+
+    ~CRPCCommandExecution()
+    {
+        int64_t nStartMicros = it->nStartMicros;
+        {
+            LOCK(cs_rpcActiveCommands);
+            listRPCActiveCommands.erase(it);
+        }
+        if (pstats) {
+            pstats->timings.Record(GetTimeMicros() - nStartMicros);
+            if (!fSucceeded)
+                pstats->nErrors++;
+        }
+    }
+
+    void Succeeded() { fSucceeded = true; }
+};
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -270,6 +332,83 @@ UniValue stop(const UniValue& params, bool fHelp)
     return "KORE server stopping";
 }
 
+UniValue getrpcinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getrpcinfo ( reset )\n"
+            "\nReturns the RPC commands being executed and call statistics per method since startup (or the last reset).\n"
+
+            "\nArguments:\n"
+            "1. reset      (boolean, optional, default=false) Zero the counters after reading them\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"active_commands\": [  (array) Commands in progress, including this one\n"
+            "    {\n"
+            "      \"method\": \"name\",  (string) The method name\n"
+            "      \"duration_ms\": x.xxx (numeric) Time since the command started\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"commands\": {\n"
+            "    \"name\": {             (json object) One entry per method called at least once\n"
+            "      \"count\": n,         (numeric) Number of calls\n"
+            "      \"errors\": n,        (numeric) Calls that returned an error\n"
+            "      \"total_ms\": x.xxx,  (numeric) Total time spent\n"
+            "      \"avg_ms\": x.xxx,    (numeric) Average time per call\n"
+            "      \"max_ms\": x.xxx,    (numeric) Slowest call\n"
+            "      \"histogram\": [n,...] (array) Call counts per bucket; bucket i counts calls below 2^i microseconds\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcinfo", "") + HelpExampleCli("getrpcinfo", "true") + HelpExampleRpc("getrpcinfo", "true"));
+
+    UniValue active(UniValue::VARR);
+    {
+        int64_t nNow = GetTimeMicros();
+        LOCK(cs_rpcActiveCommands);
+        BOOST_FOREACH (const CRPCActiveCommand& command, listRPCActiveCommands) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("method", command.strMethod));
+            entry.push_back(Pair("duration_ms", 0.001 * (nNow - command.nStartMicros)));
+            active.push_back(entry);
+        }
+    }
+
+    bool fReset = params.size() > 0 && params[0].get_bool();
+    UniValue commands(UniValue::VOBJ);
+    for (std::map<std::string, CRPCCommandStats>::iterator it = mapRPCCommandStats.begin(); it != mapRPCCommandStats.end(); ++it) {
+        CPerfStageStats stats;
+        it->second.timings.Get(stats);
+        if (stats.nCount == 0)
+            continue;
+
+        UniValue command(UniValue::VOBJ);
+        command.push_back(Pair("count", stats.nCount));
+        command.push_back(Pair("errors", (uint64_t)it->second.nErrors));
+        command.push_back(Pair("total_ms", 0.001 * stats.nTotalMicros));
+        command.push_back(Pair("avg_ms", 0.001 * stats.nTotalMicros / stats.nCount));
+        command.push_back(Pair("max_ms", 0.001 * stats.nMaxMicros));
+        UniValue histogram(UniValue::VARR);
+        BOOST_FOREACH (uint64_t nCalls, stats.vHistogram)
+            histogram.push_back(nCalls);
+        command.push_back(Pair("histogram", histogram));
+        commands.push_back(Pair(it->first, command));
+
+        if (fReset) {
+            it->second.timings.Reset();
+            it->second.nErrors = 0;
+        }
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("active_commands", active));
+    ret.push_back(Pair("commands", commands));
+    return ret;
+}
+
 
 /**
  * Call Table
@@ -280,6 +419,8 @@ static const CRPCCommand vRPCCommands[] =
         //  --------------------- ------------------------  -----------------------  ---------- ---------- ---------
         /* Overall control/query calls */
         {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
+        {"control", "getperfstats", &getperfstats, true, true, false},
+        {"control", "getrpcinfo", &getrpcinfo, true, true, false},
         {"control", "help", &help, true, true, false},
         {"control", "stop", &stop, true, true, false},
 
@@ -305,8 +446,11 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getblockcount", &getblockcount, true, false, false},
         {"blockchain", "getblock", &getblock, true, false, false},
         {"blockchain", "getblockhash", &getblockhash, true, false, false},
+        {"blockchain", "getblockfilter", &getblockfilter, true, false, false},
         {"blockchain", "getblockheader", &getblockheader, false, false, false},
+        {"blockchain", "compactdb", &compactdb, true, false, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
+        {"blockchain", "getdbstats", &getdbstats, true, false, false},
         {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
         {"blockchain", "getfeeinfo", &getfeeinfo, true, false, false},
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
@@ -315,6 +459,7 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
         {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
         {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
+        {"blockchain", "scanblockfilters", &scanblockfilters, true, false, false},
         {"blockchain", "verifychain", &verifychain, true, false, false},
 
         /* Mining */
@@ -347,6 +492,12 @@ static const CRPCCommand vRPCCommands[] =
         {"util", "estimatefee", &estimatefee, true, true, false},
         {"util", "estimatepriority", &estimatepriority, true, true, false},
 
+        /* Address index */
+        {"addressindex", "getaddressbalance", &getaddressbalance, true, false, false},
+        {"addressindex", "getaddresstxids", &getaddresstxids, true, false, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, true, false, false},
+        {"addressindex", "getspentinfo", &getspentinfo, true, false, false},
+
         /* Not shown in help */
         {"hidden", "invalidateblock", &invalidateblock, true, true, false},
         {"hidden", "reconsiderblock", &reconsiderblock, true, true, false},
@@ -466,6 +617,7 @@ CRPCTable::CRPCTable()
 
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
+        mapRPCCommandStats[pcmd->name];
     }
 }
 
@@ -593,14 +745,23 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
-    try {
-        // Execute
-        return pcmd->actor(params, false);
-    } catch (std::exception& e) {
-        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    // No lock is taken here, whatever the threadSafe flag says: the handlers lock
+    // cs_main and the wallet themselves, for as short as they can, so the calls of
+    // the HTTP worker threads only wait on each other where they share state.
+    UniValue result;
+    {
+        CRPCCommandExecution execution(pcmd->name);
+        try {
+            // Execute
+            result = pcmd->actor(params, false);
+        } catch (std::exception& e) {
+            throw JSONRPCError(RPC_MISC_ERROR, e.what());
+        }
+        execution.Succeeded();
     }
 
     g_rpcSignals.PostCommand(*pcmd);
+    return result;
 }
 
 std::vector<std::string> CRPCTable::listCommands() const
@@ -18,6 +18,7 @@
 #include "wallet.h"
 #include "walletdb.h"
 
+#include <limits>
 #include <stdint.h>
 #ifdef ZEROCOIN
 #include "libzerocoin/Coin.h"
@@ -1352,9 +1353,9 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Un
 
 UniValue listtransactions(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() > 4)
+    if (fHelp || params.size() > 5)
         throw runtime_error(
-            "listtransactions ( \"account\" count from includeWatchonly)\n"
+            "listtransactions ( \"account\" count from includeWatchonly before)\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
 
             "\nArguments:\n"
@@ -1363,6 +1364,9 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             "2. count          (numeric, optional, default=10) The number of transactions to return\n"
             "3. from           (numeric, optional, default=0) The number of transactions to skip\n"
             "4. includeWatchonly (bool, optional, default=false) Include transactions to watchonly addresses (see 'importaddress')\n"
+            "5. before         (numeric, optional) Only list transactions with an orderpos below this one. The page then always ends\n"
+            "                                     with all entries of its oldest transaction, so its lowest orderpos can be passed\n"
+            "                                     as 'before' to get the next page without walking the skipped history again.\n"
 
             "\nResult:\n"
             "[\n"
@@ -1397,6 +1401,7 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             "    \"otheraccount\": \"accountname\",  (string) For the 'move' category of transactions, the account the funds came \n"
             "                                          from (for receiving funds, positive amounts), or went to (for sending funds,\n"
             "                                          negative amounts).\n"
+            "    \"orderpos\": n,           (numeric) The position of the transaction in the wallet history\n"
             "  }\n"
             "]\n"
 
@@ -1407,6 +1412,8 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
             HelpExampleCli("listtransactions", "\"tabby\"") +
             "\nList transactions 100 to 120 from the tabby account\n" +
             HelpExampleCli("listtransactions", "\"tabby\" 20 100") +
+            "\nList the 20 transactions before position 1500\n" +
+            HelpExampleCli("listtransactions", "\"*\" 20 0 false 1500") +
             "\nAs a json rpc call\n" +
             HelpExampleRpc("listtransactions", "\"tabby\", 20, 100"));
 
@@ -1425,6 +1432,10 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
     if (params.size() > 3)
         if (params[3].get_bool())
             filter = filter | ISMINE_WATCH_ONLY;
+    bool fCursor = params.size() > 4;
+    int64_t nBefore = std::numeric_limits<int64_t>::max();
+    if (fCursor)
+        nBefore = params[4].get_int64();
 
     if (nCount < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
@@ -1432,41 +1443,46 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
     UniValue ret(UniValue::VARR);
+    vector<UniValue> arrTmp;
 
     const CWallet::TxItems & txOrdered = pwalletMain->wtxOrdered;
 
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
+    // iterate backwards from the cursor until we have nCount items to return:
+    for (CWallet::TxItems::const_reverse_iterator it(txOrdered.lower_bound(nBefore)); it != txOrdered.rend(); ++it) {
+        UniValue entries(UniValue::VARR);
         CWalletTx* const pwtx = (*it).second.first;
         if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
+            ListTransactions(*pwtx, strAccount, 0, true, entries, filter);
         CAccountingEntry* const pacentry = (*it).second.second;
         if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
+            AcentryToJSON(*pacentry, strAccount, entries);
 
-        if ((int)ret.size() >= (nCount + nFrom)) break;
-    }
-    // ret is newest to oldest
+        for (unsigned int i = 0; i < entries.size(); i++) {
+            UniValue entry = entries[i];
+            entry.push_back(Pair("orderpos", (*it).first));
+            arrTmp.push_back(entry);
+        }
 
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
+        if ((int)arrTmp.size() >= (nCount + nFrom)) break;
+    }
+    // arrTmp is newest to oldest
 
-    vector<UniValue> arrTmp = ret.getValues();
+    if (nFrom > (int)arrTmp.size())
+        nFrom = arrTmp.size();
+    if ((nFrom + nCount) > (int)arrTmp.size())
+        nCount = arrTmp.size() - nFrom;
 
     vector<UniValue>::iterator first = arrTmp.begin();
     std::advance(first, nFrom);
     vector<UniValue>::iterator last = arrTmp.begin();
     std::advance(last, nFrom+nCount);
 
-    if (last != arrTmp.end()) arrTmp.erase(last, arrTmp.end());
+    // A cursor page keeps all entries of its oldest transaction
+    if (last != arrTmp.end() && !fCursor) arrTmp.erase(last, arrTmp.end());
     if (first != arrTmp.begin()) arrTmp.erase(arrTmp.begin(), first);
 
     std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
 
-    ret.clear();
-    ret.setArray();
     ret.push_backV(arrTmp);
 
     return ret;
@@ -1619,11 +1635,15 @@ UniValue listsinceblock(const UniValue& params, bool fHelp)
 
     UniValue transactions(UniValue::VARR);
 
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++) {
-        CWalletTx tx = (*it).second;
-
-        if (depth == -1 || tx.GetDepthInMainChain(false) < depth)
-            ListTransactions(tx, "*", 0, true, transactions, filter);
+    if (depth == -1) {
+        for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++)
+            ListTransactions((*it).second, "*", 0, true, transactions, filter);
+    } else {
+        // Only visit the transactions of blocks after pindex, instead of the whole wallet
+        vector<const CWalletTx*> vwtx;
+        pwalletMain->GetTransactionsSince(pindex, vwtx);
+        BOOST_FOREACH (const CWalletTx* pwtx, vwtx)
+            ListTransactions(*pwtx, "*", 0, true, transactions, filter);
     }
 
     CBlockIndex* pblockLast = chainActive[chainActive.Height() + 1 - target_confirms];
@@ -2147,6 +2167,24 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
             "  \"keypoololdest\": xxxxxx,    (numeric) the timestamp (seconds since GMT epoch) of the oldest pre-generated key in the key pool\n"
             "  \"keypoolsize\": xxxx,        (numeric) how many new keys are pre-generated\n"
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
+            "  \"keypoolrefill\": {         (object) key pool refill throughput since startup\n"
+            "    \"keys\": n,                  (numeric) keys generated for the key pool\n"
+            "    \"keyspersec\": x.xx,         (numeric) average keys generated per second\n"
+            "    \"lastkeys\": n,              (numeric) keys generated by the most recent refill\n"
+            "    \"lastkeyspersec\": x.xx      (numeric) keys per second of the most recent refill\n"
+            "  },\n"
+            "  \"dbwrites\": {              (object) wallet database write latency since startup\n"
+            "    \"writes\": n,                (numeric) records written or erased\n"
+            "    \"avgwritemicros\": n,        (numeric) average time per record write\n"
+            "    \"maxwritemicros\": n,        (numeric) slowest record write\n"
+            "    \"batches\": n,               (numeric) batches committed as one database transaction\n"
+            "    \"avgcommitmicros\": n,       (numeric) average time to commit a batch\n"
+            "    \"checkpoints\": n,           (numeric) checkpoints taken when closing a database handle after writing\n"
+            "    \"avgcheckpointmicros\": n,   (numeric) average time per checkpoint\n"
+            "    \"flushes\": n,               (numeric) background flushes of wallet.dat\n"
+            "    \"avgflushmicros\": n,        (numeric) average time per background flush\n"
+            "    \"lastflush\": ttt            (numeric) the time of the last background flush, or 0 if none\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -2162,6 +2200,27 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("keypoolsize", (int)pwalletMain->GetKeyPoolSize()));
     if (pwalletMain->IsCrypted())
         obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
+
+    UniValue keypoolrefill(UniValue::VOBJ);
+    keypoolrefill.push_back(Pair("keys", pwalletMain->nKeyPoolRefillKeys));
+    keypoolrefill.push_back(Pair("keyspersec", pwalletMain->nKeyPoolRefillMicros ? 1000000.0 * pwalletMain->nKeyPoolRefillKeys / pwalletMain->nKeyPoolRefillMicros : 0.0));
+    keypoolrefill.push_back(Pair("lastkeys", pwalletMain->nLastKeyPoolRefillKeys));
+    keypoolrefill.push_back(Pair("lastkeyspersec", pwalletMain->nLastKeyPoolRefillMicros ? 1000000.0 * pwalletMain->nLastKeyPoolRefillKeys / pwalletMain->nLastKeyPoolRefillMicros : 0.0));
+    obj.push_back(Pair("keypoolrefill", keypoolrefill));
+
+    CDBWriteStats stats = bitdb.GetWriteStats();
+    UniValue dbwrites(UniValue::VOBJ);
+    dbwrites.push_back(Pair("writes", stats.nWrites));
+    dbwrites.push_back(Pair("avgwritemicros", stats.nWrites ? stats.nWriteMicros / (int64_t)stats.nWrites : 0));
+    dbwrites.push_back(Pair("maxwritemicros", stats.nMaxWriteMicros));
+    dbwrites.push_back(Pair("batches", stats.nCommits));
+    dbwrites.push_back(Pair("avgcommitmicros", stats.nCommits ? stats.nCommitMicros / (int64_t)stats.nCommits : 0));
+    dbwrites.push_back(Pair("checkpoints", stats.nCheckpoints));
+    dbwrites.push_back(Pair("avgcheckpointmicros", stats.nCheckpoints ? stats.nCheckpointMicros / (int64_t)stats.nCheckpoints : 0));
+    dbwrites.push_back(Pair("flushes", stats.nFlushes));
+    dbwrites.push_back(Pair("avgflushmicros", stats.nFlushes ? stats.nFlushMicros / (int64_t)stats.nFlushes : 0));
+    dbwrites.push_back(Pair("lastflush", stats.nLastFlush));
+    obj.push_back(Pair("dbwrites", dbwrites));
     return obj;
 }
 
@@ -13,6 +13,7 @@
 #include "sync.h"
 #include "sporkdb.h"
 #include "util.h"
+#include <atomic>
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -26,6 +27,50 @@ CSporkManager sporkManager;
 std::map<uint256, CSporkMessage> mapSporks;
 std::map<int, CSporkMessage> mapSporksActive;
 
+namespace
+{
+int64_t GetSporkDefault(int nSporkID)
+{
+    if (nSporkID == SPORK_2_SWIFTTX) return SPORK_2_SWIFTTX_DEFAULT;
+    if (nSporkID == SPORK_3_SWIFTTX_BLOCK_FILTERING) return SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
+    if (nSporkID == SPORK_5_MAX_VALUE) return SPORK_5_MAX_VALUE_DEFAULT;
+    if (nSporkID == SPORK_7_MASTERNODE_SCANNING) return SPORK_7_MASTERNODE_SCANNING_DEFAULT;
+    if (nSporkID == SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) return SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
+    if (nSporkID == SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT) return SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
+    if (nSporkID == SPORK_10_MASTERNODE_PAY_UPDATED_NODES) return SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
+    if (nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) return SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
+
+    return -1;
+}
+
+/**
+ * Current value of every spork ID, -1 where there is none. mapSporksActive is only
+ * touched by the message handler, this copy of its values (or the defaults) is what
+ * the rest of the node reads, without taking any lock.
+ */
+struct CSporkValues {
+    std::atomic<int64_t> vValues[SPORK_END - SPORK_START + 1];
+
+    CSporkValues()
+    {
+        for (int nSporkID = SPORK_START; nSporkID <= SPORK_END; nSporkID++)
+            vValues[nSporkID - SPORK_START] = GetSporkDefault(nSporkID);
+    }
+};
+
+CSporkValues sporkValues;
+
+// make an accepted spork visible to GetSporkValue and tell the subscribers
+void PublishSpork(const CSporkMessage& spork)
+{
+    if (spork.nSporkID < SPORK_START || spork.nSporkID > SPORK_END) return;
+
+    int64_t nOldValue = sporkValues.vValues[spork.nSporkID - SPORK_START].exchange(spork.nValue);
+    if (nOldValue != spork.nValue)
+        sporkManager.NotifySporkChanged(spork.nSporkID, spork.nValue);
+}
+} // anon namespace
+
 // KORE: on startup load spork values from previous session if they exist in the sporkDB
 void LoadSporksFromDB()
 {
@@ -44,6 +89,7 @@ void LoadSporksFromDB()
         // add spork to memory
         mapSporks[spork.GetHash()] = spork;
         mapSporksActive[spork.nSporkID] = spork;
+        PublishSpork(spork);
         std::time_t result = spork.nValue;
         // If SPORK Value is greater than 1,000,000 assume it's actually a Date and then convert to a more readable format
         if (spork.nValue > 1000000) {
@@ -101,6 +147,7 @@ void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 
         mapSporks[hash] = spork;
         mapSporksActive[spork.nSporkID] = spork;
+        PublishSpork(spork);
         sporkManager.Relay(spork);
 
         // KORE: add to spork database.
@@ -122,20 +169,10 @@ int64_t GetSporkValue(int nSporkID)
 {
     int64_t r = -1;
 
-    if (mapSporksActive.count(nSporkID)) {
-        r = mapSporksActive[nSporkID].nValue;
-    } else {
-        if (nSporkID == SPORK_2_SWIFTTX) r = SPORK_2_SWIFTTX_DEFAULT;
-        if (nSporkID == SPORK_3_SWIFTTX_BLOCK_FILTERING) r = SPORK_3_SWIFTTX_BLOCK_FILTERING_DEFAULT;
-        if (nSporkID == SPORK_5_MAX_VALUE) r = SPORK_5_MAX_VALUE_DEFAULT;
-        if (nSporkID == SPORK_7_MASTERNODE_SCANNING) r = SPORK_7_MASTERNODE_SCANNING_DEFAULT;
-        if (nSporkID == SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) r = SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT) r = SPORK_9_MASTERNODE_BUDGET_ENFORCEMENT_DEFAULT;
-        if (nSporkID == SPORK_10_MASTERNODE_PAY_UPDATED_NODES) r = SPORK_10_MASTERNODE_PAY_UPDATED_NODES_DEFAULT;
-        if (nSporkID == SPORK_13_ENABLE_SUPERBLOCKS) r = SPORK_13_ENABLE_SUPERBLOCKS_DEFAULT;
-
-        if (r == -1) LogPrintf("%s : Unknown Spork %d\n", __func__, nSporkID);
-    }
+    if (nSporkID >= SPORK_START && nSporkID <= SPORK_END)
+        r = sporkValues.vValues[nSporkID - SPORK_START].load();
+
+    if (r == -1) LogPrintf("%s : Unknown Spork %d\n", __func__, nSporkID);
 
     return r;
 }
@@ -232,6 +269,7 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue)
         Relay(msg);
         mapSporks[msg.GetHash()] = msg;
         mapSporksActive[nSporkID] = msg;
+        PublishSpork(msg);
         return true;
     }
 
@@ -16,6 +16,7 @@
 #include "obfuscation.h"
 #include "protocol.h"
 #include <boost/lexical_cast.hpp>
+#include <boost/signals2/signal.hpp>
 
 using namespace std;
 using namespace boost;
@@ -56,6 +57,7 @@ extern CSporkManager sporkManager;
 
 void LoadSporksFromDB();
 void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+// lock free, served from the values published whenever a spork is loaded or accepted
 int64_t GetSporkValue(int nSporkID);
 bool IsSporkActive(int nSporkID);
 void ReprocessBlocks(int nBlocks);
@@ -103,6 +105,9 @@ public:
     {
     }
 
+    /** A spork got a new value, fired once GetSporkValue returns it */
+    boost::signals2::signal<void(int nSporkID, int64_t nValue)> NotifySporkChanged;
+
     std::string GetSporkNameByID(int id);
     int GetSporkIDByName(std::string strName);
     bool UpdateSpork(int nSporkID, int64_t nValue);
@@ -8,10 +8,16 @@
 #include "wallet.h"
 
 //!KORE Stake
-bool CkoreStake::SetInput(CTransaction txPrev, unsigned int n)
+bool CkoreStake::SetInput(CTransaction txPrev, unsigned int n, CBlockIndex* pindexFromIn)
 {
     this->txFrom = txPrev;
     this->nPosition = n;
+    this->pindexFrom = pindexFromIn;
+    pindexModifierTip = nullptr;
+
+    //The unique identifier for a KORE stake is the outpoint
+    ssUniqueness.clear();
+    ssUniqueness << nPosition << txFrom.GetHash();
     return true;
 }
 
@@ -68,6 +74,12 @@ bool CkoreStake::CreateTxOuts(CWallet* pwallet, vector<CTxOut>& vout, bool split
 
 bool CkoreStake::GetModifier(uint64_t& nStakeModifier)
 {
+    // The modifier only moves with the chain, so reuse it until the tip changes
+    if (pindexModifierTip && pindexModifierTip == chainActive.Tip()) {
+        nStakeModifier = nCachedModifier;
+        return true;
+    }
+
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
     GetIndexFrom();
@@ -77,20 +89,23 @@ bool CkoreStake::GetModifier(uint64_t& nStakeModifier)
     if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false))
         return error("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
 
+    nCachedModifier = nStakeModifier;
+    pindexModifierTip = chainActive.Tip();
     return true;
 }
 
-CDataStream CkoreStake::GetUniqueness()
+const CDataStream& CkoreStake::GetUniqueness()
 {
-    //The unique identifier for a KORE stake is the outpoint
-    CDataStream ss(SER_NETWORK, 0);
-    ss << nPosition << txFrom.GetHash();
-    return ss;
+    return ssUniqueness;
 }
 
 //The block that the UTXO was added to the chain
 CBlockIndex* CkoreStake::GetIndexFrom()
 {
+    // Known already (SetInput or an earlier lookup) and not reorganized away
+    if (pindexFrom && chainActive.Contains(pindexFrom))
+        return pindexFrom;
+
     uint256 hashBlock = 0;
     CTransaction tx;
     if (GetTransaction(txFrom.GetHash(), tx, hashBlock, true)) {
@@ -23,7 +23,7 @@ public:
     virtual bool CreateTxOuts(CWallet* pwallet, vector<CTxOut>& vout, bool splitStake) = 0;
     virtual bool GetModifier(uint64_t& nStakeModifier) = 0;
     virtual bool IsZKORE() = 0;
-    virtual CDataStream GetUniqueness() = 0;
+    virtual const CDataStream& GetUniqueness() = 0;
 };
 
 
@@ -32,19 +32,25 @@ class CkoreStake : public CStakeInput
 private:
     CTransaction txFrom;
     unsigned int nPosition;
+    //! Serialized outpoint, built once by SetInput
+    CDataStream ssUniqueness;
+    //! Stake modifier and the tip it was computed at
+    uint64_t nCachedModifier;
+    const CBlockIndex* pindexModifierTip;
 public:
-    CkoreStake()
+    CkoreStake() : ssUniqueness(SER_NETWORK, 0), nCachedModifier(0), pindexModifierTip(nullptr)
     {
         this->pindexFrom = nullptr;
     }
 
-    bool SetInput(CTransaction txPrev, unsigned int n);
+    //! pindexFromIn may be passed when the containing block is already known, saving the transaction lookup
+    bool SetInput(CTransaction txPrev, unsigned int n, CBlockIndex* pindexFromIn = nullptr);
 
     CBlockIndex* GetIndexFrom() override;
     bool GetTxFrom(CTransaction& tx) override;
     CAmount GetValue() override;
     bool GetModifier(uint64_t& nStakeModifier) override;
-    CDataStream GetUniqueness() override;
+    const CDataStream& GetUniqueness() override;
     bool CreateTxIn(CWallet* pwallet, CTxIn& txIn, uint256 hashTxOut = 0) override;
     bool CreateTxOuts(CWallet* pwallet, vector<CTxOut>& vout, bool splitStake) override;
     bool IsZKORE() override { return false; }
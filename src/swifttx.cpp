@@ -11,12 +11,16 @@
 #include "masternodeman.h"
 #include "net.h"
 #include "obfuscation.h"
+#include "perfstats.h"
 #include "protocol.h"
 #include "spork.h"
 #include "sync.h"
 #include "util.h"
 #include "validationinterface.h"
 
+#include <limits>
+#include <set>
+
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
@@ -30,6 +34,39 @@ std::map<COutPoint, uint256> mapLockedInputs;
 std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
 int nCompleteTXLocks;
 
+// mapTxLocks ordered by expiration, so cleaning up doesn't walk every lock
+std::set<std::pair<int64_t, uint256> > setTxLockExpirations;
+
+// The masternode ranks of a lock height. Every vote needs the rank of its masternode, ranking the
+// whole list once per height instead of once per vote. Ranked again when the list changes
+// (nRankingVersion), a masternode becomes old enough to rank (nValidUntil), spork 8 turns the
+// minimum masternode age on or off (fAgeEnforced) or the entry gets old.
+struct CSwiftTXQuorum {
+    int64_t nTime;
+    int64_t nValidUntil;
+    unsigned int nRankingVersion;
+    bool fAgeEnforced;
+    std::map<COutPoint, int> mapRanks;
+};
+std::map<int, CSwiftTXQuorum> mapSwiftTXQuorums;
+CCriticalSection cs_mapSwiftTXQuorums;
+
+static void SetTxLockExpiration(CTransactionLock& lock, int nExpiration)
+{
+    setTxLockExpirations.erase(std::make_pair((int64_t)lock.nExpiration, lock.txHash));
+    lock.nExpiration = nExpiration;
+    setTxLockExpirations.insert(std::make_pair((int64_t)lock.nExpiration, lock.txHash));
+}
+
+// account the time a lock took to collect its votes, once per lock
+static void RecordLockCompletion(CTransactionLock& lock)
+{
+    if (lock.nTimeCompleted != 0 || lock.CountSignatures() < SWIFTTX_SIGNATURES_REQUIRED) return;
+
+    lock.nTimeCompleted = GetTimeMicros();
+    RecordPerfSample(PERF_SWIFTTX_LOCK, lock.nTimeCompleted - lock.nTimeCreated);
+}
+
 //txlock - Locks transaction
 //
 //step 1.) Broadcast intention to lock transaction inputs, "txlreg", CTransaction
@@ -247,12 +284,15 @@ int64_t CreateNewLock(CTransaction tx)
 
         CTransactionLock newLock;
         newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
         newLock.nTimeout = GetTime() + (60 * 5);
         newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
+        CTransactionLock& lock = mapTxLocks.insert(make_pair(tx.GetHash(), newLock)).first->second;
+        SetTxLockExpiration(lock, GetTime() + (60 * 60)); //locks expire after 60 minutes (24 confirmations)
     } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
+        CTransactionLock& lock = mapTxLocks[tx.GetHash()];
+        lock.nBlockHeight = nBlockHeight;
+        // votes that arrived ahead of the request only count now that the height is known
+        RecordLockCompletion(lock);
         LogPrint("swiftx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
     }
 
@@ -265,7 +305,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 {
     if (!fMasterNode) return;
 
-    int n = mnodeman.GetMasternodeRank(activeMasternode.vin, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = GetSwiftTXRank(activeMasternode.vin, nBlockHeight);
 
     if (n == -1) {
         LogPrint("swiftx", "SwiftX::DoConsensusVote - Unknown Masternode\n");
@@ -304,7 +344,9 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 //received a consensus vote
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 {
-    int n = mnodeman.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    CPerfTimer perfTimer(PERF_SWIFTTX_VOTE);
+
+    int n = GetSwiftTXRank(ctx.vinMasternode, ctx.nBlockHeight);
 
     CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
     if (pmn != NULL)
@@ -334,10 +376,10 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 
         CTransactionLock newLock;
         newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
         newLock.nTimeout = GetTime() + (60 * 5);
         newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
+        CTransactionLock& lock = mapTxLocks.insert(make_pair(ctx.txHash, newLock)).first->second;
+        SetTxLockExpiration(lock, GetTime() + (60 * 60));
     } else
         LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
 
@@ -345,6 +387,7 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
     std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
     if (i != mapTxLocks.end()) {
         (*i).second.AddSignature(ctx);
+        RecordLockCompletion((*i).second);
 
 #ifdef ENABLE_WALLET
         if (pwalletMain) {
@@ -402,14 +445,16 @@ bool CheckForConflictingLocks(CTransaction& tx)
         Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
+    uint256 txHash = tx.GetHash();
     BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                LogPrintf("SwiftX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if (mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if (mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
-                return true;
-            }
+        std::map<COutPoint, uint256>::iterator itInput = mapLockedInputs.find(in.prevout);
+        if (itInput != mapLockedInputs.end() && itInput->second != txHash) {
+            LogPrintf("SwiftX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", txHash.ToString().c_str(), itInput->second.ToString().c_str());
+            std::map<uint256, CTransactionLock>::iterator itLock = mapTxLocks.find(txHash);
+            if (itLock != mapTxLocks.end()) SetTxLockExpiration(itLock->second, GetTime());
+            itLock = mapTxLocks.find(itInput->second);
+            if (itLock != mapTxLocks.end()) SetTxLockExpiration(itLock->second, GetTime());
+            return true;
         }
     }
 
@@ -435,30 +480,79 @@ void CleanTransactionLocksList()
 {
     if (chainActive.Tip() == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
+    int64_t nNow = GetTime();
+    while (!setTxLockExpirations.empty() && setTxLockExpirations.begin()->first < nNow) { //keep them for an hour
+        std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.find(setTxLockExpirations.begin()->second);
+        setTxLockExpirations.erase(setTxLockExpirations.begin());
+        if (it == mapTxLocks.end()) continue;
 
-    while (it != mapTxLocks.end()) {
-        if (GetTime() > it->second.nExpiration) { //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+        LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
+        if (mapTxLockReq.count(it->second.txHash)) {
+            CTransaction& tx = mapTxLockReq[it->second.txHash];
 
-                BOOST_FOREACH (const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
+            BOOST_FOREACH (const CTxIn& in, tx.vin)
+                mapLockedInputs.erase(in.prevout);
 
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
+            mapTxLockReq.erase(it->second.txHash);
+            mapTxLockReqRejected.erase(it->second.txHash);
 
-                BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
-
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
+            BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
+                mapTxLockVote.erase(v.GetHash());
         }
+
+        mapTxLocks.erase(it);
     }
+
+    LOCK(cs_mapSwiftTXQuorums);
+    std::map<int, CSwiftTXQuorum>::iterator itQuorum = mapSwiftTXQuorums.begin();
+    while (itQuorum != mapSwiftTXQuorums.end()) {
+        if (itQuorum->second.nTime < nNow - SWIFTTX_QUORUM_CACHE_SECONDS)
+            mapSwiftTXQuorums.erase(itQuorum++);
+        else
+            ++itQuorum;
+    }
+}
+
+void SwiftTXSporkChanged(int nSporkID, int64_t nValue)
+{
+    // the minimum masternode age of the ranking is only enforced under spork 8
+    if (nSporkID != SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT) return;
+
+    LOCK(cs_mapSwiftTXQuorums);
+    mapSwiftTXQuorums.clear();
+}
+
+int GetSwiftTXRank(const CTxIn& vin, int nBlockHeight)
+{
+    LOCK(cs_mapSwiftTXQuorums);
+
+    // spork 8 is a timestamp, it takes effect when the time passes it and not when its value changes
+    bool fAgeEnforced = IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    std::map<int, CSwiftTXQuorum>::iterator it = mapSwiftTXQuorums.find(nBlockHeight);
+    if (it == mapSwiftTXQuorums.end() || it->second.nTime < GetTime() - SWIFTTX_QUORUM_CACHE_SECONDS ||
+        it->second.nValidUntil <= GetAdjustedTime() || it->second.nRankingVersion != mnodeman.GetRankingVersion() ||
+        it->second.fAgeEnforced != fAgeEnforced) {
+        // read the version first, a change while ranking makes the next vote rank again
+        unsigned int nRankingVersion = mnodeman.GetRankingVersion();
+        int64_t nValidUntil = std::numeric_limits<int64_t>::max();
+        std::vector<CTxIn> vecRanked;
+        if (!mnodeman.GetMasternodeRanking(nBlockHeight, MIN_SWIFTTX_PROTO_VERSION, vecRanked, nValidUntil))
+            return -1;
+        CSwiftTXQuorum& quorum = mapSwiftTXQuorums[nBlockHeight];
+        quorum.nTime = GetTime();
+        quorum.nValidUntil = nValidUntil;
+        quorum.nRankingVersion = nRankingVersion;
+        quorum.fAgeEnforced = fAgeEnforced;
+        quorum.mapRanks.clear();
+        for (unsigned int i = 0; i < vecRanked.size(); i++)
+            quorum.mapRanks[vecRanked[i].prevout] = i + 1;
+        it = mapSwiftTXQuorums.find(nBlockHeight);
+    }
+
+    // as GetMasternodeRank: masternodes that are unknown, inactive or too old a protocol are unranked
+    std::map<COutPoint, int>::const_iterator itRank = it->second.mapRanks.find(vin.prevout);
+    return itRank == it->second.mapRanks.end() ? -1 : itRank->second;
 }
 
 int GetTransactionLockSignatures(uint256 txHash)
@@ -478,10 +572,15 @@ uint256 CConsensusVote::GetHash() const
 }
 
 
+std::string CConsensusVote::GetStrMessage() const
+{
+    return txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+}
+
 bool CConsensusVote::SignatureValid()
 {
     std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
 
     CMasternode* pmn = mnodeman.Find(vinMasternode);
@@ -505,7 +604,7 @@ bool CConsensusVote::Sign()
 
     CKey key2;
     CPubKey pubkey2;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("signing strMessage %s \n", strMessage.c_str());
     //LogPrintf("signing privkey %s \n", strMasterNodePrivKey.c_str());
 
@@ -530,8 +629,8 @@ bool CConsensusVote::Sign()
 
 bool CTransactionLock::SignaturesValid()
 {
-    BOOST_FOREACH (CConsensusVote vote, vecConsensusVotes) {
-        int n = mnodeman.GetMasternodeRank(vote.vinMasternode, vote.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    BOOST_FOREACH (CConsensusVote& vote, vecConsensusVotes) {
+        int n = GetSwiftTXRank(vote.vinMasternode, vote.nBlockHeight);
 
         if (n == -1) {
             LogPrintf("CTransactionLock::SignaturesValid() - Unknown Masternode\n");
@@ -567,7 +666,7 @@ int CTransactionLock::CountSignatures()
     if (nBlockHeight == 0) return -1;
 
     int n = 0;
-    BOOST_FOREACH (CConsensusVote v, vecConsensusVotes) {
+    BOOST_FOREACH (const CConsensusVote& v, vecConsensusVotes) {
         if (v.nBlockHeight == nBlockHeight) {
             n++;
         }
@@ -26,6 +26,9 @@
 #define SWIFTTX_SIGNATURES_REQUIRED 6
 #define SWIFTTX_SIGNATURES_TOTAL 10
 
+// How long the ranked quorum of a lock height is reused before ranking the masternode list again
+#define SWIFTTX_QUORUM_CACHE_SECONDS 60
+
 using namespace std;
 using namespace boost;
 
@@ -64,6 +67,13 @@ void CleanTransactionLocksList();
 // get the accepted transaction lock signatures
 int GetTransactionLockSignatures(uint256 txHash);
 
+// rank of a masternode for a lock height as GetMasternodeRank gives it, -1 if it is unknown, inactive
+// or on an obsolete protocol, above SWIFTTX_SIGNATURES_TOTAL if it is not in the quorum
+int GetSwiftTXRank(const CTxIn& vin, int nBlockHeight);
+
+// drop the cached quorums when a spork they were ranked under changes
+void SwiftTXSporkChanged(int nSporkID, int64_t nValue);
+
 int64_t GetAverageVoteTime();
 
 class CConsensusVote
@@ -76,6 +86,7 @@ public:
 
     uint256 GetHash() const;
 
+    std::string GetStrMessage() const;
     bool SignatureValid();
     bool Sign();
 
@@ -99,6 +110,10 @@ public:
     std::vector<CConsensusVote> vecConsensusVotes;
     int nExpiration;
     int nTimeout;
+    int64_t nTimeCreated;   // microseconds, when we first heard of the lock
+    int64_t nTimeCompleted; // microseconds, when it first had SWIFTTX_SIGNATURES_REQUIRED votes, 0 before
+
+    CTransactionLock() : nBlockHeight(0), nExpiration(0), nTimeout(0), nTimeCreated(GetTimeMicros()), nTimeCompleted(0) {}
 
     bool SignaturesValid();
     int CountSignatures();
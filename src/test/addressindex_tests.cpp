@@ -0,0 +1,74 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "clientversion.h"
+#include "spentindex.h"
+#include "streams.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+static std::string SerializeKey(const CAddressIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << std::make_pair('a', key);
+    return ss.str();
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_key_order)
+{
+    uint160 hashBytes(std::string("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 txhash(std::string("0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9"));
+
+    // Keys of one address sort by height, then by position in the block
+    std::string str1 = SerializeKey(CAddressIndexKey(ADDRESS_TYPE_PUBKEYHASH, hashBytes, 255, 7, txhash, 0, false));
+    std::string str2 = SerializeKey(CAddressIndexKey(ADDRESS_TYPE_PUBKEYHASH, hashBytes, 256, 1, txhash, 0, false));
+    std::string str3 = SerializeKey(CAddressIndexKey(ADDRESS_TYPE_PUBKEYHASH, hashBytes, 256, 2, txhash, 0, false));
+    BOOST_CHECK(str1 < str2);
+    BOOST_CHECK(str2 < str3);
+
+    // The iterator keys are prefixes of the entries they seek to
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << std::make_pair('a', CAddressIndexIteratorKey(ADDRESS_TYPE_PUBKEYHASH, hashBytes));
+    BOOST_CHECK_EQUAL(ssPrefix.size(), 22U);
+    BOOST_CHECK(str1.compare(0, ssPrefix.size(), ssPrefix.str()) == 0);
+    CDataStream ssHeight(SER_DISK, CLIENT_VERSION);
+    ssHeight << std::make_pair('a', CAddressIndexIteratorKey(ADDRESS_TYPE_PUBKEYHASH, hashBytes, 256));
+    BOOST_CHECK(str1 < ssHeight.str());
+    BOOST_CHECK(str2.compare(0, ssHeight.size(), ssHeight.str()) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_roundtrip)
+{
+    uint160 hashBytes(std::string("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 txhash(std::string("0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9"));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CAddressIndexKey(ADDRESS_TYPE_SCRIPTHASH, hashBytes, 123456, 3, txhash, 9, true);
+    BOOST_CHECK_EQUAL(ss.size(), 66U);
+    CAddressIndexKey key;
+    ss >> key;
+    BOOST_CHECK_EQUAL(key.type, (unsigned int)ADDRESS_TYPE_SCRIPTHASH);
+    BOOST_CHECK(key.hashBytes == hashBytes);
+    BOOST_CHECK_EQUAL(key.blockHeight, 123456);
+    BOOST_CHECK_EQUAL(key.txindex, 3U);
+    BOOST_CHECK(key.txhash == txhash);
+    BOOST_CHECK_EQUAL(key.index, 9U);
+    BOOST_CHECK(key.spending);
+
+    ss << CAddressUnspentKey(ADDRESS_TYPE_PUBKEYHASH, hashBytes, txhash, 2);
+    CAddressUnspentKey unspentKey;
+    ss >> unspentKey;
+    BOOST_CHECK_EQUAL(unspentKey.type, (unsigned int)ADDRESS_TYPE_PUBKEYHASH);
+    BOOST_CHECK(unspentKey.txhash == txhash);
+    BOOST_CHECK_EQUAL(unspentKey.index, 2U);
+
+    BOOST_CHECK(CAddressUnspentValue().IsNull());
+    BOOST_CHECK(CSpentIndexValue().IsNull());
+    BOOST_CHECK(!CSpentIndexValue(txhash, 0, 1, 100, ADDRESS_TYPE_PUBKEYHASH, hashBytes).IsNull());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "main.h"
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+static CScript RandomScript()
+{
+    std::vector<unsigned char> vch(20);
+    GetRandBytes(&vch[0], vch.size());
+    return CScript() << OP_DUP << OP_HASH160 << vch << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_match)
+{
+    CBlock block;
+    CBlockUndo blockundo;
+    std::set<CScript> setIncluded;
+    for (int i = 0; i < 100; i++) {
+        CMutableTransaction tx;
+        tx.vout.resize(2);
+        tx.vout[0].scriptPubKey = RandomScript();
+        tx.vout[1].scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(4, i);
+        setIncluded.insert(tx.vout[0].scriptPubKey);
+        block.vtx.push_back(tx);
+
+        // Scripts of the spent outputs come from the undo data
+        CTxUndo txundo;
+        txundo.vprevout.push_back(CTxInUndo(CTxOut(1, RandomScript())));
+        setIncluded.insert(txundo.vprevout.back().txout.scriptPubKey);
+        blockundo.vtxundo.push_back(txundo);
+    }
+
+    CBlockFilter filter(block, blockundo);
+    BOOST_CHECK_EQUAL(filter.GetElementCount(), 200U);
+    BOOST_CHECK(filter.GetBlockHash() == block.GetHash());
+    BOOST_FOREACH (const CScript& script, setIncluded)
+        BOOST_CHECK(filter.Match(script));
+    BOOST_CHECK(!filter.Match(block.vtx[0].vout[1].scriptPubKey));
+    BOOST_CHECK(filter.HasOnlyExactScripts());
+
+    // A script not in the filter matches with probability 1/M, about one in 785000, so these
+    // 1000 scripts should practically never match; MatchAny has to agree with Match
+    std::set<CScript> setExcluded;
+    int nFalsePositives = 0;
+    for (int i = 0; i < 1000; i++) {
+        CScript script = RandomScript();
+        setExcluded.insert(script);
+        if (filter.Match(script))
+            nFalsePositives++;
+    }
+    BOOST_CHECK(nFalsePositives <= 5);
+    BOOST_CHECK_EQUAL(filter.MatchAny(setExcluded), nFalsePositives > 0);
+    setExcluded.insert(*setIncluded.begin());
+    BOOST_CHECK(filter.MatchAny(setExcluded));
+
+    // Round trip through serialization
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << filter;
+    CBlockFilter filter2;
+    ss >> filter2;
+    BOOST_CHECK(filter2.GetHash() == filter.GetHash());
+    BOOST_CHECK(filter2.MatchAny(setExcluded));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_exact_scripts)
+{
+    std::vector<unsigned char> vchPubKey(33, 2);
+    BOOST_CHECK(IsExactMatchScript(RandomScript()));
+    BOOST_CHECK(IsExactMatchScript(CScript() << vchPubKey << OP_CHECKSIG));
+    BOOST_CHECK(IsExactMatchScript(CScript() << OP_RETURN << std::vector<unsigned char>(4, 0)));
+
+    // A bare multisig output may be ours without being one of the wallet's scripts
+    CScript scriptMultisig = CScript() << OP_1 << vchPubKey << vchPubKey << OP_2 << OP_CHECKMULTISIG;
+    BOOST_CHECK(!IsExactMatchScript(scriptMultisig));
+
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = RandomScript();
+    block.vtx.push_back(tx);
+    CBlockUndo blockundo;
+    CTxUndo txundo;
+    txundo.vprevout.push_back(CTxInUndo(CTxOut(1, scriptMultisig)));
+    blockundo.vtxundo.push_back(txundo);
+    BOOST_CHECK(!CBlockFilter(block, blockundo).HasOnlyExactScripts());
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_empty)
+{
+    CBlockFilter filter;
+    BOOST_CHECK_EQUAL(filter.GetElementCount(), 0U);
+    BOOST_CHECK(!filter.Match(RandomScript()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
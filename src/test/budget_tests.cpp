@@ -30,4 +30,39 @@ BOOST_AUTO_TEST_CASE(budget_value)
     */
 }
 
+BOOST_AUTO_TEST_CASE(budget_vote_tally)
+{
+    CBudgetProposal proposal("test", "http://test", 0, 0, CScript(), 10 * COIN, 0);
+    std::string strError;
+    int64_t nTime = GetTime();
+
+    for (int i = 0; i < 30; i++) {
+        CBudgetVote vote(CTxIn(COutPoint(uint256(i + 1), 0)), proposal.GetHash(), i % 3 == 0 ? VOTE_YES : (i % 3 == 1 ? VOTE_NO : VOTE_ABSTAIN));
+        vote.nTime = nTime;
+        BOOST_CHECK(proposal.AddOrUpdateVote(vote, strError));
+    }
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 10);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 10);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), 10);
+
+    // A masternode changing its mind moves its vote over, an invalid vote is not counted
+    CBudgetVote vote(CTxIn(COutPoint(uint256(2), 0)), proposal.GetHash(), VOTE_YES);
+    vote.nTime = nTime + Params().BudgetVoteUpdate();
+    BOOST_CHECK(proposal.AddOrUpdateVote(vote, strError));
+    CBudgetVote voteInvalid(CTxIn(COutPoint(uint256(100), 0)), proposal.GetHash(), VOTE_YES);
+    voteInvalid.nTime = nTime;
+    voteInvalid.fValid = false;
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteInvalid, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 11);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 9);
+
+    // Copies keep the tallies, a recount from the votes agrees with them
+    CBudgetProposal proposalCopy(proposal);
+    BOOST_CHECK_EQUAL(proposalCopy.GetYeas(), 11);
+    proposalCopy.RecountVotes();
+    BOOST_CHECK_EQUAL(proposalCopy.GetYeas(), 11);
+    BOOST_CHECK_EQUAL(proposalCopy.GetNays(), 9);
+    BOOST_CHECK_EQUAL(proposalCopy.GetAbstains(), 10);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
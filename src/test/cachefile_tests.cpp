@@ -0,0 +1,160 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cachefile.h"
+#include "chainparams.h"
+#include "util.h"
+
+#include <map>
+#include <stdio.h>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(cachefile_tests)
+
+static const unsigned char RECORD_NUMBER = 1;
+static const unsigned char RECORD_ENTRY = 2;
+
+static void WriteTestCache(const boost::filesystem::path& path, const std::map<int, std::string>& mapEntries)
+{
+    CCacheFileWriter fileout(path, "TestCache");
+    fileout.Write(RECORD_NUMBER, (int64_t)42);
+    WriteCacheMap(fileout, RECORD_ENTRY, mapEntries);
+    BOOST_CHECK_EQUAL(fileout.GetRecordCount(), mapEntries.size() + 1);
+    BOOST_CHECK(fileout.Commit());
+}
+
+static void ReadTestCache(CCacheFileReader& filein, int64_t& nNumber, std::map<int, std::string>& mapEntries)
+{
+    unsigned char nType;
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    while (filein.Next(nType, ssRecord)) {
+        if (nType == RECORD_NUMBER)
+            ssRecord >> nNumber;
+        else if (nType == RECORD_ENTRY)
+            LoadCacheMapRecord(ssRecord, mapEntries);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cachefile_roundtrip)
+{
+    boost::filesystem::path path = GetDataDir() / "cachefile_roundtrip.dat";
+    std::map<int, std::string> mapEntries;
+    for (int i = 0; i < 100; i++)
+        mapEntries[i] = strprintf("entry %d", i);
+    WriteTestCache(path, mapEntries);
+    BOOST_CHECK(!boost::filesystem::exists(path.string() + ".new"));
+
+    CCacheFileReader filein(path);
+    BOOST_CHECK_EQUAL(filein.ReadHeader("TestCache"), CACHEFILE_OK);
+    int64_t nNumber = 0;
+    std::map<int, std::string> mapRead;
+    ReadTestCache(filein, nNumber, mapRead);
+    BOOST_CHECK_EQUAL(nNumber, 42);
+    BOOST_CHECK(mapRead == mapEntries);
+    BOOST_CHECK_EQUAL(filein.GetRecordCount(), 101U);
+    BOOST_CHECK_EQUAL(filein.GetCorruptCount(), 0U);
+
+    CCacheFileReader fileOther(path);
+    BOOST_CHECK_EQUAL(fileOther.ReadHeader("OtherCache"), CACHEFILE_BAD_MAGIC);
+}
+
+BOOST_AUTO_TEST_CASE(cachefile_damaged)
+{
+    boost::filesystem::path path = GetDataDir() / "cachefile_damaged.dat";
+    std::map<int, std::string> mapEntries;
+    for (int i = 0; i < 10; i++)
+        mapEntries[i] = strprintf("entry %d", i);
+    WriteTestCache(path, mapEntries);
+
+    // Flip a byte in the payload of the last record: only that record is lost
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    fseek(file, -6, SEEK_END);
+    int c = fgetc(file);
+    fseek(file, -6, SEEK_END);
+    fputc(c ^ 0xff, file);
+    fclose(file);
+
+    {
+        CCacheFileReader filein(path);
+        BOOST_CHECK_EQUAL(filein.ReadHeader("TestCache"), CACHEFILE_OK);
+        int64_t nNumber = 0;
+        std::map<int, std::string> mapRead;
+        ReadTestCache(filein, nNumber, mapRead);
+        BOOST_CHECK_EQUAL(nNumber, 42);
+        BOOST_CHECK_EQUAL(mapRead.size(), 9U);
+        BOOST_CHECK_EQUAL(filein.GetCorruptCount(), 1U);
+    }
+
+    // A dump cut short keeps everything before the truncated record
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 3);
+    {
+        CCacheFileReader filein(path);
+        BOOST_CHECK_EQUAL(filein.ReadHeader("TestCache"), CACHEFILE_OK);
+        int64_t nNumber = 0;
+        std::map<int, std::string> mapRead;
+        ReadTestCache(filein, nNumber, mapRead);
+        BOOST_CHECK_EQUAL(mapRead.size(), 9U);
+        BOOST_CHECK_EQUAL(filein.GetCorruptCount(), 0U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cachefile_record_type)
+{
+    boost::filesystem::path path = GetDataDir() / "cachefile_record_type.dat";
+    {
+        CCacheFileWriter fileout(path, "TestCache");
+        fileout.Write(RECORD_NUMBER, (int64_t)42);
+        // An entry followed by a byte that no reader consumes
+        CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+        ssRecord << std::make_pair(1, std::string("entry 1")) << (unsigned char)0;
+        fileout.WriteRecord(RECORD_ENTRY, ssRecord);
+        BOOST_CHECK(fileout.Commit());
+    }
+
+    // The type of the first record follows the 22 byte header; the checksum covers it
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    fseek(file, 22, SEEK_SET);
+    BOOST_CHECK_EQUAL(fgetc(file), RECORD_NUMBER);
+    fseek(file, 22, SEEK_SET);
+    fputc(RECORD_ENTRY, file);
+    fclose(file);
+
+    CCacheFileReader filein(path);
+    BOOST_CHECK_EQUAL(filein.ReadHeader("TestCache"), CACHEFILE_OK);
+    unsigned char nType;
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(filein.Next(nType, ssRecord));
+    BOOST_CHECK_EQUAL(nType, RECORD_ENTRY);
+    BOOST_CHECK_EQUAL(filein.GetCorruptCount(), 1U);
+
+    // Left over data rejects the record before anything is loaded from it
+    std::map<int, std::string> mapEntries;
+    BOOST_CHECK_THROW(LoadCacheMapRecord(ssRecord, mapEntries), std::ios_base::failure);
+    BOOST_CHECK(mapEntries.empty());
+    BOOST_CHECK(!filein.Next(nType, ssRecord));
+}
+
+BOOST_AUTO_TEST_CASE(cachefile_legacy)
+{
+    // The whole-file caches started with their magic message, they are reported as outdated
+    boost::filesystem::path path = GetDataDir() / "cachefile_legacy.dat";
+    {
+        CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        fileout << std::string("TestCache");
+        fileout << FLATDATA(Params().MessageStart());
+    }
+    CCacheFileReader filein(path);
+    BOOST_CHECK_EQUAL(filein.ReadHeader("TestCache"), CACHEFILE_OUTDATED);
+
+    CCacheFileReader fileMissing(GetDataDir() / "cachefile_missing.dat");
+    BOOST_CHECK(fileMissing.IsNull());
+    BOOST_CHECK_EQUAL(fileMissing.ReadHeader("TestCache"), CACHEFILE_IO_ERROR);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include <atomic>
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+static std::atomic<unsigned int> nChecksRun;
+
+/** Check that counts its invocations and fails if constructed with fOk == false */
+struct CCountingCheck {
+    bool fOk;
+
+    CCountingCheck() : fOk(true) {}
+    CCountingCheck(bool fOkIn) : fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        nChecksRun++;
+        return fOk;
+    }
+
+    void swap(CCountingCheck& check) { std::swap(fOk, check.fOk); }
+};
+
+static void RunQueue(CCheckQueue<CCountingCheck>* pqueue)
+{
+    pqueue->Thread();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_checks_run)
+{
+    CCheckQueue<CCountingCheck> queue(16);
+    boost::thread_group threads;
+    for (int i = 0; i < 3; i++)
+        threads.create_thread(boost::bind(&RunQueue, &queue));
+
+    for (unsigned int nRound = 1; nRound <= 200; nRound += 37) {
+        nChecksRun = 0;
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        // Several Add() calls of varying size, as ConnectBlock does per transaction
+        for (unsigned int nAdded = 0; nAdded < nRound * 10; nAdded += nRound) {
+            std::vector<CCountingCheck> vChecks(nRound, CCountingCheck(true));
+            control.Add(vChecks);
+        }
+        BOOST_CHECK(control.Wait());
+        BOOST_CHECK_EQUAL(nChecksRun.load(), nRound * 10);
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    std::vector<CCheckQueueWorkerStats> vStats;
+    queue.GetStats(vStats);
+    // Worker threads register when they start running, the master slot always exists
+    BOOST_CHECK(vStats.size() >= 1 && vStats.size() <= 4);
+    uint64_t nTotal = 0;
+    BOOST_FOREACH (const CCheckQueueWorkerStats& stats, vStats)
+        nTotal += stats.nChecks;
+    BOOST_CHECK_EQUAL(nTotal, 10U * (1 + 38 + 75 + 112 + 149 + 186));
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure_propagates)
+{
+    CCheckQueue<CCountingCheck> queue(8);
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++)
+        threads.create_thread(boost::bind(&RunQueue, &queue));
+
+    {
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        std::vector<CCountingCheck> vChecks(500, CCountingCheck(true));
+        vChecks[250] = CCountingCheck(false);
+        control.Add(vChecks);
+        BOOST_CHECK(!control.Wait());
+    }
+    // The failure must not leak into the next round
+    {
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        std::vector<CCountingCheck> vChecks(100, CCountingCheck(true));
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_master_only)
+{
+    // Without worker threads the master does all the work itself
+    CCheckQueue<CCountingCheck> queue(4);
+    nChecksRun = 0;
+    CCheckQueueControl<CCountingCheck> control(&queue);
+    std::vector<CCountingCheck> vChecks(50, CCountingCheck(true));
+    control.Add(vChecks);
+    BOOST_CHECK(control.Wait());
+    BOOST_CHECK_EQUAL(nChecksRun.load(), 50U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "leveldbwrapper.h"
+#include "util.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(leveldbwrapper_tests)
+
+BOOST_AUTO_TEST_CASE(leveldbwrapper_dbopt_args)
+{
+    std::vector<std::string>& vArgs = mapMultiArgs["-dbopt"];
+    vArgs.clear();
+    vArgs.push_back("testdb:blockcache=8");
+    vArgs.push_back("testdb:writebuffer=2");
+    vArgs.push_back("testdb:maxopenfiles=4");
+    vArgs.push_back("testdb:bloombits=0");
+    vArgs.push_back("testdb:compression=1");
+    vArgs.push_back("testdb:unknown=1");
+    vArgs.push_back("testdb:malformed");
+    vArgs.push_back("otherdb:maxopenfiles=500");
+
+    CLevelDBOptions dboptions(4 << 20);
+    ApplyDBOptionArgs("testdb", dboptions);
+    BOOST_CHECK_EQUAL(dboptions.nBlockCache, 8U << 20);
+    BOOST_CHECK_EQUAL(dboptions.nWriteBuffer, 2U << 20);
+    BOOST_CHECK_EQUAL(dboptions.nMaxOpenFiles, DB_MIN_OPEN_FILES); // raised to what LevelDB enforces
+    BOOST_CHECK_EQUAL(dboptions.nBloomBits, 0);
+    BOOST_CHECK(dboptions.fCompression);
+
+    // Options of other databases are not applied
+    CLevelDBOptions dbdefaults(4 << 20);
+    ApplyDBOptionArgs("test", dbdefaults);
+    BOOST_CHECK_EQUAL(dbdefaults.nBlockCache, 2U << 20);
+    BOOST_CHECK_EQUAL(dbdefaults.nWriteBuffer, 1U << 20);
+    BOOST_CHECK_EQUAL(dbdefaults.nMaxOpenFiles, DB_MIN_OPEN_FILES);
+    BOOST_CHECK_EQUAL(dbdefaults.nBloomBits, 10);
+    BOOST_CHECK(!dbdefaults.fCompression);
+
+    CLevelDBOptions dbother(4 << 20);
+    ApplyDBOptionArgs("otherdb", dbother);
+    BOOST_CHECK_EQUAL(dbother.nMaxOpenFiles, 500);
+
+    vArgs.push_back("otherdb:maxopenfiles=1000000");
+    ApplyDBOptionArgs("otherdb", dbother);
+    BOOST_CHECK_EQUAL(dbother.nMaxOpenFiles, DB_MAX_OPEN_FILES);
+
+    // Negative values are ignored
+    vArgs.push_back("testdb:blockcache=-1");
+    dboptions = CLevelDBOptions(4 << 20);
+    ApplyDBOptionArgs("testdb", dboptions);
+    BOOST_CHECK_EQUAL(dboptions.nBlockCache, 8U << 20);
+
+    mapMultiArgs.erase("-dbopt");
+}
+
+static void OpenAnotherLevelDB(CLevelDBWrapper& db, int& nOpened)
+{
+    // The registry lock is not held while visiting, so opening a database here must not deadlock
+    CLevelDBWrapper dbinner("leveldbwrapper_tests_inner", 1 << 20, true);
+    BOOST_CHECK(dbinner.Write('k', 1));
+    db.CompactFull();
+    nOpened++;
+}
+
+BOOST_AUTO_TEST_CASE(leveldbwrapper_foreach)
+{
+    CLevelDBWrapper db("leveldbwrapper_tests", 1 << 20, true);
+    BOOST_CHECK(db.Write('k', 1));
+
+    int nOpened = 0;
+    BOOST_CHECK_EQUAL(ForEachLevelDB("leveldbwrapper_tests", boost::bind(&OpenAnotherLevelDB, _1, boost::ref(nOpened))), 1);
+    BOOST_CHECK_EQUAL(nOpened, 1);
+    BOOST_CHECK_EQUAL(ForEachLevelDB("leveldbwrapper_tests_missing", boost::bind(&OpenAnotherLevelDB, _1, boost::ref(nOpened))), 0);
+    BOOST_CHECK_EQUAL(nOpened, 1);
+
+    int nValue = 0;
+    BOOST_CHECK(db.Read('k', nValue));
+    BOOST_CHECK_EQUAL(nValue, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The KORE developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-payments.h"
+#include "script/standard.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(mnpayments_tests)
+
+// The walk back from the tip GetLastPaid() used to do for every masternode
+static int WalkLastPaidHeight(CMasternodePayments& payments, const CScript& payee, int nTipHeight, int nMaxBlocks)
+{
+    for (int nHeight = nTipHeight; nHeight > 0 && nHeight > nTipHeight - nMaxBlocks; nHeight--) {
+        if (payments.mapMasternodeBlocks.count(nHeight) && payments.mapMasternodeBlocks[nHeight].HasPayeeWithVotes(payee, MNPAYMENTS_PAID_VOTES))
+            return nHeight;
+    }
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE(mnpayments_last_paid_index)
+{
+    const int nMasternodes = 5000;
+    const int nTipHeight = 20000;
+    const int nMaxBlocks = nMasternodes * 1.25;
+
+    std::vector<CScript> vPayees;
+    for (int i = 0; i < nMasternodes; i++)
+        vPayees.push_back(GetScriptForDestination(CKeyID(uint160(i + 1))));
+
+    // every block votes for the next masternode in line, every seventh one doesn't get enough votes
+    CMasternodePayments payments;
+    for (int nHeight = 1; nHeight <= nTipHeight + 10; nHeight++) {
+        const CScript& payee = vPayees[(nHeight * 7919) % nMasternodes];
+        payments.AddPayeeVote(nHeight, payee);
+        if (nHeight % 7)
+            payments.AddPayeeVote(nHeight, payee);
+    }
+
+    int64_t nStart = GetTimeMicros();
+    std::vector<int> vIndexed;
+    for (int i = 0; i < nMasternodes; i++)
+        vIndexed.push_back(payments.GetLastPaidHeight(vPayees[i], nTipHeight, nMaxBlocks));
+    int64_t nIndexMicros = GetTimeMicros() - nStart;
+
+    // the walk is far too slow to run for all of them
+    const int nWalked = 200;
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nWalked; i++)
+        BOOST_CHECK_EQUAL(vIndexed[i], WalkLastPaidHeight(payments, vPayees[i], nTipHeight, nMaxBlocks));
+    int64_t nWalkMicros = GetTimeMicros() - nStart;
+
+    BOOST_TEST_MESSAGE(strprintf("last paid lookup for %d masternodes: index %.3f us, walk %.3f us per masternode",
+        nMasternodes, (double)nIndexMicros / nMasternodes, (double)nWalkMicros / nWalked));
+
+    // blocks past the tip, outside the window or below the vote threshold don't count
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(vPayees[(nTipHeight * 7919) % nMasternodes], nTipHeight - 1, nMaxBlocks), nTipHeight - nMasternodes);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(vPayees[(7 * 7919) % nMasternodes], 7 + 99, 100), 0);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(vPayees[(8 * 7919) % nMasternodes], 8 + 99, 100), 8);
+    BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(vPayees[(8 * 7919) % nMasternodes], 8 + 100, 100), 0);
+
+    // rebuilding from mapMasternodeBlocks, as after loading mnpayments.dat, gives the same answers
+    payments.RebuildPaidIndex();
+    for (int i = 0; i < nMasternodes; i += 97)
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(vPayees[i], nTipHeight, nMaxBlocks), vIndexed[i]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
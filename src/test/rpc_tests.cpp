@@ -182,6 +182,24 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_convert_address_params)
+{
+    // The address index calls take a bare address or an object from the command line
+    vector<string> vArgs(1, "KTnEc3BKSV5YWN8U5SS2e7mTe8DTKV2hRd");
+    UniValue params = RPCConvertValues("getaddressbalance", vArgs);
+    BOOST_CHECK(params[0].isStr());
+    BOOST_CHECK_EQUAL(params[0].get_str(), vArgs[0]);
+
+    vArgs[0] = "{\"addresses\": [\"KTnEc3BKSV5YWN8U5SS2e7mTe8DTKV2hRd\"]}";
+    params = RPCConvertValues("getaddresstxids", vArgs);
+    BOOST_CHECK(params[0].isObject());
+    BOOST_CHECK(find_value(params[0].get_obj(), "addresses").isArray());
+
+    // Other converted params still have to be JSON
+    vArgs[0] = "KTnEc3BKSV5YWN8U5SS2e7mTe8DTKV2hRd";
+    BOOST_CHECK_THROW(RPCConvertValues("getspentinfo", vArgs), runtime_error);
+}
+
 BOOST_AUTO_TEST_CASE(rpc_ban)
 {
     BOOST_CHECK_NO_THROW(CallRPC(string("clearbanned")));
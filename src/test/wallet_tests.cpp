@@ -4,6 +4,11 @@
 
 #include "wallet.h"
 
+#include "key.h"
+#include "main.h"
+#include "random.h"
+#include "txmempool.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -305,4 +310,154 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_changeless_tests)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(wallet.cs_wallet);
+
+    empty_wallet();
+    add_coin( 9*CENT);
+    add_coin(11*CENT);
+    add_coin(30*CENT);
+
+    // 9+11 overshoots 20 cents minus 1000 by less than a dust change output, so it beats the 30 cent coin
+    BOOST_CHECK( wallet.SelectCoinsMinConf(20 * CENT - 1000, 1, 6, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 20 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // 9+11 would leave real change for 20 cents minus 10000, the next bigger coin is still preferred
+    BOOST_CHECK( wallet.SelectCoinsMinConf(20 * CENT - 10000, 1, 6, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 30 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    // an exact match deep in the list is found among many equal coins
+    empty_wallet();
+    for (int i = 0; i < 50; i++)
+        add_coin(7*CENT);
+    add_coin(3*CENT);
+    add_coin(1*COIN);
+    BOOST_CHECK( wallet.SelectCoinsMinConf(73 * CENT, 1, 6, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 73 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 11U);
+
+    empty_wallet();
+}
+
+BOOST_AUTO_TEST_CASE(coin_selection_benchmark)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(wallet.cs_wallet);
+
+    // time selection against the number of outputs in the wallet
+    for (int nCoins = 100; nCoins <= 10000; nCoins *= 10) {
+        empty_wallet();
+        for (int i = 0; i < nCoins; i++)
+            add_coin((1 + i % 97) * CENT + i);
+
+        int64_t nStart = GetTimeMicros();
+        for (int nRun = 0; nRun < 5; nRun++)
+            BOOST_CHECK(wallet.SelectCoinsMinConf(10 * COIN + 12345, 1, 6, vCoins, setCoinsRet, nValueRet));
+        BOOST_TEST_MESSAGE(strprintf("coin selection with %d outputs: %.2f ms", nCoins, (GetTimeMicros() - nStart) / 5000.0));
+    }
+
+    empty_wallet();
+}
+
+static CBlockIndex* AddTestBlockIndex(CBlockIndex* pprev, const uint256& hashMerkleRoot)
+{
+    CBlockIndex* pindex = new CBlockIndex();
+    pindex->pprev = pprev;
+    pindex->nHeight = pprev->nHeight + 1;
+    pindex->nTime = pprev->nTime + 60;
+    pindex->hashMerkleRoot = hashMerkleRoot;
+    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(GetRandHash(), pindex)).first;
+    pindex->phashBlock = &((*mi).first);
+    pindex->BuildSkip();
+    return pindex;
+}
+
+static set<pair<uint256, int> > coin_outpoints(const vector<COutput>& vOutputs)
+{
+    set<pair<uint256, int> > setOutpoints;
+    BOOST_FOREACH(const COutput& out, vOutputs)
+        setOutpoints.insert(make_pair(out.tx->GetHash(), out.i));
+    return setOutpoints;
+}
+
+static set<pair<uint256, int> > check_indexed_coins(const CWallet& walletIndexed, size_t nExpected)
+{
+    vector<COutput> vAvailable, vIndexed;
+    walletIndexed.AvailableCoins(vAvailable);
+    // a target above every output keeps all of them
+    walletIndexed.GetIndexedCoins(1000 * COIN, vIndexed);
+    BOOST_CHECK_EQUAL(vAvailable.size(), nExpected);
+    BOOST_CHECK(coin_outpoints(vIndexed) == coin_outpoints(vAvailable));
+    return coin_outpoints(vIndexed);
+}
+
+BOOST_AUTO_TEST_CASE(coin_index_tests)
+{
+    CWallet walletIndexed("wallet_coinindex.dat");
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+
+    LOCK2(cs_main, walletIndexed.cs_wallet);
+    BOOST_REQUIRE(walletIndexed.AddKeyPubKey(key, key.GetPubKey()));
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+
+    // five outputs to us, confirmed in the block after genesis
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    for (int i = 1; i <= 5; i++)
+        txFund.vout.push_back(CTxOut(i * COIN, scriptMine));
+    CWalletTx wtxFund(&walletIndexed, txFund);
+    CBlockIndex* pindexA1 = AddTestBlockIndex(pindexGenesis, wtxFund.GetHash());
+    wtxFund.hashBlock = pindexA1->GetBlockHash();
+    wtxFund.nIndex = 0;
+    chainActive.SetTip(pindexA1);
+    BOOST_CHECK(walletIndexed.AddToWallet(wtxFund));
+    check_indexed_coins(walletIndexed, 5);
+
+    // spend the 1 coin output to someone else with change back to us, in the mempool at the same tip
+    CMutableTransaction txSpend;
+    txSpend.vin.push_back(CTxIn(wtxFund.GetHash(), 0));
+    txSpend.vout.push_back(CTxOut(COIN / 2, GetScriptForDestination(keyOther.GetPubKey().GetID())));
+    txSpend.vout.push_back(CTxOut(COIN / 4, scriptMine));
+    CWalletTx wtxSpend(&walletIndexed, txSpend);
+    BOOST_CHECK(mempool.addUnchecked(wtxSpend.GetHash(), CTxMemPoolEntry(txSpend, COIN / 4, GetTime(), 0, 1)));
+    BOOST_CHECK(walletIndexed.AddToWallet(wtxSpend));
+    set<pair<uint256, int> > setIndexed = check_indexed_coins(walletIndexed, 5);
+    BOOST_CHECK(!setIndexed.count(make_pair(wtxFund.GetHash(), 0)));
+    BOOST_CHECK(setIndexed.count(make_pair(wtxSpend.GetHash(), 1)));
+
+    // reorg to a chain without the funding transaction: only the change depending on it is left
+    CBlockIndex* pindexB1 = AddTestBlockIndex(pindexGenesis, uint256());
+    CBlockIndex* pindexB2 = AddTestBlockIndex(pindexB1, uint256());
+    chainActive.SetTip(pindexB2);
+    setIndexed = check_indexed_coins(walletIndexed, 1);
+    BOOST_CHECK(setIndexed.count(make_pair(wtxSpend.GetHash(), 1)));
+
+    // and back, one block further
+    CBlockIndex* pindexA2 = AddTestBlockIndex(pindexA1, uint256());
+    CBlockIndex* pindexA3 = AddTestBlockIndex(pindexA2, uint256());
+    chainActive.SetTip(pindexA3);
+    check_indexed_coins(walletIndexed, 5);
+
+    mempool.clear();
+    chainActive.SetTip(pindexGenesis);
+    CBlockIndex* vTestIndexes[] = {pindexA1, pindexA2, pindexA3, pindexB1, pindexB2};
+    BOOST_FOREACH(CBlockIndex* pindex, vTestIndexes) {
+        mapBlockIndex.erase(pindex->GetBlockHash());
+        delete pindex;
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -11,7 +11,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70100;
+static const int PROTOCOL_VERSION = 70101;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -25,7 +25,7 @@ static const int MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT = MIN_PEER_PROTO_VERS
 static const int MIN_PEER_PROTO_VERSION_AFTER_ENFORCEMENT = MIN_PEER_PROTO_VERSION;
 
 //! masternodes older than this proto version use old strMessage format for mnannounce
-static const int MIN_PEER_MNANNOUNCE = PROTOCOL_VERSION;
+static const int MIN_PEER_MNANNOUNCE = 70100;
 
 //! nTime field added to CAddress, starting with this version;
 //! if possible, avoid requesting addresses nodes older than this
@@ -40,5 +40,8 @@ static const int MEMPOOL_GD_VERSION = 60002;
 //! "filter*" commands are disabled without NODE_BLOOM after and including this version
 static const int NO_BLOOM_VERSION = 70011;
 
+//! "mnsyncdigest" command, masternode asset sync by digest, starts with this version
+static const int MASTERNODE_SYNC_DIGEST_VERSION = 70101;
+
 
 #endif // BITCOIN_VERSION_H
@@ -8,6 +8,7 @@
 #include "wallet.h"
 
 #include "base58.h"
+#include "blockfilter.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
@@ -92,30 +93,92 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
 }
 
 CPubKey CWallet::GenerateNewKey()
+{
+    std::vector<CPubKey> vPubKeys;
+    GenerateNewKeys(1, vPubKeys);
+    return vPubKeys[0];
+}
+
+namespace
+{
+void MakeNewKeys(bool fCompressed, std::vector<CKey>& vKeys, std::vector<CPubKey>& vPubKeys, unsigned int nBegin, unsigned int nEnd)
+{
+    for (unsigned int i = nBegin; i < nEnd; i++) {
+        vKeys[i].MakeNewKey(fCompressed);
+        vPubKeys[i] = vKeys[i].GetPubKey();
+        assert(vKeys[i].VerifyPubKey(vPubKeys[i]));
+    }
+}
+
+/** A stake candidate that passed the per-attempt checks, and the outcome of its kernel search */
+struct CStakeKernelSearch {
+    CStakeCandidate* pcandidate;
+    unsigned int nTimeBlockFrom;
+    uint64_t nStakeModifier;
+    bool fFound;
+    unsigned int nTimeTx;
+    uint256 hashProofOfStake;
+    unsigned int nHashes;
+
+    CStakeKernelSearch(CStakeCandidate* pcandidateIn, unsigned int nTimeBlockFromIn, uint64_t nStakeModifierIn) : pcandidate(pcandidateIn), nTimeBlockFrom(nTimeBlockFromIn), nStakeModifier(nStakeModifierIn), fFound(false), nTimeTx(0), hashProofOfStake(0), nHashes(0) {}
+};
+
+//! Search every nStride'th candidate from nBegin on, stopping at the first kernel any thread has found
+void SearchStakeKernels(std::vector<CStakeKernelSearch>& vSearch, const uint256& bnTargetPerCoinDay, int nHeightStart, unsigned int nTimeTx, unsigned int nBegin, unsigned int nStride, std::atomic<size_t>& nFirstFound)
+{
+    for (size_t i = nBegin; i < vSearch.size() && i < nFirstFound.load(); i += nStride) {
+        if (ShutdownRequested())
+            return;
+
+        CStakeKernelSearch& search = vSearch[i];
+        search.nTimeTx = nTimeTx;
+        search.fFound = FindStakeKernel(search.pcandidate->input.GetUniqueness(), search.pcandidate->nValue, search.nStakeModifier,
+                                        bnTargetPerCoinDay, search.nTimeBlockFrom, nHeightStart, search.nTimeTx, search.hashProofOfStake, search.nHashes);
+        if (search.fFound) {
+            size_t nFound = nFirstFound.load();
+            while (i < nFound && !nFirstFound.compare_exchange_weak(nFound, i)) {
+            }
+            return;
+        }
+    }
+}
+}
+
+/**
+ * Generate nKeys new keys. The key generation and checks are spread over the
+ * cores for large batches; the keys are then added (and encrypted, if the
+ * wallet is) in order on the calling thread.
+ */
+void CWallet::GenerateNewKeys(unsigned int nKeys, std::vector<CPubKey>& vPubKeys)
 {
     AssertLockHeld(cs_wallet);                                 // mapKeyMetadata
     bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
 
     RandAddSeedPerfmon();
-    CKey secret;
-    secret.MakeNewKey(fCompressed);
+    std::vector<CKey> vKeys(nKeys);
+    vPubKeys.assign(nKeys, CPubKey());
+    unsigned int nThreads = std::max(1U, std::min(boost::thread::hardware_concurrency(), nKeys / KEYPOOL_KEYS_PER_THREAD));
+    unsigned int nChunk = (nKeys + nThreads - 1) / nThreads;
+    boost::thread_group threadGroup;
+    for (unsigned int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&MakeNewKeys, fCompressed, boost::ref(vKeys), boost::ref(vPubKeys), std::min(nKeys, i * nChunk), std::min(nKeys, (i + 1) * nChunk)));
+    MakeNewKeys(fCompressed, vKeys, vPubKeys, 0, std::min(nKeys, nChunk));
+    threadGroup.join_all();
 
     // Compressed public keys were introduced in version 0.6.0
     if (fCompressed)
         SetMinVersion(FEATURE_COMPRPUBKEY);
 
-    CPubKey pubkey = secret.GetPubKey();
-    assert(secret.VerifyPubKey(pubkey));
+    for (unsigned int i = 0; i < nKeys; i++) {
+        // Create new metadata
+        int64_t nCreationTime = GetTime();
+        mapKeyMetadata[vPubKeys[i].GetID()] = CKeyMetadata(nCreationTime);
+        if (!nTimeFirstKey || nCreationTime < nTimeFirstKey)
+            nTimeFirstKey = nCreationTime;
 
-    // Create new metadata
-    int64_t nCreationTime = GetTime();
-    mapKeyMetadata[pubkey.GetID()] = CKeyMetadata(nCreationTime);
-    if (!nTimeFirstKey || nCreationTime < nTimeFirstKey)
-        nTimeFirstKey = nCreationTime;
-
-    if (!AddKeyPubKey(secret, pubkey))
-        throw std::runtime_error("CWallet::GenerateNewKey() : AddKey failed");
-    return pubkey;
+        if (!AddKeyPubKey(vKeys[i], vPubKeys[i]))
+            throw std::runtime_error("CWallet::GenerateNewKey() : AddKey failed");
+    }
 }
 
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
@@ -133,6 +196,8 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
     if (!fFileBacked)
         return true;
     if (!IsCrypted()) {
+        if (pwalletdbBatch)
+            return pwalletdbBatch->WriteKey(pubkey, secret.GetPrivKey(), mapKeyMetadata[pubkey.GetID()]);
         return CWalletDB(strWalletFile).WriteKey(pubkey, secret.GetPrivKey(), mapKeyMetadata[pubkey.GetID()]);
     }
     return true;
@@ -151,6 +216,8 @@ bool CWallet::AddCryptedKey(const CPubKey& vchPubKey,
             return pwalletdbEncryption->WriteCryptedKey(vchPubKey,
                 vchCryptedSecret,
                 mapKeyMetadata[vchPubKey.GetID()]);
+        else if (pwalletdbBatch)
+            return pwalletdbBatch->WriteCryptedKey(vchPubKey, vchCryptedSecret, mapKeyMetadata[vchPubKey.GetID()]);
         else
             return CWalletDB(strWalletFile).WriteCryptedKey(vchPubKey, vchCryptedSecret, mapKeyMetadata[vchPubKey.GetID()]);
     }
@@ -214,9 +281,13 @@ bool CWallet::RemoveWatchOnly(const CScript& dest)
         return false;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
-    if (fFileBacked)
-        if (!CWalletDB(strWalletFile).EraseWatchOnly(dest))
+    if (fFileBacked) {
+        if (pwalletdbBatch) {
+            if (!pwalletdbBatch->EraseWatchOnly(dest))
+                return false;
+        } else if (!CWalletDB(strWalletFile).EraseWatchOnly(dest))
             return false;
+    }
 
     return true;
 }
@@ -355,6 +426,8 @@ bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB* pwalletdbIn,
         nWalletMaxVersion = nVersion;
 
     if (fFileBacked) {
+        if (!pwalletdbIn)
+            pwalletdbIn = pwalletdbBatch;
         CWalletDB* pwalletdb = pwalletdbIn ? pwalletdbIn : new CWalletDB(strWalletFile);
         if (nWalletVersion > 40000)
             pwalletdb->WriteMinVersion(nWalletVersion);
@@ -627,6 +700,8 @@ int64_t CWallet::IncOrderPosNext(CWalletDB* pwalletdb)
 {
     AssertLockHeld(cs_wallet); // nOrderPosNext
     int64_t nRet = nOrderPosNext++;
+    if (!pwalletdb)
+        pwalletdb = pwalletdbBatch;
     if (pwalletdb) {
         pwalletdb->WriteOrderPosNext(nOrderPosNext);
     } else {
@@ -641,7 +716,9 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
             item.second.MarkDirty();
+        pindexCoinIndex = NULL;
     }
+    fStakeCandidatesDirty = true;
 }
 
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
@@ -654,6 +731,10 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        AddTxByBlock(hash, wtx.hashBlock);
+        // Blocks may have been disconnected while the wallet was not loaded
+        if (wtx.hashBlock != 0)
+            setTxBlocksMaybeStale.insert(wtx.hashBlock);
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -668,15 +749,21 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
             wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
             wtx.nTimeSmart = ComputeTimeSmart(wtx);
             AddToSpends(hash);
+            AddTxByBlock(hash, wtx.hashBlock);
         }
 
         bool fUpdated = false;
         if (!fInsertedNew) {
             // Merge
             if (wtxIn.hashBlock != 0 && wtxIn.hashBlock != wtx.hashBlock) {
+                RemoveTxByBlock(hash, wtx.hashBlock);
+                AddTxByBlock(hash, wtxIn.hashBlock);
                 wtx.hashBlock = wtxIn.hashBlock;
                 fUpdated = true;
             }
+            // Seen again outside a block: the block it was in has been disconnected
+            if (wtxIn.hashBlock == 0 && wtx.hashBlock != 0)
+                setTxBlocksMaybeStale.insert(wtx.hashBlock);
             if (wtxIn.nIndex != -1 && (wtxIn.vMerkleBranch != wtx.vMerkleBranch || wtxIn.nIndex != wtx.nIndex)) {
                 wtx.vMerkleBranch = wtxIn.vMerkleBranch;
                 wtx.nIndex = wtxIn.nIndex;
@@ -698,6 +785,10 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        fStakeCandidatesDirty = true;
+        setCoinIndexStale.insert(hash);
+        BOOST_FOREACH (const CTxIn& txin, wtx.vin)
+            setCoinIndexStale.insert(txin.prevout.hash);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -756,12 +847,87 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end()) {
+            const CWalletTx& wtx = mi->second;
+            RemoveTxByBlock(hash, wtx.hashBlock);
+            std::pair<TxItems::iterator, TxItems::iterator> range = wtxOrdered.equal_range(wtx.nOrderPos);
+            for (TxItems::iterator it = range.first; it != range.second; ++it) {
+                if (it->second.first == &wtx) {
+                    wtxOrdered.erase(it);
+                    break;
+                }
+            }
+            mapWallet.erase(mi);
+            fStakeCandidatesDirty = true;
+            pindexCoinIndex = NULL;
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return;
 }
 
+void CWallet::AddTxByBlock(const uint256& hashTx, const uint256& hashBlock)
+{
+    AssertLockHeld(cs_wallet);
+    mapTxByBlock[hashBlock].insert(hashTx);
+}
+
+void CWallet::RemoveTxByBlock(const uint256& hashTx, const uint256& hashBlock)
+{
+    AssertLockHeld(cs_wallet);
+    std::map<uint256, std::set<uint256> >::iterator mi = mapTxByBlock.find(hashBlock);
+    if (mi == mapTxByBlock.end())
+        return;
+    mi->second.erase(hashTx);
+    if (mi->second.empty()) {
+        mapTxByBlock.erase(mi);
+        setTxBlocksMaybeStale.erase(hashBlock);
+    }
+}
+
+/**
+ * Collect the wallet transactions that have fewer confirmations than pindex:
+ * those in active blocks above it, those not in any block and those in
+ * blocks that have been disconnected. Returned in txid order.
+ */
+void CWallet::GetTransactionsSince(const CBlockIndex* pindex, std::vector<const CWalletTx*>& vwtx)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::set<uint256> setBlocks;
+    setBlocks.insert(0);
+    for (const CBlockIndex* pindexWalk = chainActive.Tip(); pindexWalk && pindexWalk->nHeight > pindex->nHeight; pindexWalk = pindexWalk->pprev)
+        setBlocks.insert(pindexWalk->GetBlockHash());
+
+    for (std::set<uint256>::iterator it = setTxBlocksMaybeStale.begin(); it != setTxBlocksMaybeStale.end();) {
+        BlockMap::const_iterator mi = mapBlockIndex.find(*it);
+        if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second)) {
+            // Back in the active chain; AddToWallet flags it again if it is disconnected
+            setTxBlocksMaybeStale.erase(it++);
+            continue;
+        }
+        setBlocks.insert(*it);
+        ++it;
+    }
+
+    std::set<uint256> setTx;
+    BOOST_FOREACH (const uint256& hashBlock, setBlocks) {
+        std::map<uint256, std::set<uint256> >::const_iterator mi = mapTxByBlock.find(hashBlock);
+        if (mi != mapTxByBlock.end())
+            setTx.insert(mi->second.begin(), mi->second.end());
+    }
+
+    vwtx.clear();
+    vwtx.reserve(setTx.size());
+    BOOST_FOREACH (const uint256& hashTx, setTx) {
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
+        if (mi != mapWallet.end())
+            vwtx.push_back(&mi->second);
+    }
+}
+
 
 isminetype CWallet::IsMine(const CTxIn& txin) const
 {
@@ -1410,20 +1576,188 @@ void CWalletTx::GetAccountAmounts(const string& strAccount, CAmount& nReceived,
 
 bool CWalletTx::WriteToDisk()
 {
+    if (pwallet->pwalletdbBatch)
+        return pwallet->pwalletdbBatch->WriteTx(GetHash(), *this);
     return CWalletDB(pwallet->strWalletFile).WriteTx(GetHash(), *this);
 }
 
+/**
+ * All scriptPubKeys that can pay to this wallet: pay-to-pubkey and
+ * pay-to-pubkey-hash for every key, pay-to-script-hash for every redeem
+ * script, and the watch-only and multisig scripts as they are.
+ */
+void CWallet::GetScriptPubKeys(std::set<CScript>& setScripts) const
+{
+    LOCK(cs_KeyStore);
+    std::set<CKeyID> setKeys;
+    GetKeys(setKeys);
+    BOOST_FOREACH (const CKeyID& keyid, setKeys) {
+        CPubKey pubkey;
+        if (GetPubKey(keyid, pubkey))
+            setScripts.insert(CScript() << ToByteVector(pubkey) << OP_CHECKSIG);
+        setScripts.insert(GetScriptForDestination(keyid));
+    }
+    BOOST_FOREACH (const PAIRTYPE(CScriptID, CScript) & item, mapScripts)
+        setScripts.insert(GetScriptForDestination(item.first));
+    setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+    setScripts.insert(setMultiSig.begin(), setMultiSig.end());
+}
+
+namespace
+{
+/** A block read ahead by the rescan, with the transactions that may pay to the wallet flagged */
+struct CRescanBlock {
+    CBlockIndex* pindex;
+    CDiskBlockPos pos;
+    CBlock block;
+    std::vector<bool> vMatch;
+    bool fRead;
+
+    CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), pos(pindexIn->GetBlockPos()), fRead(false) {}
+};
+
+/**
+ * Reads a batch of blocks on a pool of threads while the caller applies
+ * the previous batch to the wallet. Outputs are matched against a snapshot
+ * of the wallet's scriptPubKeys; scripts whose ownership can't be decided
+ * by an exact match are always left to IsMine.
+ */
+class CRescanReader
+{
+private:
+    const std::set<CScript>& setScripts;
+    boost::thread_group threadGroup;
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condMaster;
+    std::vector<CRescanBlock>* pbatch;
+    unsigned int nNext;
+    unsigned int nDone;
+    bool fQuit;
+
+    //! Whether an output with this script could be ours
+    bool MayBeMine(const CScript& script) const
+    {
+        return setScripts.count(script) || !IsExactMatchScript(script);
+    }
+
+    void ReadBlock(CRescanBlock& entry)
+    {
+        // A filter miss means none of our scripts is paid or spent in the block. That is
+        // only conclusive when the block has no scripts IsMine decides through their keys
+        // (bare multisig and the like), otherwise the block is read and left to MayBeMine.
+        CBlockFilter filter;
+        if (GetBlockFilter(entry.pindex, filter) && filter.HasOnlyExactScripts() && !filter.MatchAny(setScripts)) {
+            entry.fRead = true;
+            return;
+        }
+        if (!ReadBlockFromDisk(entry.block, entry.pos) || entry.block.GetHash() != entry.pindex->GetBlockHash())
+            return;
+        entry.vMatch.assign(entry.block.vtx.size(), false);
+        for (unsigned int i = 0; i < entry.block.vtx.size(); i++) {
+            BOOST_FOREACH (const CTxOut& txout, entry.block.vtx[i].vout) {
+                if (MayBeMine(txout.scriptPubKey)) {
+                    entry.vMatch[i] = true;
+                    break;
+                }
+            }
+        }
+        entry.fRead = true;
+    }
+
+    void Thread()
+    {
+        RenameThread("kore-rescan");
+        while (true) {
+            CRescanBlock* pentry;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fQuit && (pbatch == NULL || nNext == pbatch->size()))
+                    condWorker.wait(lock);
+                if (fQuit)
+                    return;
+                pentry = &(*pbatch)[nNext++];
+            }
+            ReadBlock(*pentry);
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (++nDone == pbatch->size())
+                    condMaster.notify_one();
+            }
+        }
+    }
+
+public:
+    CRescanReader(const std::set<CScript>& setScriptsIn, int nThreads) : setScripts(setScriptsIn), pbatch(NULL), nNext(0), nDone(0), fQuit(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&CRescanReader::Thread, this));
+    }
+
+    ~CRescanReader()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fQuit = true;
+        }
+        condWorker.notify_all();
+        threadGroup.join_all();
+    }
+
+    //! Start reading batch; it must not be touched until Wait() returns
+    void Start(std::vector<CRescanBlock>& batch)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        pbatch = &batch;
+        nNext = 0;
+        nDone = 0;
+        condWorker.notify_all();
+    }
+
+    void Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (pbatch != NULL && nDone < pbatch->size())
+            condMaster.wait(lock);
+        pbatch = NULL;
+    }
+};
+
+//! Fill batch with up to RESCAN_BATCH_SIZE active chain blocks starting at pindex
+void PrepareRescanBatch(CBlockIndex* pindex, std::vector<CRescanBlock>& batch)
+{
+    AssertLockHeld(cs_main);
+    batch.clear();
+    while (pindex && batch.size() < RESCAN_BATCH_SIZE) {
+        batch.push_back(CRescanBlock(pindex));
+        pindex = chainActive.Next(pindex);
+    }
+}
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and matched against the wallet's scripts in batches on
+ * -rescanthreads reader threads, one batch ahead of the one being added to
+ * the wallet. With -blockfilterindex, blocks whose filter matches none of
+ * the wallet's scripts, and that hold no script the filter can't rule out,
+ * are not read at all. cs_main and cs_wallet are only held while a batch is added,
+ * unless the caller holds them already.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
+    int nThreads = std::max(1, std::min((int)GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS), MAX_RESCAN_THREADS));
 
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart = 0.0;
+    double dProgressTip = 0.0;
+    std::set<CScript> setScripts;
+    std::vector<CRescanBlock> vCurrent, vNext;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1433,28 +1767,55 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        set<uint256> setAddedToWallet;
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+        GetScriptPubKeys(setScripts);
+        PrepareRescanBatch(pindex, vNext);
+    }
+
+    CRescanReader reader(setScripts, nThreads);
+    reader.Start(vNext);
+    while (!vNext.empty()) {
+        reader.Wait();
+        vCurrent.swap(vNext);
+
+        LOCK2(cs_main, cs_wallet);
+        // Continue from where the active chain left the batch, in case it was reorganized meanwhile
+        PrepareRescanBatch(chainActive.Next(chainActive.FindFork(vCurrent.back().pindex)), vNext);
+        reader.Start(vNext);
+
+        CWalletDBBatch batch(*this);
+        BOOST_FOREACH (CRescanBlock& entry, vCurrent) {
+            // Blocks that were disconnected meanwhile are skipped, their replacements are synced by ConnectTip
+            if (!chainActive.Contains(entry.pindex))
+                continue;
+            if (!entry.fRead) {
+                ReadBlockFromDisk(entry.block, entry.pindex);
+                entry.vMatch.assign(entry.block.vtx.size(), true);
+            }
+            for (unsigned int i = 0; i < entry.block.vtx.size(); i++) {
+                const CTransaction& tx = entry.block.vtx[i];
+                // Spends and updates can't be told from the scripts, they are looked up in mapWallet
+                bool fCandidate = entry.vMatch[i] || mapWallet.count(tx.GetHash());
+#ifdef ZEROCOIN
+                fCandidate = fCandidate || tx.ContainsZerocoins();
+#endif
+                for (unsigned int j = 0; j < tx.vin.size() && !fCandidate; j++)
+                    fCandidate = mapWallet.count(tx.vin[j].prevout.hash) != 0;
+                if (fCandidate && AddToWalletIfInvolvingMe(tx, &entry.block, fUpdate))
                     ret++;
             }
+        }
 
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
-            }
+        pindex = vCurrent.back().pindex;
+        if (dProgressTip - dProgressStart > 0.0)
+            ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+        if (GetTime() >= nNow + 60) {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -1870,81 +2231,87 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            AvailableCoinsFromTx(&(*it).second, vCoins, fOnlyConfirmed, coinControl, fIncludeZeroValue, nCoinType, fUseIX, nWatchonlyConfig);
+    }
+}
 
-            if (!CheckFinalTx(*pcoin))
-                continue;
+//! Append the outputs of one wallet transaction AvailableCoins() would return
+void CWallet::AvailableCoinsFromTx(const CWalletTx* pcoin, vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX, int nWatchonlyConfig) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    const uint256& wtxid = pcoin->GetHash();
 
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
+    if (!CheckFinalTx(*pcoin))
+        return;
 
-            if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+    if (fOnlyConfirmed && !pcoin->IsTrusted())
+        return;
 
-            int nDepth = pcoin->GetDepthInMainChain(false);
-            // do not use IX for inputs that have less then 6 blockchain confirmations
-            if (fUseIX && nDepth < 6)
-                continue;
+    if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
+        return;
 
-            // We should not consider coins which aren't at least in our mempool
-            // It's possible for these to be conflicted via ancestors which we may never be able to detect
-            if (nDepth == 0 && !pcoin->InMempool())
-                continue;
+    int nDepth = pcoin->GetDepthInMainChain(false);
+    // do not use IX for inputs that have less then 6 blockchain confirmations
+    if (fUseIX && nDepth < 6)
+        return;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                bool found = false;
-                if (nCoinType == ONLY_DENOMINATED) {
-                    found = IsDenominatedAmount(pcoin->vout[i].nValue);
-                } else if (nCoinType == ONLY_NOT10000IFMN) {
-                    found = !(fMasterNode && pcoin->vout[i].nValue == MASTERNODE_MIN_COINS * COIN);
-                } else if (nCoinType == ONLY_NONDENOMINATED_NOT10000IFMN) {
-                    if (IsCollateralAmount(pcoin->vout[i].nValue)) continue; // do not use collateral amounts
-                    found = !IsDenominatedAmount(pcoin->vout[i].nValue);
-                    if (found && fMasterNode) found = pcoin->vout[i].nValue != MASTERNODE_MIN_COINS * COIN; // do not use Hot MN funds
-                } else if (nCoinType == ONLY_10000) {
-                    found = pcoin->vout[i].nValue == MASTERNODE_MIN_COINS * COIN;
-                } else {
-                    found = true;
-                }
-                if (!found) continue;
+    // We should not consider coins which aren't at least in our mempool
+    // It's possible for these to be conflicted via ancestors which we may never be able to detect
+    if (nDepth == 0 && !pcoin->InMempool())
+        return;
+
+    for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+        bool found = false;
+        if (nCoinType == ONLY_DENOMINATED) {
+            found = IsDenominatedAmount(pcoin->vout[i].nValue);
+        } else if (nCoinType == ONLY_NOT10000IFMN) {
+            found = !(fMasterNode && pcoin->vout[i].nValue == MASTERNODE_MIN_COINS * COIN);
+        } else if (nCoinType == ONLY_NONDENOMINATED_NOT10000IFMN) {
+            if (IsCollateralAmount(pcoin->vout[i].nValue)) continue; // do not use collateral amounts
+            found = !IsDenominatedAmount(pcoin->vout[i].nValue);
+            if (found && fMasterNode) found = pcoin->vout[i].nValue != MASTERNODE_MIN_COINS * COIN; // do not use Hot MN funds
+        } else if (nCoinType == ONLY_10000) {
+            found = pcoin->vout[i].nValue == MASTERNODE_MIN_COINS * COIN;
+        } else {
+            found = true;
+        }
+        if (!found) continue;
 
 #ifdef ZEROCOIN
-                if (nCoinType == STAKABLE_COINS) {
-                    if (pcoin->vout[i].IsZerocoinMint())
-                        continue;
-                }
-#endif                
+        if (nCoinType == STAKABLE_COINS) {
+            if (pcoin->vout[i].IsZerocoinMint())
+                continue;
+        }
+#endif
 
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (IsSpent(wtxid, i))
-                    continue;
-                if (mine == ISMINE_NO)
-                    continue;
+        isminetype mine = IsMine(pcoin->vout[i]);
+        if (IsSpent(wtxid, i))
+            continue;
+        if (mine == ISMINE_NO)
+            continue;
 
-                if ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2)
-                    continue;
+        if ((mine == ISMINE_MULTISIG || mine == ISMINE_SPENDABLE) && nWatchonlyConfig == 2)
+            continue;
 
-                if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
-                    continue;
+        if (mine == ISMINE_WATCH_ONLY && nWatchonlyConfig == 1)
+            continue;
 
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000)
-                    continue;
-                if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
-                    continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected((*it).first, i))
-                    continue;
+        if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000)
+            continue;
+        if (pcoin->vout[i].nValue <= 0 && !fIncludeZeroValue)
+            continue;
+        if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(wtxid, i))
+            continue;
 
-                bool fIsSpendable = false;
-                if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
-                    fIsSpendable = true;
-                if ((mine & ISMINE_MULTISIG) != ISMINE_NO)
-                    fIsSpendable = true;
+        bool fIsSpendable = false;
+        if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
+            fIsSpendable = true;
+        if ((mine & ISMINE_MULTISIG) != ISMINE_NO)
+            fIsSpendable = true;
 
-                vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
-            }
-        }
+        vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
     }
 }
 
@@ -2007,6 +2374,68 @@ static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*, un
     }
 }
 
+/**
+ * Depth-first search for a subset of vValue (sorted by descending value) that
+ * adds up to at least nTargetValue but less than nTargetValue + nMaxExcess,
+ * so the transaction needs no change output. Branches that overshoot or can
+ * no longer reach the target are cut, and a run of equal values is only tried
+ * in one order. Gives up after nMaxTries steps.
+ */
+static bool SelectCoinsBnB(const vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > >& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, const CAmount& nMaxExcess, vector<char>& vfBest, CAmount& nBest, int nMaxTries = 100000)
+{
+    vector<char> vfIncluded(vValue.size(), false);
+    CAmount nTotal = 0;
+    CAmount nRemaining = nTotalLower; // sum of the values from i on, not decided yet
+    bool fFound = false;
+    unsigned int i = 0;
+
+    for (int nTry = 0; nTry < nMaxTries; nTry++) {
+        bool fBacktrack = false;
+        if (nTotal + nRemaining < nTargetValue || nTotal >= nTargetValue + nMaxExcess) {
+            fBacktrack = true;
+        } else if (nTotal >= nTargetValue) {
+            if (!fFound || nTotal < nBest) {
+                nBest = nTotal;
+                vfBest = vfIncluded;
+                fFound = true;
+            }
+            if (nTotal == nTargetValue)
+                break;
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Undo the trailing exclusions, then exclude the last included value instead
+            while (i > 0 && !vfIncluded[i - 1]) {
+                i--;
+                nRemaining += vValue[i].first;
+            }
+            if (i == 0)
+                break; // every branch has been tried
+            i--;
+            vfIncluded[i] = false;
+            nTotal -= vValue[i].first;
+            i++;
+            continue;
+        }
+
+        // Include the next value, unless an equal one right before it was just excluded
+        nRemaining -= vValue[i].first;
+        if (i == 0 || vfIncluded[i - 1] || vValue[i].first != vValue[i - 1].first) {
+            vfIncluded[i] = true;
+            nTotal += vValue[i].first;
+        }
+        i++;
+    }
+    return fFound;
+}
+
+//! Below this much over the target, the change output would be dust and go to the fee instead
+static CAmount GetChangelessExcess()
+{
+    // A pay-to-address change output of 34 bytes spent by a 148 byte input, as in CTxOut::IsDust()
+    return 3 * ::minRelayTxFee.GetFee(34 + 148);
+}
 
 // TODO: find appropriate place for this sort function
 // move denoms down
@@ -2025,46 +2454,47 @@ bool less_then_denom(const COutput& out1, const COutput& out2)
     return (!found1 && found2);
 }
 
-bool CWallet::SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInputs, CAmount nTargetAmount)
+/**
+ * Rebuild the staking thread's candidates: every stakable output, with the
+ * block that included it looked up once here instead of on every attempt.
+ * Amount, age and maturity change with the clock and the balance, so
+ * CreateCoinStake checks those per attempt.
+ */
+void CWallet::UpdateStakeCandidates()
 {
+    // Cleared first, so a change while rebuilding triggers another rebuild
+    fStakeCandidatesDirty = false;
+    vStakeCandidates.clear();
+
+    LOCK2(cs_main, cs_wallet);
+    pindexStakeCandidates = chainActive.Tip();
+    if (!GetBoolArg("-korestake", true))
+        return;
+
     //Add KORE
     vector<COutput> vCoins;
     AvailableCoins(vCoins, true, NULL, false, STAKABLE_COINS);
-    CAmount nAmountSelected = 0;
-    if (GetBoolArg("-korestake", true)) {
-        for (const COutput &out : vCoins) {
-            //make sure not to outrun target amount
-            if (nAmountSelected + out.tx->vout[out.i].nValue > nTargetAmount)
-                continue;
-
-            //if zerocoinspend, then use the block time
-            int64_t nTxTime = out.tx->GetTxTime();
-#ifdef ZEROCOIN            
-            if (out.tx->IsZerocoinSpend()) {
-                if (!out.tx->IsInMainChain())
-                    continue;
-                nTxTime = mapBlockIndex.at(out.tx->hashBlock)->GetBlockTime();
-            }
-#endif            
-
-            //check for min age
-            if (GetAdjustedTime() - nTxTime < Params().StakeMinAge())
-                continue;
-
-            //check that it is matured
-            if (out.nDepth < (out.tx->IsCoinStake() ? Params().COINBASE_MATURITY() : 10))
-                continue;
+    vStakeCandidates.reserve(vCoins.size());
+    for (const COutput& out : vCoins) {
+        // Unconfirmed outputs cannot be mature yet
+        BlockMap::iterator mi = mapBlockIndex.find(out.tx->hashBlock);
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+            continue;
 
-            //add to our stake set
-            nAmountSelected += out.tx->vout[out.i].nValue;
+        //if zerocoinspend, then use the block time
+        int64_t nTxTime = out.tx->GetTxTime();
+#ifdef ZEROCOIN
+        if (out.tx->IsZerocoinSpend())
+            nTxTime = mi->second->GetBlockTime();
+#endif
 
-            std::unique_ptr<CkoreStake> input(new CkoreStake());
-            input->SetInput((CTransaction) *out.tx, out.i);
-            listInputs.emplace_back(std::move(input));
-        }
+        vStakeCandidates.push_back(CStakeCandidate());
+        CStakeCandidate& candidate = vStakeCandidates.back();
+        candidate.input.SetInput((CTransaction)*out.tx, out.i, mi->second);
+        candidate.nValue = out.tx->vout[out.i].nValue;
+        candidate.nTxTime = nTxTime;
+        candidate.nMinDepth = out.tx->IsCoinStake() ? Params().COINBASE_MATURITY() : 10;
     }
-
-    return true;
 }
 
 bool CWallet::MintableCoins()
@@ -2169,19 +2599,23 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
         break;
     }
 
-    // Solve subset sum by stochastic approximation
-    sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
+    // Stable, so equal values keep their shuffled order and the search doesn't always pick the same coins
+    stable_sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    // Look for a combination that needs no change first, then solve subset sum by stochastic approximation
+    bool fChangeless = SelectCoinsBnB(vValue, nTotalLower, nTargetValue, GetChangelessExcess(), vfBest, nBest);
+    if (!fChangeless) {
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
+        if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
+            ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
     if (coinLowestLarger.second.first &&
-        ((nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger.first <= nBest)) {
+        ((!fChangeless && nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger.first <= nBest)) {
         setCoinsRet.insert(coinLowestLarger.second);
         nValueRet += coinLowestLarger.first;
     } else {
@@ -2204,7 +2638,10 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*
     // Note: this function should never be used for "always free" tx types like dstx
 
     vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, coinControl, false, coin_type, useIX);
+    if (!coinControl && coin_type == ALL_COINS && !useIX)
+        GetIndexedCoins(nTargetValue, vCoins);
+    else
+        AvailableCoins(vCoins, true, coinControl, false, coin_type, useIX);
 
     // coin control -> return all selected outputs (we want all selected to go into the transaction for sure)
     if (coinControl && coinControl->HasSelected()) {
@@ -2250,6 +2687,78 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*
             (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue, 0, 1, vCoins, setCoinsRet, nValueRet)));
 }
 
+static bool CompareOutputValue(const COutput& out1, const COutput& out2)
+{
+    return out1.tx->vout[out1.i].nValue < out2.tx->vout[out2.i].nValue;
+}
+
+/**
+ * Bring vCoinIndex up to date. It is rebuilt from scratch once per tip, as
+ * depths and maturity change with it. Within a tip only the transactions
+ * marked stale (added, updated, spent from, or with outputs locked) and the
+ * unconfirmed ones, which may have left the mempool, are looked at again, so
+ * a run of sends doesn't check every output of the wallet each time.
+ */
+void CWallet::UpdateCoinIndex() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (pindexCoinIndex == NULL || pindexCoinIndex != chainActive.Tip()) {
+        AvailableCoins(vCoinIndex);
+        sort(vCoinIndex.begin(), vCoinIndex.end(), CompareOutputValue);
+        pindexCoinIndex = chainActive.Tip();
+        setCoinIndexStale.clear();
+        return;
+    }
+
+    BOOST_FOREACH (const COutput& out, vCoinIndex)
+        if (out.nDepth == 0)
+            setCoinIndexStale.insert(out.tx->GetHash());
+    if (setCoinIndexStale.empty())
+        return;
+
+    vector<COutput>::iterator itEnd = vCoinIndex.begin();
+    for (vector<COutput>::iterator it = vCoinIndex.begin(); it != vCoinIndex.end(); ++it)
+        if (!setCoinIndexStale.count(it->tx->GetHash()))
+            *itEnd++ = *it;
+    vCoinIndex.erase(itEnd, vCoinIndex.end());
+
+    vector<COutput> vFresh;
+    BOOST_FOREACH (const uint256& hash, setCoinIndexStale) {
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+            AvailableCoinsFromTx(&(*mi).second, vFresh, true, NULL, false, ALL_COINS, false, 1);
+    }
+    BOOST_FOREACH (const COutput& out, vFresh)
+        vCoinIndex.insert(upper_bound(vCoinIndex.begin(), vCoinIndex.end(), out, CompareOutputValue), out);
+    setCoinIndexStale.clear();
+}
+
+/**
+ * The outputs AvailableCoins() returns for a plain send, without the ones
+ * SelectCoinsMinConf() could never pick for nTargetValue: of the outputs
+ * worth at least nTargetValue + CENT only the smaller ones up to the first
+ * that every confirmation tier accepts (and those equal to it, so the choice
+ * between them stays random) are kept.
+ */
+void CWallet::GetIndexedCoins(const CAmount& nTargetValue, vector<COutput>& vCoins) const
+{
+    LOCK2(cs_main, cs_wallet);
+    UpdateCoinIndex();
+
+    vCoins.clear();
+    CAmount nLargestNeeded = std::numeric_limits<CAmount>::max();
+    BOOST_FOREACH (const COutput& out, vCoinIndex) {
+        CAmount nValue = out.tx->vout[out.i].nValue;
+        if (nValue > nLargestNeeded)
+            break;
+        vCoins.push_back(out);
+        if (nValue >= nTargetValue + CENT && out.fSpendable && out.nDepth >= 6 && !IsDenominatedAmount(nValue))
+            nLargestNeeded = nValue;
+    }
+}
+
 bool CWallet::SelectCoins_Legacy(const CAmount& nTargetValue, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType coin_type, bool useIX, bool fProofOfStake) const
 {
     // Note: this function should never be used for "always free" tx types like dstx
@@ -2969,46 +3478,105 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (nBalance > 0 && nBalance <= nReserveBalance)
         return false;
 
-    // Initialize as static and don't update the set on every run of CreateCoinStake() in order to lighten resource use
-    static int nLastStakeSetUpdate = 0;
-    static list<std::unique_ptr<CStakeInput> > listInputs;
-    if (GetTime() - nLastStakeSetUpdate > nStakeSetUpdateTime) {
-        listInputs.clear();
-        if (!SelectStakeCoins(listInputs, nBalance - nReserveBalance))
-            return false;
+    // The candidates only change with the wallet or the chain, don't rebuild them on every attempt
+    if (fStakeCandidatesDirty || pindexStakeCandidates != chainActive.Tip())
+        UpdateStakeCandidates();
 
-        nLastStakeSetUpdate = GetTime();
-    }
-
-    if (listInputs.empty())
+    if (vStakeCandidates.empty())
         return false;
 
     if (GetAdjustedTime() - chainActive.Tip()->GetBlockTime() < 60)
         MilliSleep(10000);
 
+    // Take what the kernel search needs from the chain up front, the hashing itself runs without locks
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    unsigned int nTimeTx = GetAdjustedTime();
+    int nHeightStart;
+    std::vector<CStakeKernelSearch> vSearch;
+    {
+        LOCK(cs_main);
+        nHeightStart = chainActive.Height();
+        CAmount nTargetAmount = nBalance - nReserveBalance;
+        CAmount nAmountSelected = 0;
+        for (CStakeCandidate& candidate : vStakeCandidates) {
+            //make sure not to outrun target amount
+            if (nAmountSelected + candidate.nValue > nTargetAmount)
+                continue;
+
+            //check for min age
+            if (GetAdjustedTime() - candidate.nTxTime < Params().StakeMinAge())
+                continue;
+
+            //make sure that enough time has elapsed between
+            CBlockIndex* pindex = candidate.input.GetIndexFrom();
+            if (!pindex || pindex->nHeight < 1) {
+                LogPrintf("*** no pindexfrom\n");
+                continue;
+            }
+
+            //check that it is matured
+            if (nHeightStart - pindex->nHeight + 1 < candidate.nMinDepth)
+                continue;
+
+            unsigned int nTimeBlockFrom = pindex->GetBlockTime();
+            if (nTimeBlockFrom + Params().StakeMinAge() > nTimeTx)
+                continue;
+
+            uint64_t nStakeModifier = 0;
+            if (!candidate.input.GetModifier(nStakeModifier))
+                continue;
+
+            nAmountSelected += candidate.nValue;
+            vSearch.push_back(CStakeKernelSearch(&candidate, nTimeBlockFrom, nStakeModifier));
+        }
+    }
+
+    if (vSearch.empty())
+        return false;
+
+    // Make sure the wallet is unlocked and shutdown hasn't been requested
+    if (IsLocked() || ShutdownRequested())
+        return false;
+
+    // Spread the candidates over -stakethreads threads; the first kernel in candidate order wins
+    int64_t nStart = GetTimeMicros();
+    unsigned int nThreads = std::max(1, std::min((int)GetArg("-stakethreads", DEFAULT_STAKE_THREADS), MAX_STAKE_THREADS));
+    nThreads = std::max(1U, std::min(nThreads, (unsigned int)vSearch.size() / STAKE_INPUTS_PER_THREAD));
+    std::atomic<size_t> nFirstFound(vSearch.size());
+    boost::thread_group threadGroup;
+    for (unsigned int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&SearchStakeKernels, boost::ref(vSearch), bnTargetPerCoinDay, nHeightStart, nTimeTx, i, nThreads, boost::ref(nFirstFound)));
+    SearchStakeKernels(vSearch, bnTargetPerCoinDay, nHeightStart, nTimeTx, 0, nThreads, nFirstFound);
+    threadGroup.join_all();
+
+    int64_t nHashes = 0;
+    for (const CStakeKernelSearch& search : vSearch)
+        nHashes += search.nHashes;
+    {
+        LOCK(cs_wallet);
+        RecordStakeHashing(nHashes, GetTimeMicros() - nStart, nThreads);
+    }
+    {
+        LOCK(cs_main);
+        mapHashedBlocks.clear();
+        mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    }
+
+    if (IsLocked() || ShutdownRequested())
+        return false;
+
     CAmount nCredit;
     CScript scriptPubKeyKernel;
     bool fKernelFound = false;
-    for (std::unique_ptr<CStakeInput>& stakeInput : listInputs) {
-        nCredit = 0;
-        // Make sure the wallet is unlocked and shutdown hasn't been requested
-        if (IsLocked() || ShutdownRequested())
-            return false;
-
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = stakeInput->GetIndexFrom();
-        if (!pindex || pindex->nHeight < 1) {
-            LogPrintf("*** no pindexfrom\n");
+    for (const CStakeKernelSearch& search : vSearch) {
+        if (!search.fFound)
             continue;
-        }
-
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
-        uint256 hashProofOfStake = 0;
-        nTxNewTime = GetAdjustedTime();
 
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (Stake(stakeInput.get(), nBits, block.GetBlockTime(), nTxNewTime, hashProofOfStake)) {
+        nCredit = 0;
+        CStakeInput* stakeInput = &search.pcandidate->input;
+        nTxNewTime = search.nTimeTx;
+        {
             LOCK(cs_main);
             //Double check that this will pass time requirements
             if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
@@ -3098,8 +3666,8 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             return error("CreateCoinStake : failed to sign coinstake");
     }
 
-    // Successfully generated coinstake
-    nLastStakeSetUpdate = 0; //this will trigger stake set to repopulate next round
+    // Successfully generated coinstake; the staked output is gone, repopulate next round
+    fStakeCandidatesDirty = true;
     return true;
 }
 
@@ -3296,10 +3864,8 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, std:
         LOCK2(cs_main, cs_wallet);
         LogPrintf("CommitTransaction:\n%s", wtxNew.ToString());
         {
-            // This is only to keep the database open to defeat the auto-flush for the
-            // duration of this scope.  This is the only place where this optimization
-            // maybe makes sense; please don't do it anywhere else.
-            CWalletDB* pwalletdb = fFileBacked ? new CWalletDB(strWalletFile, "r") : NULL;
+            // Write the spent key, the transaction and the order position in one go
+            CWalletDBBatch batch(*this);
 
             // Take key pair from key pool so it won't be used again
             reservekey.KeepKey();
@@ -3324,9 +3890,6 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, std:
                     updated_hahes.insert(txin.prevout.hash);
                 }
             }
-
-            if (fFileBacked)
-                delete pwalletdb;
         }
 
         // Track how many getdata requests our transaction gets
@@ -3634,7 +4197,8 @@ bool CWallet::NewKeyPool()
 {
     {
         LOCK(cs_wallet);
-        CWalletDB walletdb(strWalletFile);
+        CWalletDBBatch batch(*this);
+        CWalletDB& walletdb = *pwalletdbBatch;
         BOOST_FOREACH (int64_t nIndex, setKeyPool)
             walletdb.ErasePool(nIndex);
         setKeyPool.clear();
@@ -3643,11 +4207,15 @@ bool CWallet::NewKeyPool()
             return false;
 
         int64_t nKeys = max(GetArg("-keypool", 1000), (int64_t)0);
+        int64_t nStart = GetTimeMicros();
+        std::vector<CPubKey> vPubKeys;
+        GenerateNewKeys(nKeys, vPubKeys);
         for (int i = 0; i < nKeys; i++) {
             int64_t nIndex = i + 1;
-            walletdb.WritePool(nIndex, CKeyPool(GenerateNewKey()));
+            walletdb.WritePool(nIndex, CKeyPool(vPubKeys[i]));
             setKeyPool.insert(nIndex);
         }
+        RecordKeyPoolRefill(nKeys, GetTimeMicros() - nStart);
         LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", nKeys);
     }
     return true;
@@ -3661,7 +4229,8 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         if (IsLocked())
             return false;
 
-        CWalletDB walletdb(strWalletFile);
+        CWalletDBBatch batch(*this);
+        CWalletDB& walletdb = *pwalletdbBatch;
 
         // Top up key pool
         unsigned int nTargetSize;
@@ -3670,11 +4239,17 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         else
             nTargetSize = max(GetArg("-keypool", 1000), (int64_t)0);
 
-        while (setKeyPool.size() < (nTargetSize + 1)) {
+        if (setKeyPool.size() >= (nTargetSize + 1))
+            return true;
+
+        int64_t nStart = GetTimeMicros();
+        std::vector<CPubKey> vPubKeys;
+        GenerateNewKeys(nTargetSize + 1 - setKeyPool.size(), vPubKeys);
+        BOOST_FOREACH (const CPubKey& pubkey, vPubKeys) {
             int64_t nEnd = 1;
             if (!setKeyPool.empty())
                 nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
+            if (!walletdb.WritePool(nEnd, CKeyPool(pubkey)))
                 throw runtime_error("TopUpKeyPool() : writing generated key failed");
             setKeyPool.insert(nEnd);
             LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
@@ -3682,10 +4257,30 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
             uiInterface.InitMessage(strMsg);
         }
+        RecordKeyPoolRefill(vPubKeys.size(), GetTimeMicros() - nStart);
     }
     return true;
 }
 
+void CWallet::RecordKeyPoolRefill(int64_t nKeys, int64_t nMicros)
+{
+    AssertLockHeld(cs_wallet);
+    nKeyPoolRefillKeys += nKeys;
+    nKeyPoolRefillMicros += nMicros;
+    nLastKeyPoolRefillKeys = nKeys;
+    nLastKeyPoolRefillMicros = nMicros;
+}
+
+void CWallet::RecordStakeHashing(int64_t nHashes, int64_t nMicros, unsigned int nThreads)
+{
+    AssertLockHeld(cs_wallet);
+    nStakeHashes += nHashes;
+    nStakeHashMicros += nMicros;
+    nLastStakeHashes = nHashes;
+    nLastStakeHashMicros = nMicros;
+    nLastStakeThreads = nThreads;
+}
+
 void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
 {
     nIndex = -1;
@@ -3700,11 +4295,10 @@ void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
         if (setKeyPool.empty())
             return;
 
-        CWalletDB walletdb(strWalletFile);
-
         nIndex = *(setKeyPool.begin());
         setKeyPool.erase(setKeyPool.begin());
-        if (!walletdb.ReadPool(nIndex, keypool))
+        bool fRead = pwalletdbBatch ? pwalletdbBatch->ReadPool(nIndex, keypool) : CWalletDB(strWalletFile).ReadPool(nIndex, keypool);
+        if (!fRead)
             throw runtime_error("ReserveKeyFromKeyPool() : read failed");
         if (!HaveKey(keypool.vchPubKey.GetID()))
             throw runtime_error("ReserveKeyFromKeyPool() : unknown key in key pool");
@@ -3717,8 +4311,11 @@ void CWallet::KeepKey(int64_t nIndex)
 {
     // Remove from key pool
     if (fFileBacked) {
-        CWalletDB walletdb(strWalletFile);
-        walletdb.ErasePool(nIndex);
+        LOCK(cs_wallet);
+        if (pwalletdbBatch)
+            pwalletdbBatch->ErasePool(nIndex);
+        else
+            CWalletDB(strWalletFile).ErasePool(nIndex);
     }
     LogPrintf("keypool keep %d\n", nIndex);
 }
@@ -3965,18 +4562,24 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    fStakeCandidatesDirty = true;
+    setCoinIndexStale.insert(output.hash);
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    fStakeCandidatesDirty = true;
+    setCoinIndexStale.insert(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    fStakeCandidatesDirty = true;
+    pindexCoinIndex = NULL;
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -4098,8 +4701,8 @@ unsigned int CWallet::ComputeTimeSmart(const CWalletTx& wtx) const
             {
                 // Tolerate times up to the last timestamp in the wallet not more than 5 minutes into the future
                 int64_t latestTolerated = latestNow + 300;
-                TxItems txOrdered = wtxOrdered;
-                for (TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
+                const TxItems& txOrdered = wtxOrdered;
+                for (TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
                     CWalletTx* const pwtx = (*it).second.first;
                     if (pwtx == &wtx)
                         continue;
@@ -28,6 +28,7 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -59,6 +60,20 @@ static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWa
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //! -custombackupthreshold default
 static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
+//! -rescanthreads default
+static const int DEFAULT_RESCAN_THREADS = 4;
+//! Maximum number of block reader threads a rescan may use
+static const int MAX_RESCAN_THREADS = 16;
+//! Number of blocks a rescan reads ahead while the previous batch is applied
+static const unsigned int RESCAN_BATCH_SIZE = 64;
+//! Keys each key generation thread gets at least; smaller top-ups stay on the calling thread
+static const unsigned int KEYPOOL_KEYS_PER_THREAD = 64;
+//! -stakethreads default
+static const int DEFAULT_STAKE_THREADS = 4;
+//! Maximum number of kernel hashing threads
+static const int MAX_STAKE_THREADS = 16;
+//! Stake inputs each kernel hashing thread gets at least; smaller wallets hash on the staking thread
+static const unsigned int STAKE_INPUTS_PER_THREAD = 16;
 
 // Zerocoin denomination which creates exactly one of each denominations:
 // 6666 = 1*5000 + 1*1000 + 1*500 + 1*100 + 1*50 + 1*10 + 1*5 + 1
@@ -113,6 +128,17 @@ enum ZerocoinSpendStatus {
 };
 #endif
 
+/** A wallet output the staking thread may stake, with the block it was included in resolved up front */
+struct CStakeCandidate {
+    CkoreStake input;
+    CAmount nValue;
+    int64_t nTxTime;
+    //! Confirmations needed before the output may stake
+    int nMinDepth;
+
+    CStakeCandidate() : nValue(0), nTxTime(0), nMinDepth(0) {}
+};
+
 struct CompactTallyItem {
     CBitcoinAddress address;
     CAmount nAmount;
@@ -171,6 +197,15 @@ private:
     bool SelectCoins(const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl = NULL, AvailableCoinsType coin_type = ALL_COINS, bool useIX = true) const;
     //it was public bool SelectCoins(int64_t nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet, const CCoinControl *coinControl = NULL, AvailableCoinsType coin_type=ALL_COINS, bool useIX = true) const;
     bool SelectCoins_Legacy(const CAmount& nTargetValue, set<pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType coin_type, bool useIX, bool fProofOfStake) const;
+    void AvailableCoinsFromTx(const CWalletTx* pcoin, std::vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX, int nWatchonlyConfig) const;
+    void UpdateCoinIndex() const;
+
+    //! Outputs AvailableCoins() returns for plain sends, sorted by value and reused across SelectCoins calls
+    mutable std::vector<COutput> vCoinIndex;
+    //! Tip vCoinIndex was built at; NULL makes the next SelectCoins rebuild it
+    mutable const CBlockIndex* pindexCoinIndex;
+    //! Transactions whose outputs in vCoinIndex must be looked at again
+    mutable std::set<uint256> setCoinIndexStale;
 
     CWalletDB* pwalletdbEncryption;
 
@@ -197,7 +232,7 @@ private:
 
 public:
     bool MintableCoins();
-    bool SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInputs, CAmount nTargetAmount);
+    void UpdateStakeCandidates();
     bool SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax) const;
     bool SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vCoinsRet, std::vector<COutput>& vCoinsRet2, CAmount& nValueRet, int nObfuscationRoundsMin, int nObfuscationRoundsMax);
     bool SelectCoinsDarkDenominated(CAmount nTargetValue, std::vector<CTxIn>& setCoinsRet, CAmount& nValueRet) const;
@@ -251,6 +286,21 @@ public:
     bool fFileBacked;
     bool fWalletUnlockAnonymizeOnly;
     std::string strWalletFile;
+    //! Open CWalletDBBatch that database writes go through, if any
+    CWalletDB* pwalletdbBatch;
+
+    //! Keypool refill throughput, totals and the most recent refill
+    int64_t nKeyPoolRefillKeys;
+    int64_t nKeyPoolRefillMicros;
+    int64_t nLastKeyPoolRefillKeys;
+    int64_t nLastKeyPoolRefillMicros;
+
+    //! Kernel hashing throughput, totals and the most recent staking round
+    int64_t nStakeHashes;
+    int64_t nStakeHashMicros;
+    int64_t nLastStakeHashes;
+    int64_t nLastStakeHashMicros;
+    unsigned int nLastStakeThreads;
     bool fBackupMints;
 
     //std::unique_ptr<CzKORETracker> zkoreTracker;
@@ -266,7 +316,13 @@ public:
     unsigned int nHashDrift;
     unsigned int nHashInterval;
     uint64_t nStakeSplitThreshold;
-    int nStakeSetUpdateTime;
+
+    //! Stakable outputs, owned by the staking thread and rebuilt by UpdateStakeCandidates
+    std::vector<CStakeCandidate> vStakeCandidates;
+    //! Tip vStakeCandidates was built at
+    const CBlockIndex* pindexStakeCandidates;
+    //! Set whenever wallet transactions or locked coins change
+    std::atomic<bool> fStakeCandidatesDirty;
 
     //MultiSend
     std::vector<std::pair<std::string, int> > vMultiSend;
@@ -306,6 +362,17 @@ public:
         fFileBacked = false;
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
+        pwalletdbBatch = NULL;
+        pindexCoinIndex = NULL;
+        nKeyPoolRefillKeys = 0;
+        nKeyPoolRefillMicros = 0;
+        nLastKeyPoolRefillKeys = 0;
+        nLastKeyPoolRefillMicros = 0;
+        nStakeHashes = 0;
+        nStakeHashMicros = 0;
+        nLastStakeHashes = 0;
+        nLastStakeHashMicros = 0;
+        nLastStakeThreads = 0;
         nOrderPosNext = 0;
         nNextResend = 0;
         nLastResend = 0;
@@ -317,7 +384,8 @@ public:
         nHashDrift = 45;
         nStakeSplitThreshold = 2000;
         nHashInterval = 22;
-        nStakeSetUpdateTime = 300; // 5 minutes
+        pindexStakeCandidates = NULL;
+        fStakeCandidatesDirty = true;
 
         //MultiSend
         vMultiSend.clear();
@@ -376,6 +444,14 @@ public:
     typedef std::multimap<int64_t, TxPair > TxItems;
     TxItems wtxOrdered;
 
+    /**
+     * Wallet transactions by the hash of the block they were included in (0
+     * for none), so listsinceblock only looks at the blocks it reports on.
+     */
+    std::map<uint256, std::set<uint256> > mapTxByBlock;
+    //! Blocks in mapTxByBlock that may no longer be part of the active chain
+    std::set<uint256> setTxBlocksMaybeStale;
+
     int64_t nOrderPosNext;
     std::map<uint256, int> mapRequestCount;
 
@@ -397,6 +473,8 @@ public:
     }
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = NULL, bool fIncludeZeroValue = false, AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false, int nWatchonlyConfig = 1) const;
+    //! AvailableCoins() for a plain send of nTargetValue, served from the coin index
+    void GetIndexedCoins(const CAmount& nTargetValue, std::vector<COutput>& vCoins) const;
     std::map<CBitcoinAddress, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
@@ -417,6 +495,7 @@ public:
     //  keystore implementation
     // Generate a new key
     CPubKey GenerateNewKey();
+    void GenerateNewKeys(unsigned int nKeys, std::vector<CPubKey>& vPubKeys);
 
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey& pubkey);
@@ -479,7 +558,11 @@ public:
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
+    void AddTxByBlock(const uint256& hashTx, const uint256& hashBlock);
+    void RemoveTxByBlock(const uint256& hashTx, const uint256& hashBlock);
+    void GetTransactionsSince(const CBlockIndex* pindex, std::vector<const CWalletTx*>& vwtx);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    void GetScriptPubKeys(std::set<CScript>& setScripts) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
     CAmount GetBalance() const;
@@ -534,6 +617,8 @@ public:
 
     bool NewKeyPool();
     bool TopUpKeyPool(unsigned int kpSize = 0);
+    void RecordKeyPoolRefill(int64_t nKeys, int64_t nMicros);
+    void RecordStakeHashing(int64_t nHashes, int64_t nMicros, unsigned int nThreads);
     void ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool);
     void KeepKey(int64_t nIndex);
     void ReturnKey(int64_t nIndex);
@@ -395,6 +395,11 @@ DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
     }
     WriteOrderPosNext(nOrderPosNext);
 
+    // wtxOrdered was filled with the old positions while loading
+    pwallet->wtxOrdered.clear();
+    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it)
+        pwallet->wtxOrdered.insert(make_pair(it->second.nOrderPos, CWallet::TxPair(&it->second, (CAccountingEntry*)0)));
+
     return DB_LOAD_OK;
 }
 
@@ -418,30 +423,41 @@ public:
     }
 };
 
-bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CWalletScanState& wss, string& strType, string& strErr)
+/**
+ * A "tx", "key" or "wkey" record, decoded and checked. Decoding these needs no
+ * access to the wallet and is where loading spends its time (checking and
+ * hashing transactions, re-deriving public keys of old wallets), so
+ * LoadWallet does it on worker threads.
+ */
+struct CWalletDecodedRecord {
+    bool fOk;
+    std::string strErr;
+    uint256 hash;
+    CWalletTx wtx;
+    bool fUpgraded;
+    CPubKey vchPubKey;
+    CKey key;
+
+    CWalletDecodedRecord() : fOk(false), fUpgraded(false) {}
+};
+
+static bool IsDecodedType(const string& strType)
+{
+    return (strType == "tx" || strType == "key" || strType == "wkey");
+}
+
+//! Decode a record of one of the IsDecodedType() types. ssKey must be positioned after the type.
+static void DecodeWalletRecord(const string& strType, CDataStream& ssKey, CDataStream& ssValue, CWalletDecodedRecord& rec)
 {
     try {
-        // Unserialize
-        // Taking advantage of the fact that pair serialization
-        // is just the two items serialized one after the other
-        ssKey >> strType;
-        if (strType == "name") {
-            string strAddress;
-            ssKey >> strAddress;
-            ssValue >> pwallet->mapAddressBook[CBitcoinAddress(strAddress).Get()].name;
-        } else if (strType == "purpose") {
-            string strAddress;
-            ssKey >> strAddress;
-            ssValue >> pwallet->mapAddressBook[CBitcoinAddress(strAddress).Get()].purpose;
-        } else if (strType == "tx") {
-            uint256 hash;
-            ssKey >> hash;
-            CWalletTx wtx;
+        if (strType == "tx") {
+            ssKey >> rec.hash;
+            CWalletTx& wtx = rec.wtx;
             ssValue >> wtx;
             CValidationState state;
             // false because there is no reason to go through the zerocoin checks for our own wallet
-            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
-                return false;
+            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == rec.hash) && state.IsValid()))
+                return;
 
             // Undo serialize changes in 31600
             if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703) {
@@ -449,69 +465,26 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
                     char fTmp;
                     char fUnused;
                     ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                        wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+                    rec.strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                        wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, rec.hash.ToString());
                     wtx.fTimeReceivedIsTxTime = fTmp;
                 } else {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+                    rec.strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, rec.hash.ToString());
                     wtx.fTimeReceivedIsTxTime = 0;
                 }
-                wss.vWalletUpgrade.push_back(hash);
+                rec.fUpgraded = true;
             }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->AddToWallet(wtx, true);
-        } else if (strType == "acentry") {
-            string strAccount;
-            ssKey >> strAccount;
-            uint64_t nNumber;
-            ssKey >> nNumber;
-            if (nNumber > nAccountingEntryNumber)
-                nAccountingEntryNumber = nNumber;
-
-            if (!wss.fAnyUnordered) {
-                CAccountingEntry acentry;
-                ssValue >> acentry;
-                if (acentry.nOrderPos == -1)
-                    wss.fAnyUnordered = true;
-            }
-        } else if (strType == "watchs") {
-            CScript script;
-            ssKey >> script;
-            char fYes;
-            ssValue >> fYes;
-            if (fYes == '1')
-                pwallet->LoadWatchOnly(script);
-
-            // Watch-only addresses have no birthday information for now,
-            // so set the wallet birthday to the beginning of time.
-            pwallet->nTimeFirstKey = 1;
-        } else if (strType == "multisig") {
-            CScript script;
-            ssKey >> script;
-            char fYes;
-            ssValue >> fYes;
-            if (fYes == '1')
-                pwallet->LoadMultiSig(script);
-
-            // MultiSig addresses have no birthday information for now,
-            // so set the wallet birthday to the beginning of time.
-            pwallet->nTimeFirstKey = 1;
-        } else if (strType == "key" || strType == "wkey") {
-            CPubKey vchPubKey;
+        } else {
+            CPubKey& vchPubKey = rec.vchPubKey;
             ssKey >> vchPubKey;
             if (!vchPubKey.IsValid()) {
-                strErr = "Error reading wallet database: CPubKey corrupt";
-                return false;
+                rec.strErr = "Error reading wallet database: CPubKey corrupt";
+                return;
             }
-            CKey key;
             CPrivKey pkey;
             uint256 hash = 0;
 
             if (strType == "key") {
-                wss.nKeys++;
                 ssValue >> pkey;
             } else {
                 CWalletKey wkey;
@@ -539,21 +512,102 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
                 vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
 
                 if (Hash(vchKey.begin(), vchKey.end()) != hash) {
-                    strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
-                    return false;
+                    rec.strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
+                    return;
                 }
 
                 fSkipCheck = true;
             }
 
-            if (!key.Load(pkey, vchPubKey, fSkipCheck)) {
-                strErr = "Error reading wallet database: CPrivKey corrupt";
-                return false;
+            if (!rec.key.Load(pkey, vchPubKey, fSkipCheck)) {
+                rec.strErr = "Error reading wallet database: CPrivKey corrupt";
+                return;
             }
-            if (!pwallet->LoadKey(key, vchPubKey)) {
-                strErr = "Error reading wallet database: LoadKey failed";
-                return false;
+        }
+        rec.fOk = true;
+    } catch (...) {
+    }
+}
+
+//! Merge a record decoded by DecodeWalletRecord into the wallet
+static bool ApplyDecodedRecord(CWallet* pwallet, const string& strType, CWalletDecodedRecord& rec, CWalletScanState& wss, string& strErr)
+{
+    strErr = rec.strErr;
+    if (strType == "key" && rec.vchPubKey.IsValid())
+        wss.nKeys++;
+    if (!rec.fOk)
+        return false;
+
+    if (strType == "tx") {
+        if (rec.fUpgraded)
+            wss.vWalletUpgrade.push_back(rec.hash);
+
+        if (rec.wtx.nOrderPos == -1)
+            wss.fAnyUnordered = true;
+
+        pwallet->AddToWallet(rec.wtx, true);
+    } else if (!pwallet->LoadKey(rec.key, rec.vchPubKey)) {
+        strErr = "Error reading wallet database: LoadKey failed";
+        return false;
+    }
+    return true;
+}
+
+bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CWalletScanState& wss, string& strType, string& strErr)
+{
+    try {
+        // Unserialize
+        // Taking advantage of the fact that pair serialization
+        // is just the two items serialized one after the other
+        ssKey >> strType;
+        if (IsDecodedType(strType)) {
+            CWalletDecodedRecord rec;
+            DecodeWalletRecord(strType, ssKey, ssValue, rec);
+            return ApplyDecodedRecord(pwallet, strType, rec, wss, strErr);
+        } else if (strType == "name") {
+            string strAddress;
+            ssKey >> strAddress;
+            ssValue >> pwallet->mapAddressBook[CBitcoinAddress(strAddress).Get()].name;
+        } else if (strType == "purpose") {
+            string strAddress;
+            ssKey >> strAddress;
+            ssValue >> pwallet->mapAddressBook[CBitcoinAddress(strAddress).Get()].purpose;
+        } else if (strType == "acentry") {
+            string strAccount;
+            ssKey >> strAccount;
+            uint64_t nNumber;
+            ssKey >> nNumber;
+            if (nNumber > nAccountingEntryNumber)
+                nAccountingEntryNumber = nNumber;
+
+            if (!wss.fAnyUnordered) {
+                CAccountingEntry acentry;
+                ssValue >> acentry;
+                if (acentry.nOrderPos == -1)
+                    wss.fAnyUnordered = true;
             }
+        } else if (strType == "watchs") {
+            CScript script;
+            ssKey >> script;
+            char fYes;
+            ssValue >> fYes;
+            if (fYes == '1')
+                pwallet->LoadWatchOnly(script);
+
+            // Watch-only addresses have no birthday information for now,
+            // so set the wallet birthday to the beginning of time.
+            pwallet->nTimeFirstKey = 1;
+        } else if (strType == "multisig") {
+            CScript script;
+            ssKey >> script;
+            char fYes;
+            ssValue >> fYes;
+            if (fYes == '1')
+                pwallet->LoadMultiSig(script);
+
+            // MultiSig addresses have no birthday information for now,
+            // so set the wallet birthday to the beginning of time.
+            pwallet->nTimeFirstKey = 1;
         } else if (strType == "mkey") {
             unsigned int nID;
             ssKey >> nID;
@@ -672,10 +726,54 @@ static bool IsKeyType(string strType)
             strType == "mkey" || strType == "ckey");
 }
 
+//! Records LoadWallet reads off the cursor before decoding them together
+static const unsigned int WALLET_LOAD_CHUNK = 4096;
+
+namespace
+{
+struct CWalletLoadRecord {
+    CDataStream ssKey;
+    CDataStream ssValue;
+    string strType;
+    bool fDecode;
+    CWalletDecodedRecord decoded;
+
+    CWalletLoadRecord() : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), fDecode(false) {}
+};
+
+//! Decode every nStep'th record of the chunk starting at nFirst, so the threads share the costly records evenly
+void DecodeWalletRecords(std::vector<CWalletLoadRecord>& vRecords, unsigned int nRecords, unsigned int nFirst, unsigned int nStep)
+{
+    for (unsigned int i = nFirst; i < nRecords; i += nStep) {
+        CWalletLoadRecord& record = vRecords[i];
+        if (!record.fDecode)
+            continue;
+        try {
+            string strType;
+            record.ssKey >> strType;
+        } catch (...) {
+            continue;
+        }
+        DecodeWalletRecord(record.strType, record.ssKey, record.ssValue, record.decoded);
+    }
+}
+
+//! Where LoadWallet spends its time, for the debug log
+struct CWalletLoadTimings {
+    uint64_t nRecords;
+    int64_t nReadMicros;
+    int64_t nDecodeMicros;
+    int64_t nApplyMicros;
+
+    CWalletLoadTimings() : nRecords(0), nReadMicros(0), nDecodeMicros(0), nApplyMicros(0) {}
+};
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
     CWalletScanState wss;
+    CWalletLoadTimings timings;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
 
@@ -695,35 +793,75 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
-        while (true) {
-            // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
-                break;
-            else if (ret != 0) {
-                LogPrintf("Error reading next record from wallet database\n");
-                return DB_CORRUPT;
+        // Records are read off the cursor in chunks. The transactions and keys
+        // of a chunk are decoded on worker threads, then all records are
+        // merged into the wallet in their original order on this thread.
+        unsigned int nThreads = std::max(1U, boost::thread::hardware_concurrency());
+        std::vector<CWalletLoadRecord> vRecords(WALLET_LOAD_CHUNK);
+        bool fEnd = false;
+        while (!fEnd) {
+            int64_t nStart = GetTimeMicros();
+            unsigned int nRecords = 0;
+            while (nRecords < vRecords.size()) {
+                // Read next record
+                CWalletLoadRecord& record = vRecords[nRecords];
+                int ret = ReadAtCursor(pcursor, record.ssKey, record.ssValue);
+                if (ret == DB_NOTFOUND) {
+                    fEnd = true;
+                    break;
+                } else if (ret != 0) {
+                    LogPrintf("Error reading next record from wallet database\n");
+                    return DB_CORRUPT;
+                }
+                record.strType.clear();
+                try {
+                    CDataStream ssType(record.ssKey.begin(), record.ssKey.end(), SER_DISK, CLIENT_VERSION);
+                    ssType >> record.strType;
+                } catch (...) {
+                }
+                record.fDecode = IsDecodedType(record.strType);
+                record.decoded = CWalletDecodedRecord();
+                nRecords++;
             }
-
-            // Try to be tolerant of single corrupt records:
-            string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr)) {
-                // losing keys is considered a catastrophic error, anything else
-                // we assume the user can live with:
-                if (IsKeyType(strType))
-                    result = DB_CORRUPT;
-                else {
-                    // Leave other errors alone, if we try to fix them we might make things worse.
-                    fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
-                    if (strType == "tx")
-                        // Rescan if there is a bad transaction record:
-                        SoftSetBoolArg("-rescan", true);
+            timings.nRecords += nRecords;
+            timings.nReadMicros += GetTimeMicros() - nStart;
+
+            nStart = GetTimeMicros();
+            boost::thread_group threadGroup;
+            for (unsigned int i = 1; i < nThreads && i < nRecords; i++)
+                threadGroup.create_thread(boost::bind(&DecodeWalletRecords, boost::ref(vRecords), nRecords, i, nThreads));
+            DecodeWalletRecords(vRecords, nRecords, 0, nThreads);
+            threadGroup.join_all();
+            timings.nDecodeMicros += GetTimeMicros() - nStart;
+
+            nStart = GetTimeMicros();
+            for (unsigned int i = 0; i < nRecords; i++) {
+                CWalletLoadRecord& record = vRecords[i];
+                // Try to be tolerant of single corrupt records:
+                string strType, strErr;
+                bool fOk;
+                if (record.fDecode) {
+                    strType = record.strType;
+                    fOk = ApplyDecodedRecord(pwallet, strType, record.decoded, wss, strErr);
+                } else
+                    fOk = ReadKeyValue(pwallet, record.ssKey, record.ssValue, wss, strType, strErr);
+                if (!fOk) {
+                    // losing keys is considered a catastrophic error, anything else
+                    // we assume the user can live with:
+                    if (IsKeyType(strType))
+                        result = DB_CORRUPT;
+                    else {
+                        // Leave other errors alone, if we try to fix them we might make things worse.
+                        fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
+                        if (strType == "tx")
+                            // Rescan if there is a bad transaction record:
+                            SoftSetBoolArg("-rescan", true);
+                    }
                 }
+                if (!strErr.empty())
+                    LogPrintf("%s\n", strErr);
             }
-            if (!strErr.empty())
-                LogPrintf("%s\n", strErr);
+            timings.nApplyMicros += GetTimeMicros() - nStart;
         }
         pcursor->close();
     } catch (boost::thread_interrupted) {
@@ -740,6 +878,10 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     if (result != DB_LOAD_OK)
         return result;
 
+    LogPrintf("Wallet records: %u read in %dms, decoded in %dms, merged in %dms\n", timings.nRecords,
+        timings.nReadMicros / 1000, timings.nDecodeMicros / 1000, timings.nApplyMicros / 1000);
+    int64_t nStart = GetTimeMicros();
+
     LogPrintf("nFileVersion = %d\n", wss.nFileVersion);
 
     LogPrintf("Keys: %u plaintext, %u encrypted, %u w/ metadata, %u total\n",
@@ -767,6 +909,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     BOOST_FOREACH(CAccountingEntry& entry, pwallet->laccentries) {
         pwallet->wtxOrdered.insert(make_pair(entry.nOrderPos, CWallet::TxPair((CWalletTx*)0, &entry)));
     }
+    LogPrintf("Wallet upgrades, reordering and accounting entries took %dms\n", (GetTimeMicros() - nStart) / 1000);
 
     return result;
 }
@@ -848,6 +991,30 @@ DBErrors CWalletDB::ZapWalletTx(CWallet* pwallet, vector<CWalletTx>& vWtx)
     return DB_LOAD_OK;
 }
 
+CWalletDBBatch::CWalletDBBatch(CWallet& walletIn) : wallet(walletIn), pwalletdb(NULL), fTxn(false)
+{
+    AssertLockHeld(wallet.cs_wallet);
+    if (wallet.pwalletdbBatch)
+        return;
+    pwalletdb = new CWalletDB(wallet.strWalletFile);
+    // Without a transaction the writes still share the handle, they are just not grouped
+    fTxn = pwalletdb->TxnBegin();
+    wallet.pwalletdbBatch = pwalletdb;
+}
+
+CWalletDBBatch::~CWalletDBBatch()
+{
+    if (!pwalletdb)
+        return;
+    wallet.pwalletdbBatch = NULL;
+    if (fTxn && !pwalletdb->TxnCommit())
+        LogPrintf("CWalletDBBatch : committing wallet batch failed\n");
+    delete pwalletdb;
+}
+
+//! Flush at least this often while the wallet keeps being written to (seconds)
+static const int64_t WALLET_FLUSH_MAX_DELAY = 30;
+
 void ThreadFlushWalletDB(const string& strFile)
 {
     // Make this thread recognisable as the wallet flushing thread
@@ -863,15 +1030,22 @@ void ThreadFlushWalletDB(const string& strFile)
     unsigned int nLastSeen = nWalletDBUpdated;
     unsigned int nLastFlushed = nWalletDBUpdated;
     int64_t nLastWalletUpdate = GetTime();
+    int64_t nFirstUnflushed = 0;
     while (true) {
         MilliSleep(500);
 
         if (nLastSeen != nWalletDBUpdated) {
             nLastSeen = nWalletDBUpdated;
             nLastWalletUpdate = GetTime();
+            if (!nFirstUnflushed)
+                nFirstUnflushed = nLastWalletUpdate;
         }
 
-        if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2) {
+        // Wait for the wallet to go quiet, but don't let a steady stream of
+        // writes (staking, payouts) hold off the flush indefinitely
+        bool fIdle = GetTime() - nLastWalletUpdate >= 2;
+        bool fOverdue = nFirstUnflushed && GetTime() - nFirstUnflushed >= WALLET_FLUSH_MAX_DELAY;
+        if (nLastFlushed != nWalletDBUpdated && (fIdle || fOverdue)) {
             TRY_LOCK(bitdb.cs_db, lockDb);
             if (lockDb) {
                 // Don't do this if any databases are in use
@@ -888,14 +1062,16 @@ void ThreadFlushWalletDB(const string& strFile)
                     if (mi != bitdb.mapFileUseCount.end()) {
                         LogPrint("db", "Flushing wallet.dat\n");
                         nLastFlushed = nWalletDBUpdated;
-                        int64_t nStart = GetTimeMillis();
+                        nFirstUnflushed = 0;
+                        int64_t nStart = GetTimeMicros();
 
                         // Flush wallet.dat so it's self contained
                         bitdb.CloseDb(strFile);
                         bitdb.CheckpointLSN(strFile);
 
                         bitdb.mapFileUseCount.erase(mi++);
-                        LogPrint("db", "Flushed wallet.dat %dms\n", GetTimeMillis() - nStart);
+                        bitdb.RecordFlush(GetTimeMicros() - nStart);
+                        LogPrint("db", "Flushed wallet.dat %dms\n", (GetTimeMicros() - nStart) / 1000);
                     }
                 }
             }
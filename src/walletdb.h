@@ -199,6 +199,31 @@ private:
     bool WriteAccountingEntry(const uint64_t nAccEntryNum, const CAccountingEntry& acentry);
 };
 
+/**
+ * Groups the wallet writes of one logical operation (committing a transaction,
+ * topping up the keypool, a rescan batch) into a single database transaction,
+ * so the burst costs one commit and one checkpoint instead of one per record.
+ * While it lives, CWallet routes its writes through pwalletdbBatch; a nested
+ * batch joins the outer one. cs_wallet must be held for its whole lifetime, and nothing in
+ * its scope may open a CWalletDB of its own, as that would wait on the locks
+ * of the open transaction.
+ */
+class CWalletDBBatch
+{
+private:
+    CWallet& wallet;
+    //! Handle owned by this batch, NULL if it joined an outer one
+    CWalletDB* pwalletdb;
+    bool fTxn;
+
+    CWalletDBBatch(const CWalletDBBatch&);
+    void operator=(const CWalletDBBatch&);
+
+public:
+    explicit CWalletDBBatch(CWallet& walletIn);
+    ~CWalletDBBatch();
+};
+
 void NotifyBacked(const CWallet& wallet, bool fSuccess, string strMessage);
 bool BackupWallet(const CWallet& wallet, const boost::filesystem::path& strDest, bool fEnableCustom = true);
 bool AttemptBackupWallet(const CWallet& wallet, const boost::filesystem::path& pathSrc, const boost::filesystem::path& pathDest);